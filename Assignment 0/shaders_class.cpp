@@ -1,9 +1,12 @@
 ﻿#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <learnopengl/shader_s.h>
+#include <learnopengl/offline.h>
 #include <iostream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -13,62 +16,181 @@ struct Vertex {
     float r, g, b;
 };
 
+// Append-only GPU vertex stream. Storage grows geometrically, appends upload
+// only the new bytes with glBufferSubData and removals just move the end
+// marker, so the cost of an edit does not depend on the chain length.
+struct StreamBuffer {
+    unsigned int id = 0;
+    size_t capacity = 0;        // bytes of GPU storage
+    size_t size = 0;            // bytes in use
+    size_t lastUpload = 0;      // bytes sent by the last edit
+    size_t totalUploaded = 0;
+    unsigned int reallocations = 0;
+
+    void create(size_t initialCapacity)
+    {
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(GL_ARRAY_BUFFER, initialCapacity, nullptr, GL_DYNAMIC_DRAW);
+        capacity = initialCapacity;
+    }
+
+    void append(const void* data, size_t bytes)
+    {
+        if (size + bytes > capacity)
+            grow(size + bytes);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferSubData(GL_ARRAY_BUFFER, size, bytes, data);
+        size += bytes;
+        lastUpload = bytes;
+        totalUploaded += bytes;
+    }
+
+    // Dropping the tail needs no transfer, the draw count simply shrinks.
+    void truncate(size_t bytes)
+    {
+        if (bytes < size)
+            size = bytes;
+        lastUpload = 0;
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &id);
+        id = 0;
+        capacity = size = 0;
+    }
+
+private:
+    // Keeps the same buffer name so the VAO binding stays valid: the live
+    // range is copied GPU-side into a scratch buffer and back into the
+    // enlarged storage, nothing is re-sent from the CPU.
+    void grow(size_t required)
+    {
+        size_t newCapacity = capacity ? capacity : 1024;
+        while (newCapacity < required)
+            newCapacity *= 2;
+
+        unsigned int scratch = 0;
+        if (size > 0) {
+            glGenBuffers(1, &scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_COPY);
+            glBindBuffer(GL_COPY_READ_BUFFER, id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(GL_ARRAY_BUFFER, newCapacity, nullptr, GL_DYNAMIC_DRAW);
+
+        if (scratch) {
+            glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+            glDeleteBuffers(1, &scratch);
+        }
+        capacity = newCapacity;
+        reallocations++;
+    }
+};
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void addTriangle(float ndcX, float ndcY);
+void undoTriangle();
+void resetChain();
+void runStressTest(unsigned int edits);
 
-unsigned int VBO, VAO;
+// Each triangle shares its first edge with the previous one, so the chain is
+// stored as a triangle strip: triangle i is vertices[i], [i+1], [i+2] and every
+// click adds a single vertex instead of copying the shared edge.
+unsigned int VAO;
+StreamBuffer stream;
 std::vector<Vertex> vertices;
 
-int main()
+size_t triangleCount()
+{
+    return vertices.size() >= 3 ? vertices.size() - 2 : 0;
+}
+
+int main(int argc, char** argv)
 {
+    // --stress [edits]: hidden window, synthetic click stream, report and exit
+    bool stressMode = argc > 1 && std::strcmp(argv[1], "--stress") == 0;
+    unsigned int stressEdits = 2000000;
+    if (stressMode && argc > 2)
+        stressEdits = static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10));
+
+    OfflineRenderer offline(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+
     // GLFW init
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Triangle Growth", NULL, NULL);
-    if (!window) { std::cout << "Failed to create GLFW window\n"; glfwTerminate(); return -1; }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
-
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD\n"; return -1;
+    GLFWwindow* window = NULL;
+    if (offline.active) {
+        if (!offline.createContext())
+            return -1;
+    }
+    else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (stressMode)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Triangle Growth", NULL, NULL);
+        if (!window) { std::cout << "Failed to create GLFW window\n"; glfwTerminate(); return -1; }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD\n"; return -1;
+        }
     }
 
     Shader shader("3.3.shader.vs", "3.3.shader.fs");
 
     // VAO / VBO setup
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    stream.create(1024 * sizeof(Vertex));
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    if (stressMode) {
+        runStressTest(stressEdits);
+        glDeleteVertexArrays(1, &VAO);
+        stream.destroy();
+        glfwTerminate();
+        return 0;
+    }
+
     // Render loop
-    while (!glfwWindowShouldClose(window))
+    while (!offline.shouldClose(window))
     {
-        processInput(window);
+        if (window)
+            processInput(window);
+        else // offline: one synthetic click per frame
+            addTriangle(static_cast<float>(rand() % 2000) / 1000.0f - 1.0f,
+                        static_cast<float>(rand() % 2000) / 1000.0f - 1.0f);
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
         shader.use();
         glBindVertexArray(VAO);
         if (!vertices.empty())
-            glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, vertices.size());
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        offline.present(window);
     }
 
+    offline.finish();
     glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    stream.destroy();
     glfwTerminate();
     return 0;
 }
@@ -81,22 +203,10 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
 
     if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
-    {
-        vertices.clear();
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
-    }
+        resetChain();
     bool rPressed = glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS;
-    if (rPressed && !rPressedLastFrame) {
-        if (vertices.size() >= 3) {
-            vertices.pop_back();
-            vertices.pop_back();
-            vertices.pop_back();
-
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
-        }
-    }
+    if (rPressed && !rPressedLastFrame)
+        undoTriangle();
     rPressedLastFrame = rPressed;
 }
 
@@ -116,30 +226,93 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         float ndcX = 2.0f * xpos / SCR_WIDTH - 1.0f;
         float ndcY = 1.0f - 2.0f * ypos / SCR_HEIGHT;
 
-        if (vertices.empty())
-        {
-            // First triangle
-            vertices.push_back({ ndcX, ndcY, 0.0f, 1.0f, 0.0f, 0.0f });        // red
-            vertices.push_back({ ndcX + 0.1f, ndcY, 0.0f, 0.0f, 1.0f, 0.0f });  // green
-            vertices.push_back({ ndcX, ndcY + 0.1f, 0.0f, 0.0f, 0.0f, 1.0f });  // blue
-        }
+        addTriangle(ndcX, ndcY);
+    }
+}
+
+void addTriangle(float ndcX, float ndcY)
+{
+    if (vertices.empty())
+    {
+        // First triangle
+        vertices.push_back({ ndcX, ndcY, 0.0f, 1.0f, 0.0f, 0.0f });        // red
+        vertices.push_back({ ndcX + 0.1f, ndcY, 0.0f, 0.0f, 1.0f, 0.0f });  // green
+        vertices.push_back({ ndcX, ndcY + 0.1f, 0.0f, 0.0f, 0.0f, 1.0f });  // blue
+        stream.append(vertices.data(), 3 * sizeof(Vertex));
+    }
+    else
+    {
+        // New triangle sharing the last edge: the strip reuses the previous
+        // two vertices, only the new one is stored and uploaded
+        Vertex vnew = { ndcX, ndcY, 0.0f,
+                       static_cast<float>(rand() % 100) / 100.0f,
+                       static_cast<float>(rand() % 100) / 100.0f,
+                       static_cast<float>(rand() % 100) / 100.0f };
+
+        vertices.push_back(vnew);
+        stream.append(&vertices.back(), sizeof(Vertex));
+    }
+}
+
+void undoTriangle()
+{
+    if (vertices.size() > 3)
+        vertices.pop_back();
+    else
+        vertices.clear(); // removing the first triangle empties the strip
+    stream.truncate(vertices.size() * sizeof(Vertex));
+}
+
+void resetChain()
+{
+    vertices.clear();
+    stream.truncate(0);
+}
+
+// Synthetic click stream: random clicks with an undo every 16th edit.
+// Prints upload bytes and time per edit for each tenth of the run, the
+// numbers should stay flat while the chain keeps growing. The last column
+// is the memory the old layout (3 copied vertices per triangle) would need.
+void runStressTest(unsigned int edits)
+{
+    const unsigned int window = edits >= 10 ? edits / 10 : 1;
+    std::printf("%12s %14s %14s %12s %8s %12s\n", "triangles", "bytes/edit", "us/edit", "GPU MB", "reallocs", "list MB");
+
+    srand(1234);
+    size_t windowBytes = 0;
+    double windowStart = glfwGetTime();
+    for (unsigned int i = 1; i <= edits; i++)
+    {
+        if (i % 16 == 0)
+            undoTriangle();
         else
+            addTriangle(static_cast<float>(rand() % 2000) / 1000.0f - 1.0f,
+                        static_cast<float>(rand() % 2000) / 1000.0f - 1.0f);
+        windowBytes += stream.lastUpload;
+
+        if (i % window == 0 || i == edits)
         {
-            // New triangle sharing the last edge
-            Vertex v1 = vertices[vertices.size() - 2];  // previous vertex 1
-            Vertex v2 = vertices[vertices.size() - 1];  // previous vertex 2
-            Vertex vnew = { ndcX, ndcY, 0.0f,
-                           static_cast<float>(rand() % 100) / 100.0f,
-                           static_cast<float>(rand() % 100) / 100.0f,
-                           static_cast<float>(rand() % 100) / 100.0f };
-
-            vertices.push_back(v1);
-            vertices.push_back(v2);
-            vertices.push_back(vnew);
+            glFinish(); // include the driver's deferred work in the window
+            double now = glfwGetTime();
+            unsigned int count = i % window == 0 ? window : i % window;
+            std::printf("%12zu %14.1f %14.3f %12.1f %8u %12.1f\n",
+                triangleCount(),
+                static_cast<double>(windowBytes) / count,
+                (now - windowStart) * 1e6 / count,
+                stream.capacity / (1024.0 * 1024.0),
+                stream.reallocations,
+                triangleCount() * 3 * sizeof(Vertex) / (1024.0 * 1024.0));
+            windowBytes = 0;
+            windowStart = glfwGetTime();
         }
-
-        // Update GPU
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
     }
-}
\ No newline at end of file
+    std::printf("total uploaded: %.1f MB for %u edits\n", stream.totalUploaded / (1024.0 * 1024.0), edits);
+
+    // Same edits with the old layout: every click appended three vertices
+    double stripBytes = static_cast<double>(vertices.size() * sizeof(Vertex));
+    double listBytes = static_cast<double>(triangleCount() * 3 * sizeof(Vertex));
+    std::printf("strip: %.1f MB, triangle list: %.1f MB (%.2fx), upload per click: %zu vs %zu bytes\n",
+        stripBytes / (1024.0 * 1024.0), listBytes / (1024.0 * 1024.0),
+        stripBytes > 0.0 ? listBytes / stripBytes : 0.0,
+        sizeof(Vertex), 3 * sizeof(Vertex));
+}
@@ -2,42 +2,135 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <learnopengl/shader_s.h>
+#define LEARNOPENGL_COUNT_ALLOCATIONS
+#include <learnopengl/uniforms.h>
+#include <learnopengl/offline.h>
 #include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float PIXEL_SIZE = 8.0f; // must match pixelSize in the shaders
+
+// Per-column wave height and colour. Everything in the waveform except the
+// final compare against the row depends only on the column, so it is
+// evaluated here once per column per frame instead of once per fragment and
+// handed to 5.1.transform.fs as a (columns x 1) texture.
+struct WaveColumns {
+    unsigned int texture = 0;
+    int capacity = 0;
+    std::vector<float> texels;
+
+    void update(float time, float width, float height)
+    {
+        int count = (int)std::ceil(width / PIXEL_SIZE);
+        if (count > capacity)
+            allocate(count);
+
+        float rows = height / PIXEL_SIZE;
+        for (int x = 0; x < count; x++)
+        {
+            // same math as the reference shader
+            float phase = x * 0.15f;
+            float wave = 0.5f + 0.25f * std::sin(phase - time * 2.0f);
+            wave += 0.2f * std::sin(time * 1.5f + x * 0.1f);
+            wave = std::fmin(std::fmax(wave, 0.0f), 1.0f);
+            float waveBlock = std::floor(wave * rows * rows) / rows;
+
+            float t = x / width;
+            float* texel = &texels[x * 4];
+            texel[0] = 0.5f + 0.5f * std::sin(6.2831f * t + 0.0f);
+            texel[1] = 0.5f + 0.5f * std::sin(6.2831f * t + 2.094f);
+            texel[2] = 0.5f + 0.5f * std::sin(6.2831f * t + 4.188f);
+            texel[3] = waveBlock;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, count, 1, GL_RGBA, GL_FLOAT, texels.data());
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+        capacity = 0;
+    }
+
+private:
+    void allocate(int count)
+    {
+        if (!texture)
+            glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, count, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texels.resize(count * 4);
+        capacity = count;
+    }
+};
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+void runBenchmark(int frames, unsigned int VAO, Shader& columnShader, WaveColumns& columns, Shader& referenceShader);
 
-int main()
+int main(int argc, char** argv)
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    OfflineRenderer offline(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+    // --bench [frames]: time both fragment paths at 1080p and 4K, then exit
+    int benchFrames = 0;
+    for (int i = 1; i < argc; i++)
+        if (std::strcmp(argv[i], "--bench") == 0)
+            benchFrames = i + 1 < argc && argv[i + 1][0] != '-' ? std::atoi(argv[i + 1]) : 200;
+
+    GLFWwindow* window = NULL;
+    if (offline.active)
+    {
+        if (!offline.createContext())
+            return -1;
+    }
+    else
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+        if (benchFrames > 0)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "8-Bit Waveform", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window\n";
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "8-Bit Waveform", NULL, NULL);
+        if (!window)
+        {
+            std::cout << "Failed to create GLFW window\n";
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD\n";
-        return -1;
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD\n";
+            return -1;
+        }
     }
+    countUniformLookups();
 
     Shader ourShader("5.1.transform.vs", "5.1.transform.fs");
+    UniformTable uniforms(ourShader.ID);
+    ourShader.use();
+    uniforms.get<int>("uColumns").set(0);
+    WaveColumns columns;
 
     // Full-screen quad
     float vertices[] = {
@@ -62,25 +155,52 @@ int main()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    while (!glfwWindowShouldClose(window))
+    if (benchFrames > 0)
     {
-        processInput(window);
+        Shader referenceShader("5.1.transform.vs", "5.1.transform_perpixel.fs");
+        runBenchmark(benchFrames, VAO, ourShader, columns, referenceShader);
+        columns.destroy();
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glfwTerminate();
+        return 0;
+    }
+
+    FrameCounters counters;
+    double lastTitleUpdate = 0.0;
+
+    while (!offline.shouldClose(window))
+    {
+        if (window)
+            processInput(window);
 
         glClear(GL_COLOR_BUFFER_BIT);
 
+        columns.update(offline.time(), (float)SCR_WIDTH, (float)SCR_HEIGHT);
         ourShader.use();
-        int timeLoc = glGetUniformLocation(ourShader.ID, "uTime");
-        glUniform1f(timeLoc, (float)glfwGetTime());
-        int resLoc = glGetUniformLocation(ourShader.ID, "uResolution");
-        glUniform2f(resLoc, (float)SCR_WIDTH, (float)SCR_HEIGHT);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, columns.texture);
 
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        offline.present(window);
+
+        // Uniform name lookups / heap allocations during the last frame
+        counters.endFrame();
+        if (window && glfwGetTime() - lastTitleUpdate > 1.0)
+        {
+            char title[128];
+            std::snprintf(title, sizeof(title), "8-Bit Waveform | lookups/frame %llu | allocs/frame %llu",
+                counters.lookups, counters.allocations);
+            glfwSetWindowTitle(window, title);
+            lastTitleUpdate = glfwGetTime();
+        }
     }
 
+    offline.finish();
+    columns.destroy();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
@@ -99,3 +219,76 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
 }
+
+// Fragment cost of the column-texture path against the per-fragment reference
+// shader, measured with GPU timer queries into offscreen targets at 1080p and
+// 4K; the column path's GPU time includes its texture upload. The CPU time of
+// filling the columns is timed on the CPU and reported on its own, since a
+// timer query only sees the GPU.
+void runBenchmark(int frames, unsigned int VAO, Shader& columnShader, WaveColumns& columns, Shader& referenceShader)
+{
+    UniformTable referenceUniforms(referenceShader.ID);
+    Uniform<float> uTime = referenceUniforms.get<float>("uTime");
+    Uniform<glm::vec2> uResolution = referenceUniforms.get<glm::vec2>("uResolution");
+
+    const unsigned int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    unsigned int query;
+    glGenQueries(1, &query);
+    glBindVertexArray(VAO);
+
+    std::printf("%-10s %16s %16s %16s %10s\n", "target", "per-pixel ms", "columns ms", "column fill ms", "GPU speedup");
+    for (const auto& size : sizes)
+    {
+        unsigned int fbo, rbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenRenderbuffers(1, &rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size[0], size[1]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+        glViewport(0, 0, size[0], size[1]);
+
+        double ms[2];
+        double fillMs = 0.0;   // CPU, column path
+        for (int path = 0; path < 2; path++)
+        {
+            // one untimed frame to get shader compilation and allocation out of the way
+            for (int i = -1; i < frames; i++)
+            {
+                if (i == 0)
+                    glBeginQuery(GL_TIME_ELAPSED, query);
+                float time = i * (1.0f / 60.0f);
+                if (path == 0)
+                {
+                    referenceShader.use();
+                    uTime.set(time);
+                    uResolution.set(glm::vec2((float)size[0], (float)size[1]));
+                }
+                else
+                {
+                    auto fillStart = std::chrono::steady_clock::now();
+                    columns.update(time, (float)size[0], (float)size[1]);
+                    if (i >= 0)
+                        fillMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fillStart).count();
+                    columnShader.use();
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, columns.texture);
+                }
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            }
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            ms[path] = elapsed / 1e6 / frames;
+        }
+
+        char label[16];
+        std::snprintf(label, sizeof(label), "%ux%u", size[0], size[1]);
+        std::printf("%-10s %16.4f %16.4f %16.4f %10.1fx\n", label, ms[0], ms[1], fillMs / frames, ms[1] > 0.0 ? ms[0] / ms[1] : 0.0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &rbo);
+        glDeleteFramebuffers(1, &fbo);
+    }
+    glDeleteQueries(1, &query);
+}
@@ -0,0 +1,186 @@
+#version 330 core
+out vec4 FragColor;
+
+// Lighting pass of the deferred path: the lighting of 6.multiple_lights.fs,
+// run once per covered pixel on the surface stored by 6.gbuffer.fs
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+struct DirLight {
+    vec3 direction;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    
+    float constant;
+    float linear;
+    float quadratic;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+  
+    float constant;
+    float linear;
+    float quadratic;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;       
+};
+
+// Clustered point lights: CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z
+// exponential depth slices, must match clusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+uniform vec3 viewPos;
+uniform DirLight dirLight;
+uniform SpotLight spotLight;
+
+uniform mat4 view;
+uniform samplerBuffer lightData;        // 2 texels per light: position + radius, color
+uniform usamplerBuffer clusterGrid;     // offset and count into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
+uniform vec2 screenSize;
+uniform float clusterScale;             // slice = log(depth) * clusterScale + clusterBias
+uniform float clusterBias;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gMaterial;
+
+// filled from the G-buffer, so the Calc* functions below are unchanged
+Material material;
+
+// function prototypes
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+PointLight FetchPointLight(int index);
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 positionAmbient = texelFetch(gPosition, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormal, pixel, 0);
+    vec4 diffuseSpecular = texelFetch(gMaterial, pixel, 0);
+    if (normalShininess.w == 0.0)
+        discard; // nothing was drawn here
+    vec3 FragPos = positionAmbient.xyz;
+    material.ambient = vec3(positionAmbient.w);
+    material.diffuse = diffuseSpecular.rgb;
+    material.specular = vec3(diffuseSpecular.a);
+    material.shininess = normalShininess.w;
+
+    vec3 norm = normalShininess.xyz;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    
+    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    
+    // only the lights binned into this fragment's cluster
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    ivec3 cell = ivec3(vec3(gl_FragCoord.xy / screenSize * vec2(CLUSTER_X, CLUSTER_Y), log(depth) * clusterScale + clusterBias));
+    cell = clamp(cell, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    uvec2 range = texelFetch(clusterGrid, cell.x + CLUSTER_X * (cell.y + CLUSTER_Y * cell.z)).xy;
+    for(uint i = 0u; i < range.y; i++)
+        result += CalcPointLight(FetchPointLight(int(texelFetch(lightIndices, int(range.x + i)).r)), norm, FragPos, viewDir);
+    
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+    
+    FragColor = vec4(result, 1.0);
+}
+
+// MODIFIED: Calculations now use material colors instead of textures
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    
+    vec3 ambient = light.ambient * material.ambient;
+    vec3 diffuse = light.diffuse * diff * material.diffuse;
+    vec3 specular = light.specular * spec * material.specular;
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // window the falloff so the light ends exactly at its cluster radius
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+    
+    vec3 ambient = light.ambient * material.ambient;
+    vec3 diffuse = light.diffuse * diff * material.diffuse;
+    vec3 specular = light.specular * spec * material.specular;
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    float theta = dot(lightDir, normalize(-light.direction)); 
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    
+    vec3 ambient = light.ambient * material.ambient;
+    vec3 diffuse = light.diffuse * diff * material.diffuse;
+    vec3 specular = light.specular * spec * material.specular;
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    return (ambient + diffuse + specular);
+}
+
+// Point lights share the attenuation and ambient/diffuse/specular split the
+// two original lights used, only position, radius and color are per light
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(lightData, 2 * index);
+    vec3 color = texelFetch(lightData, 2 * index + 1).rgb;
+
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.constant = 1.0;
+    light.linear = 0.09;
+    light.quadratic = 0.032;
+    light.ambient = color * 0.05;
+    light.diffuse = color * 0.8;
+    light.specular = color;
+    return light;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 330 core
+// G-buffer pass of the deferred path: the same vertex stage as
+// 6.multiple_lights, but instead of lighting the fragment its surface is
+// stored for 6.deferred_lighting.fs
+layout (location = 0) out vec4 gPosition;   // world position, material ambient
+layout (location = 1) out vec4 gNormal;     // normal, material shininess
+layout (location = 2) out vec4 gMaterial;   // material diffuse, material specular
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform Material material;
+
+void main()
+{
+    // ambient and specular are grey in this scene, one channel each is enough
+    gPosition = vec4(FragPos, material.ambient.r);
+    gNormal = vec4(normalize(Normal), material.shininess);
+    gMaterial = vec4(material.diffuse, material.specular.r);
+}
@@ -19,6 +19,7 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
+    float radius;
     
     float constant;
     float linear;
@@ -44,22 +45,33 @@ struct SpotLight {
     vec3 specular;       
 };
 
-// MODIFIED: Reduced to 2 point lights for clarity
-#define NR_POINT_LIGHTS 2
+// Clustered point lights: CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z
+// exponential depth slices, must match clusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
 
 in vec3 FragPos;
 in vec3 Normal;
 
 uniform vec3 viewPos;
 uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
 uniform Material material;
 
+uniform mat4 view;
+uniform samplerBuffer lightData;        // 2 texels per light: position + radius, color
+uniform usamplerBuffer clusterGrid;     // offset and count into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
+uniform vec2 screenSize;
+uniform float clusterScale;             // slice = log(depth) * clusterScale + clusterBias
+uniform float clusterBias;
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+PointLight FetchPointLight(int index);
 
 void main()
 {    
@@ -68,8 +80,13 @@ void main()
     
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
     
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    // only the lights binned into this fragment's cluster
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    ivec3 cell = ivec3(vec3(gl_FragCoord.xy / screenSize * vec2(CLUSTER_X, CLUSTER_Y), log(depth) * clusterScale + clusterBias));
+    cell = clamp(cell, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    uvec2 range = texelFetch(clusterGrid, cell.x + CLUSTER_X * (cell.y + CLUSTER_Y * cell.z)).xy;
+    for(uint i = 0u; i < range.y; i++)
+        result += CalcPointLight(FetchPointLight(int(texelFetch(lightIndices, int(range.x + i)).r)), norm, FragPos, viewDir);
     
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
     
@@ -98,6 +115,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // window the falloff so the light ends exactly at its cluster radius
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
     
     vec3 ambient = light.ambient * material.ambient;
     vec3 diffuse = light.diffuse * diff * material.diffuse;
@@ -127,4 +147,23 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
+}
+
+// Point lights share the attenuation and ambient/diffuse/specular split the
+// two original lights used, only position, radius and color are per light
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(lightData, 2 * index);
+    vec3 color = texelFetch(lightData, 2 * index + 1).rgb;
+
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.constant = 1.0;
+    light.linear = 0.09;
+    light.quadratic = 0.032;
+    light.ambient = color * 0.05;
+    light.diffuse = color * 0.8;
+    light.specular = color;
+    return light;
 }
\ No newline at end of file
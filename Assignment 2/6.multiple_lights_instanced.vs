@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;    // half float
+layout (location = 1) in vec2 aNormal; // octahedral
+layout (location = 3) in mat4 aInstanceModel; // per-instance, occupies locations 3-6
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main()
+{
+    FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+    // instance transforms are rotation + uniform scale, so the upper 3x3 is
+    // already a valid normal matrix up to scale (the fragment stage normalizes)
+    Normal = mat3(aInstanceModel) * octDecode(aNormal);
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,222 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/jobs.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Point light as stored in the light buffer, two RGBA32F texels per light
+struct ClusterLight {
+    glm::vec3 position; // world space
+    float radius;       // the light fades to exactly zero at this distance
+    glm::vec3 color;
+    float padding;
+};
+
+// Cluster grid: CLUSTER_X x CLUSTER_Y screen tiles, CLUSTER_Z exponential
+// depth slices between near and far. Must match the defines in
+// 6.multiple_lights.fs.
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const int MAX_CLUSTER_LIGHTS = 4096;        // light indices are 16 bit
+const int MAX_LIGHTS_PER_CLUSTER = 512;     // further lights in a full cluster are dropped
+
+// Clustered forward lighting. Every frame the lights are binned into the
+// view-space clusters they touch on the CPU, one depth slice per task, and
+// three texture buffers are uploaded once: the lights, an (offset, count)
+// pair per cluster and the compacted light index list. The fragment shader
+// finds its cluster from gl_FragCoord and its view depth and only loops
+// over that cluster's lights.
+class LightClusters
+{
+public:
+    // light data, cluster grid, light index list
+    unsigned int buffers[3] = { 0, 0, 0 };
+    unsigned int textures[3] = { 0, 0, 0 };
+    float nearPlane = 0.1f, farPlane = 100.0f;
+
+    // stats of the last update()
+    size_t indexCount = 0;
+    unsigned int maxPerCluster = 0;
+    unsigned int dropped = 0;
+
+    void create(float near, float far)
+    {
+        nearPlane = near;
+        farPlane = far;
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        scratch.resize((size_t)CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        counts.resize(CLUSTER_COUNT);
+        grid.resize(2 * CLUSTER_COUNT);
+        indices.reserve(CLUSTER_COUNT * 16);
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    // Bins the lights for this camera and uploads all three buffers. With
+    // cull = false every cluster references every light, which is the cost of
+    // plain forward shading with the same shader.
+    void update(JobScheduler& jobs, const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection, bool cull = true)
+    {
+        size_t count = std::min<size_t>(lights.size(), MAX_CLUSTER_LIGHTS);
+        indices.clear();
+        dropped = 0;
+        if (cull)
+        {
+            viewLights.resize(count);
+            for (size_t i = 0; i < count; i++)
+                viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+
+            float p00 = projection[0][0], p11 = projection[1][1];
+            jobs.parallelFor(CLUSTER_Z, 1, [&](size_t begin, size_t end) {
+                for (size_t z = begin; z < end; z++)
+                    binSlice((int)z, p00, p11);
+            });
+
+            maxPerCluster = 0;
+            for (int c = 0; c < CLUSTER_COUNT; c++)
+            {
+                unsigned int n = std::min<unsigned int>(counts[c], MAX_LIGHTS_PER_CLUSTER);
+                dropped += counts[c] - n;
+                maxPerCluster = std::max(maxPerCluster, n);
+                grid[2 * c] = (uint32_t)indices.size();
+                grid[2 * c + 1] = n;
+                indices.insert(indices.end(), &scratch[(size_t)c * MAX_LIGHTS_PER_CLUSTER], &scratch[(size_t)c * MAX_LIGHTS_PER_CLUSTER] + n);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
+                indices.push_back((uint16_t)i);
+            for (int c = 0; c < CLUSTER_COUNT; c++)
+            {
+                grid[2 * c] = 0;
+                grid[2 * c + 1] = (uint32_t)count;
+            }
+            maxPerCluster = (unsigned int)count;
+        }
+        indexCount = indices.size();
+
+        upload(0, lights.data(), count * sizeof(ClusterLight));
+        upload(1, grid.data(), grid.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint16_t));
+    }
+
+    // binds the light, grid and index textures to three consecutive units
+    void bind(int firstUnit) const
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // slice = log(depth) * depthScale() + depthBias()
+    float depthScale() const { return CLUSTER_Z / std::log(farPlane / nearPlane); }
+    float depthBias() const { return -CLUSTER_Z * std::log(nearPlane) / std::log(farPlane / nearPlane); }
+
+private:
+    std::vector<glm::vec4> viewLights;  // view-space center, radius
+    std::vector<uint16_t> scratch;      // MAX_LIGHTS_PER_CLUSTER slots per cluster
+    std::vector<uint32_t> counts;       // lights that touched each cluster
+    std::vector<uint32_t> grid;         // offset, count per cluster
+    std::vector<uint16_t> indices;      // compacted light lists
+
+    float sliceDepth(int z) const { return nearPlane * std::pow(farPlane / nearPlane, (float)z / CLUSTER_Z); }
+
+    void upload(int i, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Each slice writes only its own clusters, so slices run in parallel.
+    // A light's screen-tile range comes from the projected bounds of its box
+    // within the slice; each candidate cluster is then checked with an exact
+    // sphere / view-space AABB test.
+    void binSlice(int z, float p00, float p11)
+    {
+        float dn = sliceDepth(z), df = sliceDepth(z + 1);
+        int first = z * CLUSTER_X * CLUSTER_Y;
+        std::memset(&counts[first], 0, CLUSTER_X * CLUSTER_Y * sizeof(uint32_t));
+
+        for (size_t i = 0; i < viewLights.size(); i++)
+        {
+            glm::vec4 light = viewLights[i];
+            float r = light.w, depth = -light.z;
+            if (depth + r < dn || depth - r > df)
+                continue;
+            float d0 = std::max(dn, depth - r), d1 = std::min(df, depth + r);
+
+            // x / d is smallest at the nearest depth for negative x and at
+            // the farthest depth for positive x, likewise for the maximum
+            float xmin = light.x - r, xmax = light.x + r, ymin = light.y - r, ymax = light.y + r;
+            float nx0 = p00 * (xmin < 0.0f ? xmin / d0 : xmin / d1);
+            float nx1 = p00 * (xmax > 0.0f ? xmax / d0 : xmax / d1);
+            float ny0 = p11 * (ymin < 0.0f ? ymin / d0 : ymin / d1);
+            float ny1 = p11 * (ymax > 0.0f ? ymax / d0 : ymax / d1);
+            if (nx1 < -1.0f || nx0 > 1.0f || ny1 < -1.0f || ny0 > 1.0f)
+                continue;
+            int tx0 = tile(nx0, CLUSTER_X), tx1 = tile(nx1, CLUSTER_X);
+            int ty0 = tile(ny0, CLUSTER_Y), ty1 = tile(ny1, CLUSTER_Y);
+
+            for (int ty = ty0; ty <= ty1; ty++)
+            {
+                float ay0 = ty * 2.0f / CLUSTER_Y - 1.0f, ay1 = (ty + 1) * 2.0f / CLUSTER_Y - 1.0f;
+                float by0 = std::min(ay0 * dn, ay0 * df) / p11, by1 = std::max(ay1 * dn, ay1 * df) / p11;
+                for (int tx = tx0; tx <= tx1; tx++)
+                {
+                    float ax0 = tx * 2.0f / CLUSTER_X - 1.0f, ax1 = (tx + 1) * 2.0f / CLUSTER_X - 1.0f;
+                    float bx0 = std::min(ax0 * dn, ax0 * df) / p00, bx1 = std::max(ax1 * dn, ax1 * df) / p00;
+                    float dx = std::max(std::max(bx0 - light.x, light.x - bx1), 0.0f);
+                    float dy = std::max(std::max(by0 - light.y, light.y - by1), 0.0f);
+                    float dz = std::max(std::max(dn - depth, depth - df), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz > r * r)
+                        continue;
+
+                    int cluster = first + tx + ty * CLUSTER_X;
+                    if (counts[cluster] < MAX_LIGHTS_PER_CLUSTER)
+                        scratch[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER + counts[cluster]] = (uint16_t)i;
+                    counts[cluster]++;
+                }
+            }
+        }
+    }
+
+    static int tile(float ndc, int tiles)
+    {
+        return std::min(std::max((int)std::floor((ndc * 0.5f + 0.5f) * tiles), 0), tiles - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef KINETIC_H
+#define KINETIC_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/simd.h>
+#include <learnopengl/jobs.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Animation parameters of the sculpture, one array per component so the
+// kernel can load 4 or 8 cubes at a time.
+struct KineticGrid
+{
+    std::vector<float> baseX, baseY, baseZ;     // position in the grid
+    std::vector<float> ampX, ampY, ampZ;        // how far it moves on each axis
+    std::vector<float> freqX, freqY, freqZ;     // how fast it moves on each axis
+    std::vector<float> offset;                  // ensures cubes don't all move in sync
+
+    size_t size() const { return baseX.size(); }
+
+    void build(int gridSize)
+    {
+        std::vector<float>* arrays[] = { &baseX, &baseY, &baseZ, &ampX, &ampY, &ampZ, &freqX, &freqY, &freqZ, &offset };
+        size_t count = (size_t)(2 * gridSize + 1) * (2 * gridSize + 1) * (2 * gridSize + 1);
+        for (std::vector<float>* a : arrays) {
+            a->clear();
+            a->reserve(count);
+        }
+        float spacing = 2.0f;
+        for (int x = -gridSize; x <= gridSize; ++x) {
+            for (int y = -gridSize; y <= gridSize; ++y) {
+                for (int z = -gridSize; z <= gridSize; ++z) {
+                    glm::vec3 basePosition(x * spacing, y * spacing, z * spacing);
+                    // The further from the center, the more it moves
+                    float distanceFromCenter = glm::length(basePosition);
+                    baseX.push_back(basePosition.x);
+                    baseY.push_back(basePosition.y);
+                    baseZ.push_back(basePosition.z);
+                    ampX.push_back(distanceFromCenter * 0.1f);
+                    ampY.push_back(distanceFromCenter * 0.15f);
+                    ampZ.push_back(distanceFromCenter * 0.1f);
+                    // Varied frequencies for more chaotic, interesting movement
+                    freqX.push_back(0.5f + x * 0.05f);
+                    freqY.push_back(0.5f + y * 0.05f);
+                    freqZ.push_back(0.5f + z * 0.05f);
+                    offset.push_back((x + y + z) * 0.2f);
+                }
+            }
+        }
+    }
+};
+
+// The original per-cube glm code: translate, rotate about a renormalized
+// axis, scale. Kept as the reference for the kernel's correctness check.
+inline void kineticTransformsReference(const KineticGrid& grid, float currentFrame, glm::mat4* models, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+
+        float time = currentFrame + grid.offset[i];
+        glm::vec3 motion;
+        motion.x = sin(time * grid.freqX[i]) * grid.ampX[i];
+        motion.y = cos(time * grid.freqY[i]) * grid.ampY[i];
+        motion.z = sin(time * grid.freqZ[i]) * grid.ampZ[i];
+
+        glm::vec3 finalPosition = glm::vec3(grid.baseX[i], grid.baseY[i], grid.baseZ[i]) + motion;
+        model = glm::translate(model, finalPosition);
+
+        float angle = currentFrame * 25.0f;
+        model = glm::rotate(model, glm::radians(angle), glm::normalize(glm::vec3(0.5f, 1.0f, 0.7f)));
+
+        model = glm::scale(model, glm::vec3(0.5f));
+
+        models[i] = model;
+    }
+}
+
+// Instance matrices for cubes [begin, end). The rotation and scale are the
+// same for every cube, so the upper 3x3 is built once per call and only the
+// translation column is evaluated per cube, SIMD_LANES cubes at a time.
+inline void kineticTransforms(const KineticGrid& grid, float currentFrame, glm::mat4* models, size_t begin, size_t end)
+{
+    float angle = currentFrame * 25.0f;
+    const glm::mat4 shared = glm::scale(glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::normalize(glm::vec3(0.5f, 1.0f, 0.7f))), glm::vec3(0.5f));
+
+    size_t i = begin;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    const vfloat frame = vset1(currentFrame);
+    float px[SIMD_LANES], py[SIMD_LANES], pz[SIMD_LANES];
+    for (; i + SIMD_LANES <= end; i += SIMD_LANES)
+    {
+        vfloat time = vadd(frame, vload(&grid.offset[i]));
+        vfloat x = vmuladd(vsincos(vmul(time, vload(&grid.freqX[i])), 0), vload(&grid.ampX[i]), vload(&grid.baseX[i]));
+        vfloat y = vmuladd(vsincos(vmul(time, vload(&grid.freqY[i])), 1), vload(&grid.ampY[i]), vload(&grid.baseY[i]));
+        vfloat z = vmuladd(vsincos(vmul(time, vload(&grid.freqZ[i])), 0), vload(&grid.ampZ[i]), vload(&grid.baseZ[i]));
+        vstore(px, x);
+        vstore(py, y);
+        vstore(pz, z);
+        for (size_t k = 0; k < SIMD_LANES; k++)
+        {
+            glm::mat4& model = models[i + k];
+            model[0] = shared[0];
+            model[1] = shared[1];
+            model[2] = shared[2];
+            model[3] = glm::vec4(px[k], py[k], pz[k], 1.0f);
+        }
+    }
+#endif
+    // scalar fallback and the remainder of a vector batch
+    for (; i < end; i++)
+    {
+        float time = currentFrame + grid.offset[i];
+        glm::mat4& model = models[i];
+        model[0] = shared[0];
+        model[1] = shared[1];
+        model[2] = shared[2];
+        model[3] = glm::vec4(grid.baseX[i] + std::sin(time * grid.freqX[i]) * grid.ampX[i],
+                             grid.baseY[i] + std::cos(time * grid.freqY[i]) * grid.ampY[i],
+                             grid.baseZ[i] + std::sin(time * grid.freqZ[i]) * grid.ampZ[i], 1.0f);
+    }
+}
+
+// Small grids stay on the calling thread, waking the workers costs more than
+// the few microseconds of work
+const size_t KINETIC_MIN_CHUNK = 16384;
+
+inline void updateKineticTransforms(JobScheduler& jobs, const KineticGrid& grid, float currentFrame, std::vector<glm::mat4>& models)
+{
+    models.resize(grid.size());
+    glm::mat4* out = models.data();
+    jobs.parallelFor(grid.size(), KINETIC_MIN_CHUNK, [&](size_t begin, size_t end) {
+        kineticTransforms(grid, currentFrame, out, begin, end);
+    }, SIMD_LANES);
+}
+
+#endif
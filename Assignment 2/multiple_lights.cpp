@@ -9,9 +9,22 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
+#define LEARNOPENGL_COUNT_ALLOCATIONS
+#include <learnopengl/uniforms.h>
+#include <learnopengl/offline.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/vertex_format.h>
+#include <learnopengl/render_queue.h>
+
+#include "kinetic.h"
+#include "clusters.h"
 
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -33,48 +46,323 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-// A structure to hold unique animation properties for each cube
-struct CubeKineticProps {
-    glm::vec3 basePosition;
-    glm::vec3 motionAmplitude; // How far it moves on each axis
-    glm::vec3 motionFrequency; // How fast it moves on each axis
-    float motionOffset;      // Ensures cubes don't all move in sync
+// The cube has 24 unique vertices, so its indices fit in a byte
+const GLenum CUBE_INDEX_TYPE = GL_UNSIGNED_BYTE;
+
+// Sculpture size: (2 * gridSize + 1)^3 cubes. '[' / ']' change it at runtime,
+// 'I' switches between the instanced draw and the original per-cube loop.
+const int MAX_GRID_SIZE = 49; // 99^3, just under a million cubes
+int gridSize = 5;
+bool gridChanged = false;
+bool drawInstanced = true;
+
+// 'F' switches between forward shading and the deferred path
+bool deferredShading = false;
+
+// 'C' toggles frustum culling of the sculpture's cubes
+bool frustumCulling = true;
+
+// Point lights, '-' / '=' halve and double the count. The first two are the
+// original orbiting red and blue lights, the rest drift around the grid.
+int lightCount = 2;
+int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT;
+
+// Uniform handles for the sculpture programs, resolved once after linking
+struct MaterialUniforms {
+    Uniform<glm::vec3> ambient, diffuse, specular;
+    Uniform<float> shininess;
+
+    explicit MaterialUniforms(const UniformTable& u)
+    {
+        ambient = u.get<glm::vec3>("material.ambient");
+        diffuse = u.get<glm::vec3>("material.diffuse");
+        specular = u.get<glm::vec3>("material.specular");
+        shininess = u.get<float>("material.shininess");
+    }
+};
+
+// Camera and lights, shared by forward shading and the deferred lighting pass
+struct SceneLightUniforms {
+    Uniform<glm::mat4> view;
+    Uniform<glm::vec3> viewPos;
+    Uniform<glm::vec3> dirDirection, dirAmbient, dirDiffuse, dirSpecular;
+    Uniform<int> lightData, clusterGrid, lightIndices;
+    Uniform<glm::vec2> screenSize;
+    Uniform<float> clusterScale, clusterBias;
+    Uniform<glm::vec3> spotPosition, spotDirection, spotAmbient, spotDiffuse, spotSpecular;
+    Uniform<float> spotConstant, spotLinear, spotQuadratic, spotCutOff, spotOuterCutOff;
+
+    explicit SceneLightUniforms(const UniformTable& u)
+    {
+        view = u.get<glm::mat4>("view");
+        viewPos = u.get<glm::vec3>("viewPos");
+        dirDirection = u.get<glm::vec3>("dirLight.direction");
+        dirAmbient = u.get<glm::vec3>("dirLight.ambient");
+        dirDiffuse = u.get<glm::vec3>("dirLight.diffuse");
+        dirSpecular = u.get<glm::vec3>("dirLight.specular");
+        lightData = u.get<int>("lightData");
+        clusterGrid = u.get<int>("clusterGrid");
+        lightIndices = u.get<int>("lightIndices");
+        screenSize = u.get<glm::vec2>("screenSize");
+        clusterScale = u.get<float>("clusterScale");
+        clusterBias = u.get<float>("clusterBias");
+        spotPosition = u.get<glm::vec3>("spotLight.position");
+        spotDirection = u.get<glm::vec3>("spotLight.direction");
+        spotAmbient = u.get<glm::vec3>("spotLight.ambient");
+        spotDiffuse = u.get<glm::vec3>("spotLight.diffuse");
+        spotSpecular = u.get<glm::vec3>("spotLight.specular");
+        spotConstant = u.get<float>("spotLight.constant");
+        spotLinear = u.get<float>("spotLight.linear");
+        spotQuadratic = u.get<float>("spotLight.quadratic");
+        spotCutOff = u.get<float>("spotLight.cutOff");
+        spotOuterCutOff = u.get<float>("spotLight.outerCutOff");
+    }
+};
+
+// 6.multiple_lights, forward shading
+struct LightingUniforms {
+    Uniform<glm::mat4> model, projection;
+    MaterialUniforms material;
+    SceneLightUniforms scene;
+
+    explicit LightingUniforms(const UniformTable& u) : material(u), scene(u)
+    {
+        if (u.has("model")) // the instanced variant takes it per instance
+            model = u.get<glm::mat4>("model");
+        projection = u.get<glm::mat4>("projection");
+    }
+};
+
+// 6.gbuffer, geometry pass of the deferred path
+struct GBufferUniforms {
+    Uniform<glm::mat4> model, view, projection;
+    MaterialUniforms material;
+
+    explicit GBufferUniforms(const UniformTable& u) : material(u)
+    {
+        if (u.has("model"))
+            model = u.get<glm::mat4>("model");
+        view = u.get<glm::mat4>("view");
+        projection = u.get<glm::mat4>("projection");
+    }
+};
+
+// 6.deferred_lighting, lighting pass of the deferred path
+struct DeferredUniforms {
+    SceneLightUniforms scene;
+    Uniform<int> gPosition, gNormal, gMaterial;
+
+    explicit DeferredUniforms(const UniformTable& u) : scene(u)
+    {
+        gPosition = u.get<int>("gPosition");
+        gNormal = u.get<int>("gNormal");
+        gMaterial = u.get<int>("gMaterial");
+    }
+};
+
+struct LightCubeUniforms {
+    Uniform<glm::mat4> model, view, projection;
+    Uniform<glm::vec3> lightColor;
+
+    explicit LightCubeUniforms(const UniformTable& u)
+    {
+        model = u.get<glm::mat4>("model");
+        view = u.get<glm::mat4>("view");
+        projection = u.get<glm::mat4>("projection");
+        lightColor = u.get<glm::vec3>("lightColor");
+    }
+};
+
+// Render targets of the deferred path, recreated when the framebuffer size changes
+struct GBuffer {
+    unsigned int fbo = 0, depth = 0;
+    unsigned int textures[3] = { 0, 0, 0 }; // position, normal, material
+    int width = 0, height = 0;
+
+    void resize(int w, int h)
+    {
+        if (w == width && h == height)
+            return;
+        destroy();
+        width = w;
+        height = h;
+
+        // positions need full float, normals and material colors do not
+        const GLenum formats[3] = { GL_RGBA32F, GL_RGBA16F, GL_RGBA8 };
+        const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[i], w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, textures[i], 0);
+        }
+        glDrawBuffers(3, attachments);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+    }
+
+    void destroy()
+    {
+        if (fbo == 0)
+            return;
+        glDeleteTextures(3, textures);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+        width = height = 0;
+    }
+};
+
+// The sculpture's programs for both lighting paths. Forward shading lights
+// every fragment the cubes produce, including the ones later covered by a
+// nearer cube; the deferred path stores the surfaces in the G-buffer first
+// and then lights each covered pixel exactly once.
+struct SculptureRenderer {
+    Shader forward, forwardLoop;    // 6.multiple_lights, instanced / one draw per cube
+    Shader gbuffer, gbufferLoop;    // 6.gbuffer
+    Shader deferred;                // 6.deferred_lighting
+    LightingUniforms forwardUniforms, forwardLoopUniforms;
+    GBufferUniforms gbufferUniforms, gbufferLoopUniforms;
+    DeferredUniforms deferredUniforms;
+    GBuffer targets;
+    RenderQueue queue;  // the sculpture's draws, flushed once per pass
+    unsigned int cubeVAO = 0, instanceVBO = 0, emptyVAO = 0;
+
+    // With measureOverdraw set, draw() reads back the fragments that passed
+    // the depth test while drawing the cubes and, on the deferred path, the
+    // pixels the lighting pass covered
+    bool measureOverdraw = false;
+    GLuint64 shadedSamples = 0, litSamples = 0;
+
+    SculptureRenderer()
+        : forward("6.multiple_lights_instanced.vs", "6.multiple_lights.fs"),
+          forwardLoop("6.multiple_lights.vs", "6.multiple_lights.fs"),
+          gbuffer("6.multiple_lights_instanced.vs", "6.gbuffer.fs"),
+          gbufferLoop("6.multiple_lights.vs", "6.gbuffer.fs"),
+          deferred("6.deferred_lighting.vs", "6.deferred_lighting.fs"),
+          forwardUniforms(UniformTable(forward.ID)),
+          forwardLoopUniforms(UniformTable(forwardLoop.ID)),
+          gbufferUniforms(UniformTable(gbuffer.ID)),
+          gbufferLoopUniforms(UniformTable(gbufferLoop.ID)),
+          deferredUniforms(UniformTable(deferred.ID))
+    {
+        glGenVertexArrays(1, &emptyVAO); // the fullscreen triangle has no attributes
+        glGenQueries(2, queries);
+    }
+
+    void draw(bool deferredShading, bool instanced, const std::vector<glm::mat4>& models, const LightClusters& clusters,
+              const glm::mat4& projection, const glm::mat4& view, unsigned int target);
+
+    void destroy()
+    {
+        targets.destroy();
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteQueries(2, queries);
+    }
+
+private:
+    unsigned int queries[2] = { 0, 0 };
 };
 
-int main()
+void submitKineticInstanced(RenderQueue& queue, unsigned int program, unsigned int cubeVAO, unsigned int instanceVBO,
+                            const std::vector<glm::mat4>& models);
+void submitKineticLoop(RenderQueue& queue, unsigned int program, unsigned int cubeVAO, const Uniform<glm::mat4>& modelUniform,
+                       const std::vector<glm::mat4>& models, const glm::mat4& view);
+void applyMaterial(const MaterialUniforms& material);
+void applySceneLights(const SceneLightUniforms& lights, const LightClusters& clusters, const glm::mat4& view);
+void applyLighting(const LightingUniforms& lighting, const LightClusters& clusters, const glm::mat4& projection, const glm::mat4& view);
+void animateLights(std::vector<ClusterLight>& lights, int count, float currentFrame);
+void cullKineticCubes(const Frustum& frustum, const std::vector<glm::mat4>& models, SphereBatch& spheres,
+                      std::vector<uint32_t>& visible, std::vector<glm::mat4>& visibleModels);
+void runSubmitBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, const LightClusters& clusters);
+int runKernelBenchmark(int frames, JobScheduler& jobs);
+void runLightBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, LightClusters& clusters);
+void runDeferredBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, LightClusters& clusters);
+
+int main(int argc, char** argv)
 {
     // === Standard OpenGL/GLFW Initialization (similar to original) ===
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    OfflineRenderer offline(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+    // --grid N sets the starting grid size, --bench [frames] compares the
+    // CPU submit cost of both sculpture paths over a range of sizes and exits,
+    // --kernel-bench [frames] times the matrix kernels alone without any GL,
+    // --light-bench [frames] sweeps the point light count from 2 to 4096,
+    // --deferred-bench [frames] compares forward and deferred shading
+    int benchFrames = 0, kernelBenchFrames = 0, lightBenchFrames = 0, deferredBenchFrames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--grid") == 0 && i + 1 < argc)
+            gridSize = glm::clamp(std::atoi(argv[++i]), 0, MAX_GRID_SIZE);
+        else if (std::strcmp(argv[i], "--bench") == 0)
+            benchFrames = i + 1 < argc && argv[i + 1][0] != '-' ? std::atoi(argv[++i]) : 10;
+        else if (std::strcmp(argv[i], "--kernel-bench") == 0)
+            kernelBenchFrames = i + 1 < argc && argv[i + 1][0] != '-' ? std::atoi(argv[++i]) : 20;
+        else if (std::strcmp(argv[i], "--light-bench") == 0)
+            lightBenchFrames = i + 1 < argc && argv[i + 1][0] != '-' ? std::atoi(argv[++i]) : 10;
+        else if (std::strcmp(argv[i], "--deferred-bench") == 0)
+            deferredBenchFrames = i + 1 < argc && argv[i + 1][0] != '-' ? std::atoi(argv[++i]) : 120;
+        else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            lightCount = glm::clamp(std::atoi(argv[++i]), 2, MAX_CLUSTER_LIGHTS);
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+            deferredShading = true;
+        else if (std::strcmp(argv[i], "--no-cull") == 0)
+            frustumCulling = false;
+    }
+
+    JobScheduler jobs;
+    if (kernelBenchFrames > 0)
+        return runKernelBenchmark(kernelBenchFrames, jobs);
+
+    GLFWwindow* window = NULL;
+    if (offline.active) {
+        if (!offline.createContext())
+            return -1;
+    }
+    else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
+        if (benchFrames > 0 || lightBenchFrames > 0 || deferredBenchFrames > 0)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Kinetic Sculpture", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Kinetic Sculpture", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
+    countUniformLookups();
 
     glEnable(GL_DEPTH_TEST);
 
     // === Shader Program Compilation ===
-    Shader lightingShader("6.multiple_lights.vs", "6.multiple_lights.fs");
+    SculptureRenderer sculpture;
     Shader lightCubeShader("6.light_cube.vs", "6.light_cube.fs");
+    LightCubeUniforms lightCube{ UniformTable(lightCubeShader.ID) };
 
     // === Vertex Data (Unchanged) ===
     float vertices[] = {
@@ -123,188 +411,648 @@ int main()
     };
 
     // === NEW: Procedurally generate the kinetic sculpture cubes ===
-    std::vector<CubeKineticProps> kineticCubes;
-    int gridSize = 5; // Create a 5x5x5 grid of cubes
-    float spacing = 2.0f;
-    for (int x = -gridSize; x <= gridSize; ++x) {
-        for (int y = -gridSize; y <= gridSize; ++y) {
-            for (int z = -gridSize; z <= gridSize; ++z) {
-                CubeKineticProps props;
-                // Calculate base position in the grid
-                props.basePosition = glm::vec3(x * spacing, y * spacing, z * spacing);
-
-                // The further from the center, the more it moves
-                float distanceFromCenter = glm::length(props.basePosition);
-                props.motionAmplitude = glm::vec3(distanceFromCenter * 0.1f, distanceFromCenter * 0.15f, distanceFromCenter * 0.1f);
-
-                // Varied frequencies for more chaotic, interesting movement
-                props.motionFrequency = glm::vec3(0.5f + x * 0.05f, 0.5f + y * 0.05f, 0.5f + z * 0.05f);
-
-                // Offset ensures they don't all move together
-                props.motionOffset = (x + y + z) * 0.2f;
-
-                kineticCubes.push_back(props);
-            }
-        }
-    }
+    KineticGrid kineticCubes;
+    kineticCubes.build(gridSize);
+    std::vector<glm::mat4> instanceModels;
+    // frustum culling scratch, reused every frame
+    SphereBatch cubeSpheres;
+    std::vector<uint32_t> visibleCubes;
+    std::vector<glm::mat4> visibleModels;
+    CullStats cullStats;
 
-    // Positions of the point lights
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3(0.0f,  5.0f,  0.0f),
-        glm::vec3(0.0f, -5.0f,  0.0f),
-    };
+    // Point lights, binned into view-space clusters every frame
+    std::vector<ClusterLight> lights;
+    LightClusters clusters;
+    clusters.create(0.1f, 100.0f);
 
-    // Colors for the point lights
-    glm::vec3 pointLightColors[] = {
-        glm::vec3(1.0f, 0.2f, 0.2f), // Red
-        glm::vec3(0.2f, 0.2f, 1.0f), // Blue
-    };
+    // Indexed, compact cube: the 36 corners weld into 24 unique position +
+    // normal pairs (the texture coordinates are never read and are dropped),
+    // stored as half positions and octahedral normals with 8-bit indices
+    std::vector<float> cubeUnique;
+    std::vector<uint32_t> cubeIndices;
+    weldVertices(vertices, 36, 8, 6, cubeUnique, cubeIndices);
+    std::vector<CompactVertex> cubeVertices(cubeUnique.size() / 6);
+    for (size_t i = 0; i < cubeVertices.size(); i++) {
+        const float* v = &cubeUnique[i * 6];
+        glm::vec2 normal = octEncode(glm::vec3(v[3], v[4], v[5]));
+        cubeVertices[i] = { { packHalf(v[0]), packHalf(v[1]), packHalf(v[2]), packHalf(1.0f) },
+                            { packSnorm16(normal.x), packSnorm16(normal.y) } };
+    }
+    std::printf("cube: %d x %zu bytes -> %zu x %zu bytes + %zu index bytes (%zu -> %zu bytes)\n",
+        36, 8 * sizeof(float), cubeVertices.size(), sizeof(CompactVertex), cubeIndices.size() * indexSize(CUBE_INDEX_TYPE),
+        sizeof(vertices), cubeVertices.size() * sizeof(CompactVertex) + cubeIndices.size() * indexSize(CUBE_INDEX_TYPE));
 
     // Vertex Buffer and Array Object setup
-    unsigned int VBO, cubeVAO;
+    unsigned int VBO, EBO, cubeVAO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, cubeVertices.size() * sizeof(CompactVertex), cubeVertices.data(), GL_STATIC_DRAW);
     glBindVertexArray(cubeVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // TexCoords are still in the VBO but we won't use them for the metallic look
-    // glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    // glEnableVertexAttribArray(2);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    uploadIndices(cubeIndices, CUBE_INDEX_TYPE);
+    setupCompactAttributes();
+
+    // Per-instance model matrices, a mat4 attribute spread over locations 3-6.
+    // The per-cube loop shader simply doesn't read them.
+    unsigned int instanceVBO;
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribDivisor(3 + i, 1);
+    }
+    sculpture.cubeVAO = cubeVAO;
+    sculpture.instanceVBO = instanceVBO;
 
     unsigned int lightCubeVAO;
     glGenVertexArrays(1, &lightCubeVAO);
     glBindVertexArray(lightCubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)0);
     glEnableVertexAttribArray(0);
 
+    if (benchFrames > 0 || lightBenchFrames > 0 || deferredBenchFrames > 0) {
+        if (lightBenchFrames > 0)
+            runLightBenchmark(lightBenchFrames, jobs, sculpture, clusters);
+        if (benchFrames > 0) {
+            animateLights(lights, lightCount, 0.0f);
+            clusters.update(jobs, lights, camera.GetViewMatrix(),
+                glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f));
+            runSubmitBenchmark(benchFrames, jobs, sculpture, clusters);
+        }
+        if (deferredBenchFrames > 0)
+            runDeferredBenchmark(deferredBenchFrames, jobs, sculpture, clusters);
+        sculpture.destroy();
+        clusters.destroy();
+        glDeleteVertexArrays(1, &cubeVAO);
+        glDeleteVertexArrays(1, &lightCubeVAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glfwTerminate();
+        return 0;
+    }
+
+    FrameCounters counters;
+    float lastTitleUpdate = 0.0f;
+
     // Render loop
-    while (!glfwWindowShouldClose(window))
+    while (!offline.shouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        float currentFrame = offline.time();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
+        if (window)
+            processInput(window);
+
+        if (gridChanged) {
+            kineticCubes.build(gridSize);
+            gridChanged = false;
+        }
 
         // === RENDER COMMANDS ===
         // Black background for drama
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // NEW: Material properties for a metallic look
-        lightingShader.setVec3("material.ambient", 0.1f, 0.1f, 0.1f);
-        lightingShader.setVec3("material.diffuse", 0.8f, 0.8f, 0.8f); // Will be colored by lights
-        lightingShader.setVec3("material.specular", 1.0f, 1.0f, 1.0f); // Strong highlight
-        lightingShader.setFloat("material.shininess", 64.0f);
-
-        // === LIGHTING SETUP (Revised for a more dramatic effect) ===
-        // Directional light (a dim, cool "moonlight")
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.02f, 0.02f, 0.05f); // Very dim blue ambient
-        lightingShader.setVec3("dirLight.diffuse", 0.1f, 0.1f, 0.15f);
-        lightingShader.setVec3("dirLight.specular", 0.2f, 0.2f, 0.2f);
-
-        // Animate the point lights to orbit the sculpture
-        float lightOrbitRadius = 8.0f;
-        pointLightPositions[0].x = sin(currentFrame * 0.5f) * lightOrbitRadius;
-        pointLightPositions[0].z = cos(currentFrame * 0.5f) * lightOrbitRadius;
-        pointLightPositions[1].x = sin(-currentFrame * 0.3f) * lightOrbitRadius;
-        pointLightPositions[1].z = cos(-currentFrame * 0.3f) * lightOrbitRadius;
-
-        // Point lights (dynamic, colored lights)
-        for (int i = 0; i < 2; i++) {
-            std::string number = std::to_string(i);
-            lightingShader.setVec3("pointLights[" + number + "].position", pointLightPositions[i]);
-            lightingShader.setVec3("pointLights[" + number + "].ambient", pointLightColors[i] * 0.05f);
-            lightingShader.setVec3("pointLights[" + number + "].diffuse", pointLightColors[i] * 0.8f);
-            lightingShader.setVec3("pointLights[" + number + "].specular", pointLightColors[i]);
-            lightingShader.setFloat("pointLights[" + number + "].constant", 1.0f);
-            lightingShader.setFloat("pointLights[" + number + "].linear", 0.09f);
-            lightingShader.setFloat("pointLights[" + number + "].quadratic", 0.032f);
-        }
-
-        // SpotLight (the user's "flashlight")
-        lightingShader.setVec3("spotLight.position", camera.Position);
-        lightingShader.setVec3("spotLight.direction", camera.Front);
-        lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-        lightingShader.setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-        lightingShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.09f);
-        lightingShader.setFloat("spotLight.quadratic", 0.032f);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+        // Animate the point lights
+        animateLights(lights, lightCount, currentFrame);
 
         // View/Projection matrices
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
 
-        // === RENDER THE KINETIC SCULPTURE ===
-        glBindVertexArray(cubeVAO);
-        for (const auto& props : kineticCubes)
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-
-            // NEW: Apply the kinetic motion using sine waves
-            float time = currentFrame + props.motionOffset;
-            glm::vec3 motion;
-            motion.x = sin(time * props.motionFrequency.x) * props.motionAmplitude.x;
-            motion.y = cos(time * props.motionFrequency.y) * props.motionAmplitude.y;
-            motion.z = sin(time * props.motionFrequency.z) * props.motionAmplitude.z;
-
-            // Start with the base grid position and add the fluid motion
-            glm::vec3 finalPosition = props.basePosition + motion;
-            model = glm::translate(model, finalPosition);
-
-            // Add a slow, continuous self-rotation
-            float angle = currentFrame * 25.0f;
-            model = glm::rotate(model, glm::radians(angle), glm::normalize(glm::vec3(0.5f, 1.0f, 0.7f)));
+        // Bin the lights for this camera, one upload for all of them
+        auto clusterStart = std::chrono::steady_clock::now();
+        clusters.update(jobs, lights, view, projection);
+        double clusterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - clusterStart).count();
 
-            // Make the cubes smaller to fit more in the view
-            model = glm::scale(model, glm::vec3(0.5f));
-
-            lightingShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // === RENDER THE KINETIC SCULPTURE ===
+        auto submitStart = std::chrono::steady_clock::now();
+        updateKineticTransforms(jobs, kineticCubes, currentFrame, instanceModels);
+        const std::vector<glm::mat4>* drawModels = &instanceModels;
+        if (frustumCulling) {
+            cullStats.begin();
+            cullKineticCubes(Frustum(projection * view), instanceModels, cubeSpheres, visibleCubes, visibleModels);
+            cullStats.end(instanceModels.size(), visibleModels.size());
+            drawModels = &visibleModels;
         }
+        else
+            cullStats = CullStats();
+        sculpture.draw(deferredShading, drawInstanced, *drawModels, clusters, projection, view, offline.framebuffer());
+        double submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
 
-        // Draw the light source cubes
+        // Draw the light source cubes of the two main lights
         lightCubeShader.use();
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
-        glBindVertexArray(lightCubeVAO);
+        lightCube.projection.set(projection);
+        lightCube.view.set(view);
         for (unsigned int i = 0; i < 2; i++)
         {
             glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
+            model = glm::translate(model, lights[i].position);
             model = glm::scale(model, glm::vec3(0.4f)); // Make lights bigger to see them
-            lightCubeShader.setMat4("model", model);
+            float depth = -(view * glm::vec4(lights[i].position, 1.0f)).z / 100.0f;
+            sculpture.queue.submit(makeSortKey(0, lightCubeShader.ID, 0, lightCubeVAO, depth), lightCubeShader.ID, lightCubeVAO, nullptr,
+                                   GL_TRIANGLES, 36, CUBE_INDEX_TYPE);
+            sculpture.queue.setMat4(lightCube.model.location, model);
             // Set light cube color to match the light it emits
-            lightCubeShader.setVec3("lightColor", pointLightColors[i]);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            sculpture.queue.setVec3(lightCube.lightColor.location, lights[i].color);
         }
+        sculpture.queue.flush();
+        sculpture.queue.endFrame();
+
+        offline.present(window);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // Uniform name lookups / heap allocations during the last frame
+        counters.endFrame();
+        if (window && currentFrame - lastTitleUpdate > 1.0f) {
+            char title[256];
+            std::snprintf(title, sizeof(title), "Kinetic Sculpture | %zu cubes, %s, %s | %zu/%zu visible, %.0f us culling | %d lights, %.2f ms binning, max %u/cluster | CPU %.2f ms | %u draws, %u state changes (%u unsorted) | lookups/frame %llu | allocs/frame %llu",
+                kineticCubes.size(), drawInstanced ? "instanced" : "per-cube", deferredShading ? "deferred" : "forward",
+                frustumCulling ? cullStats.visible : kineticCubes.size(), kineticCubes.size(), cullStats.microseconds,
+                lightCount, clusterMs, clusters.maxPerCluster, submitMs, sculpture.queue.lastFrame.drawCalls,
+                sculpture.queue.lastFrame.stateChanges(), sculpture.queue.lastFrame.unsortedBinds, counters.lookups, counters.allocations);
+            glfwSetWindowTitle(window, title);
+            lastTitleUpdate = currentFrame;
+        }
     }
 
+    offline.finish();
+    sculpture.destroy();
+    clusters.destroy();
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceVBO);
     glfwTerminate();
     return 0;
 }
 
+// One draw for the whole sculpture: the matrices are streamed into an
+// orphaned instance buffer and read as a per-instance attribute
+void submitKineticInstanced(RenderQueue& queue, unsigned int program, unsigned int cubeVAO, unsigned int instanceVBO,
+                            const std::vector<glm::mat4>& models)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, models.size() * sizeof(glm::mat4), models.data());
+    if (!models.empty())
+        queue.submit(makeSortKey(0, program, 0, cubeVAO, 0.0f), program, cubeVAO, nullptr,
+                     GL_TRIANGLES, 36, CUBE_INDEX_TYPE, (GLsizei)models.size());
+}
+
+// The original path: one model uniform and one draw call per cube, sorted
+// front to back
+void submitKineticLoop(RenderQueue& queue, unsigned int program, unsigned int cubeVAO, const Uniform<glm::mat4>& modelUniform,
+                       const std::vector<glm::mat4>& models, const glm::mat4& view)
+{
+    for (const glm::mat4& model : models)
+    {
+        float depth = -(view * model[3]).z / 100.0f;
+        queue.submit(makeSortKey(0, program, 0, cubeVAO, depth), program, cubeVAO, nullptr, GL_TRIANGLES, 36, CUBE_INDEX_TYPE);
+        queue.setMat4(modelUniform.location, model);
+    }
+}
+
+void SculptureRenderer::draw(bool deferredShading, bool instanced, const std::vector<glm::mat4>& models, const LightClusters& clusters,
+                             const glm::mat4& projection, const glm::mat4& view, unsigned int target)
+{
+    if (measureOverdraw)
+        glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+
+    if (!deferredShading) {
+        const LightingUniforms& uniforms = instanced ? forwardUniforms : forwardLoopUniforms;
+        Shader& program = instanced ? forward : forwardLoop;
+        program.use();
+        applyLighting(uniforms, clusters, projection, view);
+        if (instanced)
+            submitKineticInstanced(queue, program.ID, cubeVAO, instanceVBO, models);
+        else
+            submitKineticLoop(queue, program.ID, cubeVAO, uniforms.model, models, view);
+        queue.flush();
+    }
+    else {
+        // geometry pass: surfaces only, nothing is lit yet
+        targets.resize(framebufferWidth, framebufferHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, targets.fbo);
+        const float empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f }; // shininess 0 marks uncovered pixels
+        for (int i = 0; i < 3; i++)
+            glClearBufferfv(GL_COLOR, i, empty);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        const GBufferUniforms& uniforms = instanced ? gbufferUniforms : gbufferLoopUniforms;
+        Shader& program = instanced ? gbuffer : gbufferLoop;
+        program.use();
+        applyMaterial(uniforms.material);
+        uniforms.projection.set(projection);
+        uniforms.view.set(view);
+        if (instanced)
+            submitKineticInstanced(queue, program.ID, cubeVAO, instanceVBO, models);
+        else
+            submitKineticLoop(queue, program.ID, cubeVAO, uniforms.model, models, view);
+        queue.flush();
+
+        if (measureOverdraw) {
+            glEndQuery(GL_SAMPLES_PASSED);
+            glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+        }
+
+        // lighting pass: one fullscreen triangle, every covered pixel is lit once
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glDisable(GL_DEPTH_TEST);
+        deferred.use();
+        applySceneLights(deferredUniforms.scene, clusters, view);
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE3 + i);
+            glBindTexture(GL_TEXTURE_2D, targets.textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        deferredUniforms.gPosition.set(3);
+        deferredUniforms.gNormal.set(4);
+        deferredUniforms.gMaterial.set(5);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+
+        // the sculpture's depth, for whatever is drawn after it
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, targets.fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, targets.width, targets.height, 0, 0, targets.width, targets.height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    if (measureOverdraw) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &shadedSamples);
+        litSamples = 0;
+        if (deferredShading)
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &litSamples);
+    }
+}
+
+// NEW: Material properties for a metallic look
+void applyMaterial(const MaterialUniforms& material)
+{
+    material.ambient.set(glm::vec3(0.1f, 0.1f, 0.1f));
+    material.diffuse.set(glm::vec3(0.8f, 0.8f, 0.8f)); // Will be colored by lights
+    material.specular.set(glm::vec3(1.0f, 1.0f, 1.0f)); // Strong highlight
+    material.shininess.set(64.0f);
+}
+
+// Camera and light uniforms for whichever lighting program is bound
+void applySceneLights(const SceneLightUniforms& lights, const LightClusters& clusters, const glm::mat4& view)
+{
+    lights.viewPos.set(camera.Position);
+    lights.view.set(view);
+
+    // === LIGHTING SETUP (Revised for a more dramatic effect) ===
+    // Directional light (a dim, cool "moonlight")
+    lights.dirDirection.set(glm::vec3(-0.2f, -1.0f, -0.3f));
+    lights.dirAmbient.set(glm::vec3(0.02f, 0.02f, 0.05f)); // Very dim blue ambient
+    lights.dirDiffuse.set(glm::vec3(0.1f, 0.1f, 0.15f));
+    lights.dirSpecular.set(glm::vec3(0.2f, 0.2f, 0.2f));
+
+    // Point lights (dynamic, colored lights), read from the cluster buffers
+    clusters.bind(0);
+    lights.lightData.set(0);
+    lights.clusterGrid.set(1);
+    lights.lightIndices.set(2);
+    lights.screenSize.set(glm::vec2((float)framebufferWidth, (float)framebufferHeight));
+    lights.clusterScale.set(clusters.depthScale());
+    lights.clusterBias.set(clusters.depthBias());
+
+    // SpotLight (the user's "flashlight")
+    lights.spotPosition.set(camera.Position);
+    lights.spotDirection.set(camera.Front);
+    lights.spotAmbient.set(glm::vec3(0.0f, 0.0f, 0.0f));
+    lights.spotDiffuse.set(glm::vec3(1.0f, 1.0f, 1.0f));
+    lights.spotSpecular.set(glm::vec3(1.0f, 1.0f, 1.0f));
+    lights.spotConstant.set(1.0f);
+    lights.spotLinear.set(0.09f);
+    lights.spotQuadratic.set(0.032f);
+    lights.spotCutOff.set(glm::cos(glm::radians(12.5f)));
+    lights.spotOuterCutOff.set(glm::cos(glm::radians(15.0f)));
+}
+
+// Everything the forward program needs
+void applyLighting(const LightingUniforms& lighting, const LightClusters& clusters, const glm::mat4& projection, const glm::mat4& view)
+{
+    applyMaterial(lighting.material);
+    applySceneLights(lighting.scene, clusters, view);
+    lighting.projection.set(projection);
+}
+
+// CPU cost of getting the sculpture to the driver, per-cube loop against the
+// instanced draw. Matrix building is timed separately so "submit" is only the
+// uniform/buffer traffic and draw calls; glFinish after every frame keeps the
+// GPU from queueing up but is not counted.
+void runSubmitBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, const LightClusters& clusters)
+{
+    const int sizes[] = { 5, 10, 20, 30, MAX_GRID_SIZE };
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    std::vector<glm::mat4> models;
+
+    std::printf("%10s %14s %16s %18s %10s\n", "cubes", "build ms", "per-cube ms", "instanced ms", "ratio");
+    for (int size : sizes)
+    {
+        KineticGrid cubes;
+        cubes.build(size);
+        double buildMs = 0.0, submitMs[2] = { 0.0, 0.0 };
+        for (int path = 0; path < 2; path++)
+        {
+            for (int frame = 0; frame < frames; frame++)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                updateKineticTransforms(jobs, cubes, frame / 60.0f, models);
+                auto t1 = std::chrono::steady_clock::now();
+                sculpture.draw(false, path == 1, models, clusters, projection, view, 0);
+                auto t2 = std::chrono::steady_clock::now();
+                glFinish();
+                buildMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+                submitMs[path] += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            }
+        }
+        buildMs /= 2.0 * frames;
+        submitMs[0] /= frames;
+        submitMs[1] /= frames;
+        std::printf("%10zu %14.3f %16.3f %18.3f %9.1fx\n", cubes.size(), buildMs, submitMs[0], submitMs[1],
+                    submitMs[1] > 0.0 ? submitMs[0] / submitMs[1] : 0.0);
+    }
+}
+
+// The two original lights orbit the sculpture with a reach that covers all
+// of it; the others get a fixed pseudo-random spot, color and small radius
+// inside the grid and bob around it.
+void animateLights(std::vector<ClusterLight>& lights, int count, float currentFrame)
+{
+    lights.resize(count);
+    float lightOrbitRadius = 8.0f;
+    lights[0].position = glm::vec3(sin(currentFrame * 0.5f) * lightOrbitRadius, 5.0f, cos(currentFrame * 0.5f) * lightOrbitRadius);
+    lights[0].color = glm::vec3(1.0f, 0.2f, 0.2f); // Red
+    lights[1].position = glm::vec3(sin(-currentFrame * 0.3f) * lightOrbitRadius, -5.0f, cos(-currentFrame * 0.3f) * lightOrbitRadius);
+    lights[1].color = glm::vec3(0.2f, 0.2f, 1.0f); // Blue
+    lights[0].radius = lights[1].radius = 60.0f;
+
+    float extent = gridSize * 2.0f + 1.0f;
+    for (int i = 2; i < count; i++)
+    {
+        // integer hash -> four values in [0, 1)
+        unsigned int h = (unsigned int)i * 2654435761u;
+        float hx = ((h >> 8) & 1023) / 1024.0f, hy = ((h >> 18) & 1023) / 1024.0f;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        float hz = ((h >> 8) & 1023) / 1024.0f, hue = ((h >> 18) & 1023) / 1024.0f;
+
+        float phase = currentFrame * (0.5f + hx) + i;
+        lights[i].position = glm::vec3((hx * 2.0f - 1.0f) * extent + sin(phase) * 1.5f,
+                                       (hy * 2.0f - 1.0f) * extent + cos(phase * 0.7f) * 1.5f,
+                                       (hz * 2.0f - 1.0f) * extent);
+        lights[i].radius = 3.0f + 3.0f * hz;
+        lights[i].color = glm::vec3(0.5f) + 0.5f * glm::vec3(cos(6.2832f * hue), cos(6.2832f * (hue + 0.33f)), cos(6.2832f * (hue + 0.67f)));
+    }
+}
+
+// GPU time of the instanced sculpture and CPU binning time for 2 to 4096
+// point lights, clustered against every fragment looping over every light
+// (the same shader with all lights in each cluster). Brute force stops at
+// 1024 lights, past that a frame takes seconds on slower GPUs.
+void runLightBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, LightClusters& clusters)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    KineticGrid cubes;
+    cubes.build(gridSize);
+    std::vector<glm::mat4> models;
+    std::vector<ClusterLight> lights;
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    std::printf("%zu cubes, %dx%dx%d clusters\n", cubes.size(), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    std::printf("%8s %12s %12s %10s %16s %16s %10s\n", "lights", "binning ms", "avg/cluster", "max", "clustered ms", "all lights ms", "speedup");
+    for (int count = 2; count <= MAX_CLUSTER_LIGHTS; count *= 2)
+    {
+        double binMs = 0.0, gpuMs[2] = { 0.0, 0.0 };
+        size_t indices = 0;
+        unsigned int maxPerCluster = 0;
+        for (int path = 0; path < 2; path++)
+        {
+            bool cull = path == 0;
+            if (!cull && count > 1024)
+                break;
+            // one untimed frame to get shader compilation and allocation out of the way
+            for (int i = -1; i < frames; i++)
+            {
+                float time = i * (1.0f / 60.0f);
+                animateLights(lights, count, time);
+                updateKineticTransforms(jobs, cubes, time, models);
+                auto t0 = std::chrono::steady_clock::now();
+                clusters.update(jobs, lights, view, projection, cull);
+                if (cull && i >= 0) {
+                    binMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                    indices += clusters.indexCount;
+                    maxPerCluster = std::max(maxPerCluster, clusters.maxPerCluster);
+                }
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                if (i >= 0)
+                    glBeginQuery(GL_TIME_ELAPSED, query);
+                sculpture.draw(false, true, models, clusters, projection, view, 0);
+                if (i >= 0) {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                    gpuMs[path] += elapsed / 1e6;
+                }
+            }
+        }
+        binMs /= frames;
+        gpuMs[0] /= frames;
+        gpuMs[1] /= frames;
+        if (gpuMs[1] > 0.0)
+            std::printf("%8d %12.3f %12.2f %10u %16.3f %16.3f %9.1fx\n", count, binMs, (double)indices / frames / CLUSTER_COUNT,
+                        maxPerCluster, gpuMs[0], gpuMs[1], gpuMs[0] > 0.0 ? gpuMs[1] / gpuMs[0] : 0.0);
+        else
+            std::printf("%8d %12.3f %12.2f %10u %16.3f %16s %10s\n", count, binMs, (double)indices / frames / CLUSTER_COUNT,
+                        maxPerCluster, gpuMs[0], "-", "-");
+    }
+    glDeleteQueries(1, &query);
+}
+
+// Bounding spheres straight from the instance matrices, then the SIMD frustum
+// test. Every cube shares the same rotation and scale, so one radius covers
+// them all: the unit cube's half diagonal times the largest axis scale.
+void cullKineticCubes(const Frustum& frustum, const std::vector<glm::mat4>& models, SphereBatch& spheres,
+                      std::vector<uint32_t>& visible, std::vector<glm::mat4>& visibleModels)
+{
+    visible.clear();
+    visibleModels.clear();
+    if (models.empty())
+        return;
+    float radius = transformSphere({ glm::vec3(0.0f), 0.5f * std::sqrt(3.0f) }, models[0]).radius;
+    spheres.resize(models.size());
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        spheres.x[i] = models[i][3].x;
+        spheres.y[i] = models[i][3].y;
+        spheres.z[i] = models[i][3].z;
+        spheres.radius[i] = radius;
+    }
+    cullSpheres(frustum, spheres, visible);
+    visibleModels.reserve(models.size());
+    for (uint32_t i : visible)
+        visibleModels.push_back(models[i]);
+}
+
+// Forward against deferred shading on the same camera path: an orbit around
+// the sculpture that ends up inside the larger grids. Overdraw is fragments
+// that passed the depth test per visible pixel, i.e. how often forward
+// shading lights a pixel; occluded fragments the GPU did not reject early
+// come on top. Frame time is the GPU time of the whole sculpture draw from a
+// GL_TIME_ELAPSED query, as in the other GPU benchmarks, G-buffer and
+// lighting pass together for deferred.
+void runDeferredBenchmark(int frames, JobScheduler& jobs, SculptureRenderer& sculpture, LightClusters& clusters)
+{
+    const int sizes[] = { 5, 10, 20 };
+    const int lightCounts[] = { 2, 256 };
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    std::vector<glm::mat4> models;
+    std::vector<ClusterLight> lights;
+    sculpture.measureOverdraw = true;
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    std::printf("%10s %8s %10s %14s %14s %10s\n", "cubes", "lights", "overdraw", "forward ms", "deferred ms", "speedup");
+    for (int size : sizes)
+    {
+        KineticGrid cubes;
+        cubes.build(size);
+        int savedGridSize = gridSize;
+        gridSize = size; // animateLights spreads the lights over the grid
+        for (int count : lightCounts)
+        {
+            double ms[2] = { 0.0, 0.0 };
+            GLuint64 shaded = 0, visible = 0;
+            for (int path = 0; path < 2; path++)
+            {
+                for (int i = -1; i < frames; i++)
+                {
+                    // one untimed frame first, as in the other benchmarks
+                    float time = std::max(i, 0) * (1.0f / 60.0f);
+                    float angle = 6.2832f * std::max(i, 0) / frames;
+                    float radius = 15.0f + size * 0.5f;
+                    camera.Position = glm::vec3(sin(angle) * radius, 4.0f, cos(angle) * radius) * (1.0f - 0.5f * std::max(i, 0) / frames);
+                    camera.Front = glm::normalize(-camera.Position);
+                    glm::mat4 view = camera.GetViewMatrix();
+
+                    animateLights(lights, count, time);
+                    updateKineticTransforms(jobs, cubes, time, models);
+                    clusters.update(jobs, lights, view, projection);
+
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    glBeginQuery(GL_TIME_ELAPSED, query);
+                    sculpture.draw(path == 1, true, models, clusters, projection, view, 0);
+                    glEndQuery(GL_TIME_ELAPSED);
+                    if (i >= 0) {
+                        GLuint64 elapsed = 0;
+                        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                        ms[path] += elapsed / 1e6;
+                        if (path == 1) {
+                            shaded += sculpture.shadedSamples;
+                            visible += sculpture.litSamples;
+                        }
+                    }
+                }
+            }
+            std::printf("%10zu %8d %10.2f %14.3f %14.3f %9.2fx\n", cubes.size(), count,
+                        visible > 0 ? (double)shaded / visible : 0.0, ms[0] / frames, ms[1] / frames,
+                        ms[1] > 0.0 ? ms[0] / ms[1] : 0.0);
+        }
+        gridSize = savedGridSize;
+    }
+    glDeleteQueries(1, &query);
+    sculpture.measureOverdraw = false;
+}
+
+// Matrices per second of the original glm loop against the SoA kernel on one
+// thread and on all of them, CPU only. Before timing, the kernel output is
+// compared with the glm loop at a few animation times, including late ones
+// where the sine arguments are large; a mismatch fails the run.
+int runKernelBenchmark(int frames, JobScheduler& jobs)
+{
+#if defined(SIMD_AVX2)
+    const char* isa = "AVX2+FMA";
+#elif defined(SIMD_SSE2)
+    const char* isa = "SSE2";
+#else
+    const char* isa = "scalar";
+#endif
+    std::printf("kernel: %s, %zu lanes, %u threads\n", isa, SIMD_LANES, jobs.threadCount());
+
+    // correctness: positions are up to ~200 units out, so compare with an
+    // absolute tolerance a little above float rounding at that magnitude
+    KineticGrid grid;
+    grid.build(MAX_GRID_SIZE);
+    std::vector<glm::mat4> reference(grid.size()), models(grid.size());
+    const float checkTimes[] = { 0.0f, 1.7f, 123.4f, 3600.0f };
+    float maxError = 0.0f;
+    for (float t : checkTimes) {
+        kineticTransformsReference(grid, t, reference.data(), 0, grid.size());
+        updateKineticTransforms(jobs, grid, t, models);
+        for (size_t i = 0; i < grid.size(); i++)
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    maxError = std::max(maxError, std::abs(models[i][c][r] - reference[i][c][r]));
+    }
+    const float tolerance = 1e-3f;
+    std::printf("max abs error vs glm over %zu cubes: %g (%s)\n", grid.size(), maxError, maxError <= tolerance ? "ok" : "FAILED");
+    if (maxError > tolerance)
+        return 1;
+
+    const int sizes[] = { 5, 10, 20, 30, MAX_GRID_SIZE };
+    std::printf("%10s %16s %16s %18s %16s %10s\n", "cubes", "glm M/s", "kernel M/s", "threaded M/s", "M/s per core", "speedup");
+    for (int size : sizes)
+    {
+        grid.build(size);
+        models.resize(grid.size());
+        double seconds[3] = { 0.0, 0.0, 0.0 };
+        for (int frame = 0; frame < frames; frame++) {
+            float t = frame / 60.0f;
+            auto t0 = std::chrono::steady_clock::now();
+            kineticTransformsReference(grid, t, models.data(), 0, grid.size());
+            auto t1 = std::chrono::steady_clock::now();
+            kineticTransforms(grid, t, models.data(), 0, grid.size());
+            auto t2 = std::chrono::steady_clock::now();
+            updateKineticTransforms(jobs, grid, t, models);
+            auto t3 = std::chrono::steady_clock::now();
+            seconds[0] += std::chrono::duration<double>(t1 - t0).count();
+            seconds[1] += std::chrono::duration<double>(t2 - t1).count();
+            seconds[2] += std::chrono::duration<double>(t3 - t2).count();
+        }
+        double rate[3];
+        for (int k = 0; k < 3; k++)
+            rate[k] = seconds[k] > 0.0 ? grid.size() * (double)frames / seconds[k] / 1e6 : 0.0;
+        // below KINETIC_MIN_CHUNK the threaded path only uses the calling thread
+        unsigned int cores = (unsigned int)std::min<size_t>(jobs.threadCount(), (grid.size() + KINETIC_MIN_CHUNK - 1) / KINETIC_MIN_CHUNK);
+        std::printf("%10zu %16.1f %16.1f %18.1f %16.1f %9.1fx\n", grid.size(), rate[0], rate[1], rate[2],
+                    rate[2] / std::max(cores, 1u), rate[0] > 0.0 ? rate[1] / rate[0] : 0.0);
+    }
+    return 0;
+}
+
 // === Callback and Input Functions (mostly unchanged) ===
+bool gridKeyDown = false;
+bool instanceKeyDown = false;
+bool lightKeyDown = false;
+bool deferredKeyDown = false;
+bool cullKeyDown = false;
+
 void processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -316,10 +1064,43 @@ void processInput(GLFWwindow* window) {
         camera.ProcessKeyboard(LEFT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
+
+    // Grid size and draw path, once per key press
+    bool grow = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+    bool shrink = glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+    if ((grow || shrink) && !gridKeyDown) {
+        int newSize = glm::clamp(gridSize + (grow ? 1 : -1), 0, MAX_GRID_SIZE);
+        gridChanged = newSize != gridSize;
+        gridSize = newSize;
+    }
+    gridKeyDown = grow || shrink;
+
+    bool instanceKey = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (instanceKey && !instanceKeyDown)
+        drawInstanced = !drawInstanced;
+    instanceKeyDown = instanceKey;
+
+    bool moreLights = glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS;
+    bool fewerLights = glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS;
+    if ((moreLights || fewerLights) && !lightKeyDown)
+        lightCount = glm::clamp(moreLights ? lightCount * 2 : lightCount / 2, 2, MAX_CLUSTER_LIGHTS);
+    lightKeyDown = moreLights || fewerLights;
+
+    bool deferredKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (deferredKey && !deferredKeyDown)
+        deferredShading = !deferredShading;
+    deferredKeyDown = deferredKey;
+
+    bool cullKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cullKey && !cullKeyDown)
+        frustumCulling = !frustumCulling;
+    cullKeyDown = cullKey;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
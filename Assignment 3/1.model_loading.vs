@@ -1,7 +1,6 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoords;
+layout (location = 0) in vec4 aPos;       // snorm16 inside the mesh's bounding box
+layout (location = 2) in vec2 aTexCoords; // half float
 
 out vec2 TexCoords;
 
@@ -9,8 +8,13 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// dequantization of the packed positions, per mesh
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    vec3 position = aPos.xyz * positionScale + positionOffset;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
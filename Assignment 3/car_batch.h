@@ -0,0 +1,118 @@
+#ifndef CAR_BATCH_H
+#define CAR_BATCH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/simd.h>
+#include <learnopengl/jobs.h>
+
+#include "car_sim.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Many independent cars stepped together, e.g. to evaluate driving bots or
+// tuning parameters on thousands of cars at once. State and inputs are kept
+// one array per component; throttle, steering and friction run SIMD_LANES
+// cars at a time, and only the collision queries, which branch per car, stay
+// scalar. Cars collide with the shared world, not with each other, so they
+// are split across the job scheduler without any locking.
+struct CarBatch
+{
+    std::vector<float> x, y, z, yaw, speed;
+    std::vector<float> throttle, steer;     // CarInput per car, set before each step
+    std::vector<uint32_t> crashes;          // since add()
+    std::vector<ContactEvents> contacts;
+
+    size_t size() const { return x.size(); }
+
+    size_t add(const CarState& car)
+    {
+        x.push_back(car.position.x);
+        y.push_back(car.position.y);
+        z.push_back(car.position.z);
+        yaw.push_back(car.yaw);
+        speed.push_back(car.speed);
+        throttle.push_back(0.0f);
+        steer.push_back(0.0f);
+        crashes.push_back(0);
+        contacts.emplace_back();
+        return x.size() - 1;
+    }
+
+    CarState get(size_t i) const { return { glm::vec3(x[i], y[i], z[i]), yaw[i], speed[i] }; }
+
+    void setInput(size_t i, const CarInput& input)
+    {
+        throttle[i] = input.throttle;
+        steer[i] = input.steer;
+    }
+};
+
+// Steps cars [begin, end) by dt, in blocks small enough that the motions of
+// the kinematics pass are still in cache for the collision pass
+inline void stepCarRange(CarBatch& cars, float dt, const CarWorld& world, size_t begin, size_t end)
+{
+    const size_t BLOCK = 256;
+    float motionX[BLOCK], motionZ[BLOCK];
+    for (size_t block = begin; block < end; block += BLOCK)
+    {
+        size_t blockEnd = std::min(end, block + BLOCK);
+        size_t i = block;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+        // driveCar(), SIMD_LANES cars at a time
+        const vfloat zero = vset1(0.0f), full = vset1(360.0f), friction = vset1(FRICTION * dt);
+        for (; i + SIMD_LANES <= blockEnd; i += SIMD_LANES)
+        {
+            vfloat speed = vmuladd(vload(&cars.throttle[i]), vset1(PLAYER_ACCELERATION * dt), vload(&cars.speed[i]));
+            vfloat moving = vless(vset1(0.1f), vmax(speed, vsub(zero, speed)));
+            vfloat yaw = vadd(vload(&cars.yaw[i]), vand(moving, vmul(vload(&cars.steer[i]), vset1(PLAYER_TURN_SPEED * dt))));
+            yaw = vadd(yaw, vand(vless(yaw, zero), full));
+            yaw = vsub(yaw, vand(vless(full, yaw), full));
+            vfloat forward = vless(zero, speed), backward = vless(speed, zero);
+            speed = vadd(vsub(speed, vand(forward, friction)), vand(backward, friction));
+            speed = vmin(vmax(speed, vset1(-MAX_SPEED / 2.0f)), vset1(MAX_SPEED));
+            vfloat radians = vmul(yaw, vset1(0.0174532925f));
+            vfloat step = vmul(speed, vset1(dt));
+            vstore(&cars.speed[i], speed);
+            vstore(&cars.yaw[i], yaw);
+            vstore(&motionX[i - block], vmul(vsincos(radians, 1), step));
+            vstore(&motionZ[i - block], vmul(vsincos(radians, 0), step));
+        }
+#endif
+        // scalar fallback and the remainder of a vector batch
+        for (; i < blockEnd; i++)
+        {
+            CarState car = cars.get(i);
+            glm::vec3 motion = driveCar(car, { cars.throttle[i], cars.steer[i] }, dt);
+            cars.yaw[i] = car.yaw;
+            cars.speed[i] = car.speed;
+            motionX[i - block] = motion.x;
+            motionZ[i - block] = motion.z;
+        }
+
+        // moveCar(), one car at a time
+        for (i = block; i < blockEnd; i++)
+        {
+            glm::vec3 position(cars.x[i], cars.y[i], cars.z[i]);
+            cars.crashes[i] += moveCar(position, cars.speed[i], glm::vec3(motionX[i - block], 0.0f, motionZ[i - block]), world, cars.contacts[i]);
+            cars.x[i] = position.x;
+            cars.y[i] = position.y;
+            cars.z[i] = position.z;
+        }
+    }
+}
+
+// A few hundred cars are worth waking the workers for, the collision
+// queries cost microseconds per car
+const size_t CAR_BATCH_MIN_CHUNK = 256;
+
+inline void stepCars(JobScheduler& jobs, CarBatch& cars, float dt, const CarWorld& world)
+{
+    jobs.parallelFor(cars.size(), CAR_BATCH_MIN_CHUNK, [&](size_t begin, size_t end) {
+        stepCarRange(cars, dt, world, begin, end);
+    }, SIMD_LANES);
+}
+
+#endif
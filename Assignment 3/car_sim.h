@@ -0,0 +1,128 @@
+#ifndef CAR_SIM_H
+#define CAR_SIM_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bvh.h>
+
+#include "collision.h"
+
+#include <algorithm>
+#include <cmath>
+
+// ============== Car physics ==============
+// The car is simulated at a fixed rate, independent of the frame rate, so
+// the same inputs always give the same drive. Nothing here touches GL.
+const float SIM_STEP = 1.0f / 120.0f;
+const int MAX_SIM_STEPS_PER_FRAME = 8;   // below 15 fps the game slows down instead
+
+const float PLAYER_ACCELERATION = 8.0f;
+const float PLAYER_TURN_SPEED = 100.0f;
+const float FRICTION = 3.0f;
+const float MAX_SPEED = 15.0f;
+const float CAR_COLLISION_RADIUS = 1.8f;
+const float CONTACT_SKIN = 0.05f; // the car stops this far short of what it hits
+// Against the city: the car rides CAR_RIDE_HEIGHT above the road under it
+// and can climb steps up to MAX_STEP. Walls are found with a sphere lifted
+// off the road, and only faces steeper than WALKABLE_NORMAL_Y stop it.
+const float CAR_RIDE_HEIGHT = 1.0f;
+const float MAX_STEP = 0.5f;
+const float WALL_PROBE_HEIGHT = 0.6f;
+const float WALL_PROBE_RADIUS = 1.2f;
+const float WALKABLE_NORMAL_Y = 0.7f;
+
+// Held controls: throttle 1 is W, -1 is S; steer 1 is D, -1 is A
+struct CarInput {
+    float throttle = 0.0f;
+    float steer = 0.0f;
+};
+
+struct CarState {
+    glm::vec3 position;
+    float yaw;      // degrees
+    float speed;
+};
+
+// What the car collides with; either may be null
+struct CarWorld {
+    const SpatialHash* obstacles = nullptr;
+    const TriangleBvh* city = nullptr;
+};
+
+inline glm::vec3 carFront(float yaw)
+{
+    return glm::normalize(glm::vec3(std::cos(glm::radians(yaw)), 0.0f, std::sin(glm::radians(yaw))));
+}
+
+// Throttle, steering, friction and the speed limit for one step of dt
+// seconds; returns how far the car wants to move
+inline glm::vec3 driveCar(CarState& car, const CarInput& input, float dt)
+{
+    car.speed += input.throttle * PLAYER_ACCELERATION * dt;
+    if (std::fabs(car.speed) > 0.1f)
+        car.yaw = std::fmod(car.yaw + input.steer * PLAYER_TURN_SPEED * dt + 360.0f, 360.0f);
+    if (car.speed > 0) car.speed -= FRICTION * dt;
+    else if (car.speed < 0) car.speed += FRICTION * dt;
+    car.speed = std::min(std::max(car.speed, -MAX_SPEED / 2.0f), MAX_SPEED);
+    return carFront(car.yaw) * car.speed * dt;
+}
+
+// Moves the car up to the first obstacle or wall in the way, stopping it
+// there, and puts it on the road; returns how many obstacles it newly
+// touches
+inline unsigned int moveCar(glm::vec3& position, float& speed, glm::vec3 motion, const CarWorld& world, ContactEvents& contacts)
+{
+    SweepHit hit;
+    if (world.obstacles && world.obstacles->sweep(position, CAR_COLLISION_RADIUS, motion, hit))
+    {
+        float travel = glm::length(motion);
+        motion *= travel > 0.0f ? std::max(hit.t - CONTACT_SKIN / travel, 0.0f) : 0.0f;
+        speed = 0.0f;
+    }
+    BvhSweepHit wall;
+    if (world.city && world.city->sweep(position + glm::vec3(0.0f, WALL_PROBE_HEIGHT, 0.0f), WALL_PROBE_RADIUS, motion, wall, WALKABLE_NORMAL_Y))
+    {
+        float travel = glm::length(motion);
+        motion *= travel > 0.0f ? std::max(wall.t - CONTACT_SKIN / travel, 0.0f) : 0.0f;
+        speed = 0.0f;
+    }
+    position += motion;
+
+    // Floor: the highest road surface below the wheels plus a step; off the
+    // city the old flat ground remains
+    BvhRayHit ground;
+    glm::vec3 probe = position + glm::vec3(0.0f, MAX_STEP - CAR_RIDE_HEIGHT, 0.0f);
+    if (world.city && world.city->raycast(probe, glm::vec3(0.0f, -1.0f, 0.0f), 50.0f, ground))
+        position.y = probe.y - ground.t + CAR_RIDE_HEIGHT;
+    else if (position.y < -1.0f)
+        position.y = -1.0f;
+
+    unsigned int crashes = 0;
+    if (world.obstacles)
+        world.obstacles->overlaps(position, CAR_COLLISION_RADIUS + 2.0f * CONTACT_SKIN, [&](uint32_t id) { contacts.add(id); });
+    contacts.update([&](uint32_t) { crashes++; });
+    return crashes;
+}
+
+// Advances the car by one step of dt seconds; returns how many obstacles it
+// crashed into during the step
+inline unsigned int stepCar(CarState& car, const CarInput& input, float dt, const CarWorld& world, ContactEvents& contacts)
+{
+    glm::vec3 motion = driveCar(car, input, dt);
+    return moveCar(car.position, car.speed, motion, world, contacts);
+}
+
+// The pose to draw between two steps
+inline CarState interpolate(const CarState& previous, const CarState& current, float alpha)
+{
+    CarState shown;
+    shown.position = glm::mix(previous.position, current.position, alpha);
+    float turn = current.yaw - previous.yaw;  // the short way across 0/360
+    if (turn > 180.0f) turn -= 360.0f;
+    else if (turn < -180.0f) turn += 360.0f;
+    shown.yaw = previous.yaw + turn * alpha;
+    shown.speed = previous.speed + (current.speed - previous.speed) * alpha;
+    return shown;
+}
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct CollisionSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Result of a swept query: the first obstacle hit and the fraction of the
+// motion travelled before touching it. candidates counts the narrowphase
+// tests made, hit or not.
+struct SweepHit {
+    uint32_t id = 0;
+    float t = 1.0f;
+    uint32_t candidates = 0;
+};
+
+// Overlap test on squared distances, no square root
+inline bool spheresOverlap(const glm::vec3& a, float radiusA, const glm::vec3& b, float radiusB)
+{
+    glm::vec3 d = a - b;
+    float r = radiusA + radiusB;
+    return glm::dot(d, d) < r * r;
+}
+
+// Time of impact of a sphere moving by motion against a static sphere, as a
+// fraction of motion in [0, 1]. A sphere that already overlaps only hits if
+// it moves further in, so a stuck car can always back out.
+inline bool sweepSphere(const glm::vec3& center, float radius, const glm::vec3& motion,
+                        const glm::vec3& obstacle, float obstacleRadius, float& t)
+{
+    glm::vec3 m = center - obstacle;
+    float r = radius + obstacleRadius;
+    float b = glm::dot(m, motion);
+    float c = glm::dot(m, m) - r * r;
+    if (c <= 0.0f)
+    {
+        if (b >= 0.0f)
+            return false;
+        t = 0.0f;
+        return true;
+    }
+    float a = glm::dot(motion, motion);
+    if (b >= 0.0f || a == 0.0f)
+        return false;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.0f)
+        return false;
+    t = (-b - std::sqrt(discriminant)) / a;
+    return t <= 1.0f;
+}
+
+// Reference for the grid: tests every sphere
+inline bool sweepSpheres(const std::vector<CollisionSphere>& spheres, const glm::vec3& center, float radius,
+                         const glm::vec3& motion, SweepHit& hit)
+{
+    bool found = false;
+    hit.t = 1.0f;
+    for (uint32_t i = 0; i < spheres.size(); i++)
+    {
+        float t;
+        if (sweepSphere(center, radius, motion, spheres[i].center, spheres[i].radius, t) && (!found || t < hit.t))
+        {
+            hit.id = i;
+            hit.t = t;
+            found = true;
+        }
+    }
+    hit.candidates = (uint32_t)spheres.size();
+    return found;
+}
+
+// Uniform grid over the ground plane (XZ) for static obstacle spheres. Each
+// sphere is stored once, in the cell holding its center; cells are at least
+// twice the largest radius, so a query only has to widen its box by that
+// radius to find everything it can touch. Spheres are kept sorted by cell so
+// a cell's spheres are contiguous, and occupied cells are found through an
+// open-addressed hash table, so empty space costs no memory and the grid
+// needs no bounds.
+class SpatialHash
+{
+public:
+    // Builds the grid; ids in queries are indices into spheres.
+    void build(const std::vector<CollisionSphere>& spheres, float cellSize)
+    {
+        maxRadius = 0.0f;
+        for (const CollisionSphere& s : spheres)
+            maxRadius = std::max(maxRadius, s.radius);
+        cell = std::max(cellSize, 2.0f * maxRadius);
+        if (cell <= 0.0f)
+            cell = 1.0f;
+        invCell = 1.0f / cell;
+
+        std::vector<std::pair<uint64_t, uint32_t>> order(spheres.size());
+        for (uint32_t i = 0; i < spheres.size(); i++)
+            order[i] = { packCell(cellOf(spheres[i].center.x), cellOf(spheres[i].center.z)), i };
+        std::sort(order.begin(), order.end());
+
+        size_t cellCount = 0;
+        for (size_t i = 0; i < order.size(); i++)
+            if (i == 0 || order[i].first != order[i - 1].first)
+                cellCount++;
+        size_t capacity = 16;
+        while (capacity < cellCount * 2)
+            capacity *= 2;
+        cells.assign(capacity, Cell());
+        mask = (uint32_t)(capacity - 1);
+        occupied = (uint32_t)cellCount;
+
+        slots.resize(order.size());
+        ids.resize(order.size());
+        uint32_t current = 0;
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            const CollisionSphere& s = spheres[order[i].second];
+            slots[i] = glm::vec4(s.center, s.radius);
+            ids[i] = order[i].second;
+            if (i == 0 || order[i].first != order[i - 1].first)
+            {
+                int32_t x = (int32_t)(uint32_t)(order[i].first >> 32);
+                int32_t z = (int32_t)(uint32_t)order[i].first;
+                current = hashCell(x, z) & mask;
+                while (cells[current].start != EMPTY)
+                    current = (current + 1) & mask;
+                cells[current].x = x;
+                cells[current].z = z;
+                cells[current].start = i;
+            }
+            cells[current].count++;
+        }
+    }
+
+    size_t size() const { return slots.size(); }
+    size_t cellCount() const { return occupied; }
+    float cellSize() const { return cell; }
+
+    // Calls f(id) for every sphere overlapping the given one
+    template<typename F>
+    uint32_t overlaps(const glm::vec3& center, float radius, F f) const
+    {
+        glm::vec2 lo(center.x - radius, center.z - radius);
+        glm::vec2 hi(center.x + radius, center.z + radius);
+        return forEachSlot(lo, hi, [&](uint32_t slot) {
+            const glm::vec4& s = slots[slot];
+            if (spheresOverlap(center, radius, glm::vec3(s), s.w))
+                f(ids[slot]);
+        });
+    }
+
+    // First sphere hit by a sphere moving from center by motion
+    bool sweep(const glm::vec3& center, float radius, const glm::vec3& motion, SweepHit& hit) const
+    {
+        glm::vec3 end = center + motion;
+        glm::vec2 lo(std::min(center.x, end.x) - radius, std::min(center.z, end.z) - radius);
+        glm::vec2 hi(std::max(center.x, end.x) + radius, std::max(center.z, end.z) + radius);
+        bool found = false;
+        hit.t = 1.0f;
+        hit.candidates = forEachSlot(lo, hi, [&](uint32_t slot) {
+            const glm::vec4& s = slots[slot];
+            float t;
+            if (sweepSphere(center, radius, motion, glm::vec3(s), s.w, t) &&
+                (!found || t < hit.t || (t == hit.t && ids[slot] < hit.id)))
+            {
+                hit.id = ids[slot];
+                hit.t = t;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+private:
+    static const uint32_t EMPTY = 0xffffffffu;
+
+    struct Cell {
+        int32_t x = 0, z = 0;
+        uint32_t start = EMPTY; // first slot
+        uint32_t count = 0;
+    };
+
+    std::vector<Cell> cells;
+    std::vector<glm::vec4> slots; // center and radius, sorted by cell
+    std::vector<uint32_t> ids;    // slot -> index given to build()
+    uint32_t mask = 0, occupied = 0;
+    float cell = 1.0f, invCell = 1.0f, maxRadius = 0.0f;
+
+    int32_t cellOf(float v) const { return (int32_t)std::floor(v * invCell); }
+    static uint64_t packCell(int32_t x, int32_t z) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z; }
+    static uint32_t hashCell(int32_t x, int32_t z) { return (uint32_t)x * 73856093u ^ (uint32_t)z * 19349663u; }
+
+    const Cell* find(int32_t x, int32_t z) const
+    {
+        if (cells.empty())
+            return nullptr;
+        uint32_t h = hashCell(x, z) & mask;
+        while (cells[h].start != EMPTY)
+        {
+            if (cells[h].x == x && cells[h].z == z)
+                return &cells[h];
+            h = (h + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    // Calls f(slot) for the spheres of every cell the box, widened by the
+    // largest radius, touches; returns how many it visited. A box covering
+    // more cells than are occupied walks the table instead.
+    template<typename F>
+    uint32_t forEachSlot(glm::vec2 lo, glm::vec2 hi, F f) const
+    {
+        if (slots.empty())
+            return 0;
+        int32_t x0 = cellOf(lo.x - maxRadius), x1 = cellOf(hi.x + maxRadius);
+        int32_t z0 = cellOf(lo.y - maxRadius), z1 = cellOf(hi.y + maxRadius);
+        uint32_t visited = 0;
+        if ((double)(x1 - x0 + 1) * (double)(z1 - z0 + 1) > (double)occupied)
+        {
+            for (const Cell& c : cells)
+            {
+                if (c.start == EMPTY || c.x < x0 || c.x > x1 || c.z < z0 || c.z > z1)
+                    continue;
+                for (uint32_t s = c.start; s < c.start + c.count; s++)
+                    f(s);
+                visited += c.count;
+            }
+            return visited;
+        }
+        for (int32_t z = z0; z <= z1; z++)
+            for (int32_t x = x0; x <= x1; x++)
+            {
+                const Cell* c = find(x, z);
+                if (!c)
+                    continue;
+                for (uint32_t s = c->start; s < c->start + c->count; s++)
+                    f(s);
+                visited += c->count;
+            }
+        return visited;
+    }
+};
+
+// Turns per-frame contacts into events: a contact is reported the first
+// frame it appears and not again until it has been broken.
+class ContactEvents
+{
+public:
+    void add(uint32_t id) { current.push_back(id); }
+
+    // Calls onEnter(id) for the contacts added this frame that were not
+    // there the frame before, then starts the next frame.
+    template<typename F>
+    void update(F onEnter)
+    {
+        std::sort(current.begin(), current.end());
+        current.erase(std::unique(current.begin(), current.end()), current.end());
+        for (uint32_t id : current)
+            if (!std::binary_search(previous.begin(), previous.end(), id))
+                onEnter(id);
+        previous.swap(current);
+        current.clear();
+    }
+
+private:
+    std::vector<uint32_t> current, previous;
+};
+
+#endif
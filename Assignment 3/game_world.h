@@ -0,0 +1,186 @@
+#ifndef GAME_WORLD_H
+#define GAME_WORLD_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/ecs.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/vertex_format.h>
+
+#include "collision.h"
+#include "car_sim.h"
+
+#include <cstdint>
+#include <vector>
+
+// ============== Components ==============
+// The pose drawn this frame; yaw in degrees, as CarState
+struct Transform {
+    glm::vec3 position;
+    float yaw;
+};
+
+// A simulated car: the last two steps, the controls it holds, and what the
+// movement system hands to the collision system
+struct CarBody {
+    CarState state, previous;
+    CarInput input;
+    glm::vec3 motion = glm::vec3(0.0f);
+    ContactEvents contacts;
+    unsigned int crashes = 0, newCrashes = 0;
+};
+
+// Something the cars crash into; obstacles never move
+struct Obstacle {
+    float radius;
+};
+
+// What to draw: the model, placed by its entity's Transform after local
+// (the model's own offset, turn and scale). Render extraction fills in
+// matrix and sphere, the drawing code the level of each mesh.
+struct Renderable {
+    const PackedModel* model = nullptr;
+    BoundingSphere bounds = { glm::vec3(0.0f), 0.0f };   // in model space
+    glm::mat4 local = glm::mat4(1.0f);
+    float scale = 1.0f;                                  // of local
+    glm::mat4 matrix = glm::mat4(1.0f);
+    BoundingSphere sphere = { glm::vec3(0.0f), 0.0f };   // in world space
+    std::vector<uint8_t> levels;                         // per mesh
+};
+
+// A chase camera behind target, looking at a point above its position
+struct CameraRig {
+    Entity target;
+    glm::vec3 lookOffset = glm::vec3(0.0f);
+    float distance = 8.0f, height = 4.0f;
+    glm::vec3 position = glm::vec3(0.0f), front = glm::vec3(0.0f, 0.0f, -1.0f);
+};
+
+// ============== Systems ==============
+// The parameters are read when the systems run, so they can change between
+// runs of a graph.
+
+// Throttle, steering and friction of every car for one step of dt
+inline System movementSystem(const float& dt)
+{
+    System system;
+    system.name = "movement";
+    system.query = componentMask<CarBody>();
+    system.writes = componentMask<CarBody>();
+    system.run = [&dt](const ChunkView& chunk) {
+        CarBody* bodies = chunk.column<CarBody>();
+        for (uint32_t i = 0; i < chunk.count; i++)
+        {
+            bodies[i].previous = bodies[i].state;
+            bodies[i].motion = driveCar(bodies[i].state, bodies[i].input, dt);
+        }
+    };
+    return system;
+}
+
+// Moves every car along its motion against the world's obstacles and city
+inline System collisionSystem(const CarWorld& world)
+{
+    System system;
+    system.name = "collision";
+    system.query = componentMask<CarBody>();
+    system.writes = componentMask<CarBody>();
+    system.run = [&world](const ChunkView& chunk) {
+        CarBody* bodies = chunk.column<CarBody>();
+        for (uint32_t i = 0; i < chunk.count; i++)
+        {
+            CarBody& body = bodies[i];
+            body.newCrashes = moveCar(body.state.position, body.state.speed, body.motion, world, body.contacts);
+            body.crashes += body.newCrashes;
+        }
+    };
+    return system;
+}
+
+// The pose of every car between its last two steps
+inline System interpolationSystem(const float& alpha)
+{
+    System system;
+    system.name = "interpolation";
+    system.query = componentMask<CarBody, Transform>();
+    system.reads = componentMask<CarBody>();
+    system.writes = componentMask<Transform>();
+    system.run = [&alpha](const ChunkView& chunk) {
+        const CarBody* bodies = chunk.column<CarBody>();
+        Transform* transforms = chunk.column<Transform>();
+        for (uint32_t i = 0; i < chunk.count; i++)
+        {
+            CarState shown = interpolate(bodies[i].previous, bodies[i].state, alpha);
+            transforms[i].position = shown.position;
+            transforms[i].yaw = shown.yaw;
+        }
+    };
+    return system;
+}
+
+// Puts every camera rig behind its target
+inline System cameraFollowSystem(const World& world)
+{
+    System system;
+    system.name = "camera follow";
+    system.query = componentMask<CameraRig>();
+    system.reads = componentMask<Transform>();
+    system.writes = componentMask<CameraRig>();
+    system.run = [&world](const ChunkView& chunk) {
+        CameraRig* rigs = chunk.column<CameraRig>();
+        for (uint32_t i = 0; i < chunk.count; i++)
+        {
+            CameraRig& rig = rigs[i];
+            const Transform* target = world.get<Transform>(rig.target);
+            if (!target)
+                continue;
+            glm::vec3 lookAt = target->position + rig.lookOffset;
+            rig.position = lookAt - carFront(target->yaw) * rig.distance + glm::vec3(0.0f, rig.height, 0.0f);
+            rig.front = glm::normalize(lookAt - rig.position);
+        }
+    };
+    return system;
+}
+
+// The model matrix and world bounding sphere of everything drawn
+inline System renderExtractionSystem()
+{
+    System system;
+    system.name = "render extraction";
+    system.query = componentMask<Transform, Renderable>();
+    system.reads = componentMask<Transform>();
+    system.writes = componentMask<Renderable>();
+    system.run = [](const ChunkView& chunk) {
+        const Transform* transforms = chunk.column<Transform>();
+        Renderable* renderables = chunk.column<Renderable>();
+        for (uint32_t i = 0; i < chunk.count; i++)
+        {
+            Renderable& r = renderables[i];
+            glm::mat4 placed = glm::translate(glm::mat4(1.0f), transforms[i].position);
+            placed = glm::rotate(placed, glm::radians(-transforms[i].yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+            r.matrix = placed * r.local;
+            r.sphere = transformSphere(r.bounds, r.matrix);
+        }
+    };
+    return system;
+}
+
+// A car entity as the game and the benchmark set it up; model may be null
+inline Entity createCar(World& world, const CarState& car, const PackedModel* model, const BoundingSphere& bounds)
+{
+    CarBody body;
+    body.state = body.previous = car;
+    Renderable renderable;
+    renderable.model = model;
+    renderable.bounds = bounds;
+    renderable.scale = 0.1f;
+    renderable.local = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.2f, 0.0f));
+    renderable.local = glm::rotate(renderable.local, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    renderable.local = glm::scale(renderable.local, glm::vec3(renderable.scale));
+    if (model)
+        renderable.levels.assign(model->meshes.size(), 0);
+    return world.create(Transform{ car.position, car.yaw }, std::move(body), std::move(renderable));
+}
+
+#endif
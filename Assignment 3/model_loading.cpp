@@ -9,18 +9,76 @@
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/uniforms.h>
+#include <learnopengl/offline.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/vertex_format.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/asset_loader.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/fixed_timestep.h>
+#include <learnopengl/static_batch.h>
+#include <learnopengl/lod.h>
+#include <learnopengl/jobs.h>
+#include <learnopengl/ecs.h>
+#include <learnopengl/occlusion.h>
+#include <learnopengl/event_log.h>
 
+#include "collision.h"
+#include "car_sim.h"
+#include "car_batch.h"
+#include "game_world.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+void runLoadBenchmark(const std::string* modelPaths, bool useMeshCache);
+void runCollisionBenchmark();
+void runBvhBenchmark(const std::string& cityPath);
+void loadCityBvh(const std::string& path, bool useMeshCache, TriangleBvh& bvh, JobScheduler* jobs = nullptr);
+int runHeadlessDrive(float seconds);
+CarInput scriptedInput(double t);
+void runBatchBenchmark();
+void runEcsBenchmark();
+void runOcclusionBenchmark();
+void runLogBenchmark();
 
 // Settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
+const double UPLOAD_BUDGET_MS = 4.0;   // GL upload time per loading frame
+const glm::vec3 CITY_SCALE = glm::vec3(0.02f);
+
+// Occlusion culling: a CPU depth buffer at a quarter of the screen size,
+// the nearest city meshes drawn into it each frame up to a triangle budget
+const int OCCLUSION_WIDTH = SCR_WIDTH / 4, OCCLUSION_HEIGHT = SCR_HEIGHT / 4;
+const float OCCLUDER_MIN_RADIUS = 2.0f;       // smaller meshes are not occluders
+const size_t OCCLUDER_TRIANGLE_BUDGET = 20000;
+
+// A city mesh as an occluder, in world space; no triangles if it is too
+// small to be one
+struct CityOccluder {
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+    BoundingSphere sphere;
+};
+void loadCityOccluders(const std::string& path, bool useMeshCache, std::vector<CityOccluder>& occluders);
+void drawCityOccluders(MaskedOcclusionBuffer& occlusion, const std::vector<CityOccluder>& occluders, const std::vector<uint32_t>& visible,
+                       const glm::vec3& eye, JobScheduler& jobs);
 
 // Camera
 Camera camera(glm::vec3(0.0f, 5.0f, 15.0f));
@@ -33,160 +91,539 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 // ============== Player (Car) State ==============
-glm::vec3 playerPosition = glm::vec3(0.0f, -2.0f, 5.0f); // Start on the new ground level
-glm::vec3 playerModelOffset = glm::vec3(0.0f, 0.2f, 0.0f);
-glm::vec3 playerFront = glm::vec3(0.0f, 0.0f, -1.0f);
-float playerYaw = 180.0f; // Rotated the starting position
-float playerSpeed = 0.0f;
-const float PLAYER_ACCELERATION = 8.0f;
-const float PLAYER_TURN_SPEED = 100.0f;
-const float FRICTION = 3.0f;
-const float MAX_SPEED = 15.0f;
-
-// ============== Game Objects ==============
-struct GameObject {
-    glm::vec3 position;
-    float scale;
-    float collisionRadius;
-    Model* model;
+// The car, the barrels and the camera are entities of the game's World
+// (game_world.h); only the keyboard state lives here.
+const CarState PLAYER_START = { glm::vec3(0.0f, -2.0f, 5.0f), 180.0f, 0.0f }; // on the ground, turned around
+CarInput playerInput;     // sampled once per frame, held for its steps
+
+// Logged from the frame loop: a few crash lines a second at most, however
+// long the car scrapes along a barrel
+LogSite crashLog(LOG_INFO, "CRASH! You hit a barrel. (%u crashes)", 4);
+
+// Lowered the Y-position for all barrels to the new ground level
+const glm::vec3 BARREL_POSITIONS[] = {
+    glm::vec3(10.0f, -2.0f, -10.0f), glm::vec3(-5.0f, -2.0f, 20.0f), glm::vec3(10.0f, -2.0f, 15.0f),
+    glm::vec3(-5.0f, -2.0f, -10.0f), glm::vec3(0.0f, -2.0f, 28.0f)
 };
 
-std::vector<GameObject> obstacles;
+// 'C' toggles frustum culling
+bool frustumCulling = true;
+bool cullKeyDown = false;
+
+// 'B' toggles drawing the city from its static batch
+bool staticBatching = true;
+bool batchKeyDown = false;
+
+// 'L' toggles levels of detail
+bool levelsOfDetail = true;
+bool lodKeyDown = false;
+
+// 'O' toggles occlusion culling
+bool occlusionCulling = true;
+bool occlusionKeyDown = false;
 
-// ============== Collision Detection ==============
-bool checkCollision(const GameObject& one, const GameObject& two)
+// Per-draw uniforms of 1.model_loading
+struct MeshUniforms {
+    Uniform<glm::mat4> model;
+    Uniform<glm::vec3> positionOffset, positionScale;
+};
+
+// One packet per mesh at the given level of detail, keyed by program, first
+// texture, VAO and view depth
+void submitMesh(RenderQueue& queue, unsigned int program, const MeshUniforms& uniforms, const PackedMesh& mesh, int level,
+                const glm::mat4& model, const glm::mat4& view, float farPlane)
 {
-    float distance = glm::length(one.position - two.position);
-    return distance < (one.collisionRadius + two.collisionRadius);
+    float depth = -(view * model * glm::vec4(mesh.positionOffset, 1.0f)).z / farPlane;
+    unsigned int material = mesh.textures.empty() ? 0 : mesh.textures[0].second;
+    queue.submit(makeSortKey(0, program, material, mesh.VAO, depth), program, mesh.VAO, &mesh.textures,
+                 GL_TRIANGLES, mesh.levelIndexCount(level), mesh.indexType, 1, mesh.levelFirstIndex(level));
+    queue.setMat4(uniforms.model.location, model);
+    queue.setVec3(uniforms.positionOffset.location, mesh.positionOffset);
+    queue.setVec3(uniforms.positionScale.location, mesh.positionScale);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // --collision-bench times the obstacle queries alone, --bvh-bench the
+    // city BVH, --drive <seconds> runs the car simulation, --batch-bench
+    // steps thousands of cars at once, --ecs-bench runs the game's systems
+    // over 100k entities, --occlusion-bench the occlusion culling along the
+    // scripted drive, --log-bench the event log against printing; all
+    // without a window
+    for (int i = 1; i < argc; i++)
+        if (std::strcmp(argv[i], "--drive") == 0 && i + 1 < argc)
+            return runHeadlessDrive((float)std::atof(argv[i + 1]));
+        else if (std::strcmp(argv[i], "--batch-bench") == 0)
+        {
+            runBatchBenchmark();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--ecs-bench") == 0)
+        {
+            runEcsBenchmark();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--occlusion-bench") == 0)
+        {
+            runOcclusionBenchmark();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--log-bench") == 0)
+        {
+            runLogBenchmark();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--collision-bench") == 0)
+        {
+            runCollisionBenchmark();
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--bvh-bench") == 0)
+        {
+            runBvhBenchmark(FileSystem::getPath("resources/objects/City/city.obj"));
+            return 0;
+        }
+
     // GLFW and GLAD setup...
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "City Driver", NULL, NULL);
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    OfflineRenderer offline(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+    GLFWwindow* window = NULL;
+    if (offline.active)
+    {
+        if (!offline.createContext())
+            return -1;
+    }
+    else
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "City Driver", NULL, NULL);
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
+    countUniformLookups();
 
     stbi_set_flip_vertically_on_load(true);
     glEnable(GL_DEPTH_TEST);
 
     // build and compile shaders
     Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+    UniformTable uniforms(ourShader.ID);
+    Uniform<glm::mat4> uProjection = uniforms.get<glm::mat4>("projection");
+    Uniform<glm::mat4> uView = uniforms.get<glm::mat4>("view");
+    MeshUniforms meshUniforms;
+    meshUniforms.model = uniforms.get<glm::mat4>("model");
+    meshUniforms.positionOffset = uniforms.get<glm::vec3>("positionOffset");
+    meshUniforms.positionScale = uniforms.get<glm::vec3>("positionScale");
+
+    // Load Models. Each goes through Assimp once and is then cooked into a
+    // binary cache next to its .obj; later launches map the cache instead.
+    // --rebuild-mesh-cache forces a cold load, --no-mesh-cache skips the cache.
+    // Loading runs as jobs on the game's job scheduler (--loader-threads N
+    // gives it N threads besides this one, default one per core) while
+    // frames keep coming; --sync-load loads on this thread with a per-model
+    // timing breakdown, --load-bench compares thread counts.
+    // Textures are shared by content hash and their mip chains cooked into
+    // resources/texture_cache (--no-texture-cache decodes every time);
+    // --cook-assets cooks meshes and textures and exits.
+    // --no-static-batch draws the city mesh by mesh, --no-lod at full detail,
+    // --no-occlusion without occlusion culling; --scripted-drive replaces the
+    // keyboard with the drive of --drive.
+    bool useMeshCache = true, rebuildMeshCache = false, syncLoad = false, loadBench = false;
+    bool useTextureCache = true, cookAssets = false, scriptedDrive = false;
+    unsigned int loaderThreads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--no-mesh-cache") == 0)
+            useMeshCache = false;
+        else if (std::strcmp(argv[i], "--rebuild-mesh-cache") == 0)
+            rebuildMeshCache = true;
+        else if (std::strcmp(argv[i], "--sync-load") == 0)
+            syncLoad = true;
+        else if (std::strcmp(argv[i], "--load-bench") == 0)
+            loadBench = true;
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            useTextureCache = false;
+        else if (std::strcmp(argv[i], "--cook-assets") == 0)
+            cookAssets = true;
+        else if (std::strcmp(argv[i], "--no-static-batch") == 0)
+            staticBatching = false;
+        else if (std::strcmp(argv[i], "--no-lod") == 0)
+            levelsOfDetail = false;
+        else if (std::strcmp(argv[i], "--no-occlusion") == 0)
+            occlusionCulling = false;
+        else if (std::strcmp(argv[i], "--scripted-drive") == 0)
+            scriptedDrive = true;
+        else if (std::strcmp(argv[i], "--loader-threads") == 0 && i + 1 < argc)
+            loaderThreads = (unsigned int)std::max(std::atoi(argv[++i]), 1);
+    }
+    const std::string modelPaths[3] = {
+        FileSystem::getPath("resources/objects/City/city.obj"),
+        FileSystem::getPath("resources/objects/Cars/Car_OBJ.obj"),
+        FileSystem::getPath("resources/objects/Barrel/Barrels_OBJ.obj")
+    };
+    if (rebuildMeshCache)
+        for (const std::string& path : modelPaths)
+            std::remove((path + ".meshcache").c_str());
+    TextureRegistry& textures = TextureRegistry::shared();
+    textures.configure(useTextureCache ? FileSystem::getPath("resources/texture_cache") : std::string(), true);
+
+    // One job scheduler runs the loading, the BVH build and later the game's
+    // systems. While loading this thread only uploads, so the scheduler
+    // needs a thread besides it even on one core.
+    JobScheduler jobs(loaderThreads > 0 ? loaderThreads + 1 : std::max(std::thread::hardware_concurrency(), 2u));
+    if (cookAssets)
+    {
+        auto cookStart = std::chrono::steady_clock::now();
+        AssetLoader loader(jobs);
+        for (const std::string& path : modelPaths)
+            loader.cookModel(path);
+        loader.finish();
+        std::printf("assets cooked in %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cookStart).count());
+        glfwTerminate();
+        return 0;
+    }
+    if (loadBench)
+    {
+        runLoadBenchmark(modelPaths, useMeshCache);
+        glfwTerminate();
+        return 0;
+    }
 
-    // Load Models
     std::cout << "Loading models..." << std::endl;
-    Model cityModel(FileSystem::getPath("resources/objects/City/city.obj"));
-    Model carModel(FileSystem::getPath("resources/objects/Cars/Car_OBJ.obj"));
-    Model barrelModel(FileSystem::getPath("resources/objects/Barrel/Barrels_OBJ.obj"));
+    auto loadStart = std::chrono::steady_clock::now();
+    PackedModel city, car, barrel;
+    ModelBounds cityBounds, carBounds, barrelBounds;
+    TriangleBvh cityBvh; // ground and walls
+    std::vector<CityOccluder> cityOccluders;
+    if (syncLoad)
+    {
+        auto loadTexture = [](const std::string& path, const std::string& directory) { return TextureRegistry::shared().load(directory + '/' + path); };
+        MeshCacheTimings cityTimings, carTimings, barrelTimings;
+        MeshCache::load<Model>(modelPaths[0], city, cityBounds, loadTexture, cityTimings, useMeshCache);
+        MeshCache::load<Model>(modelPaths[1], car, carBounds, loadTexture, carTimings, useMeshCache);
+        MeshCache::load<Model>(modelPaths[2], barrel, barrelBounds, loadTexture, barrelTimings, useMeshCache);
+        loadCityBvh(modelPaths[0], useMeshCache, cityBvh, &jobs);
+        loadCityOccluders(modelPaths[0], useMeshCache, cityOccluders);
+        cityTimings.print("city");
+        carTimings.print("car");
+        barrelTimings.print("barrel");
+        std::printf("%s start: models loaded in %.1f ms on the main thread\n",
+            !useMeshCache ? "uncached" : cityTimings.hit && carTimings.hit && barrelTimings.hit ? "warm" : "cold",
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+    }
+    else
+    {
+        AssetLoader loader(jobs);
+        loader.loadModel(modelPaths[0], city, cityBounds, useMeshCache);
+        loader.loadModel(modelPaths[1], car, carBounds, useMeshCache);
+        loader.loadModel(modelPaths[2], barrel, barrelBounds, useMeshCache);
+        loader.run([&]() { loadCityBvh(modelPaths[0], useMeshCache, cityBvh, &jobs); });
+        loader.run([&]() { loadCityOccluders(modelPaths[0], useMeshCache, cityOccluders); });
+        int loadingFrames = 0;
+        if (offline.active)
+            loader.finish(); // offline frames are all game frames
+        while (!loader.done() && !offline.shouldClose(window))
+        {
+            loader.update(UPLOAD_BUDGET_MS);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawLoadingBar(loader.progress(), SCR_WIDTH, SCR_HEIGHT);
+            char title[64];
+            std::snprintf(title, sizeof(title), "City Driver | loading %d%%", (int)(loader.progress() * 100.0f));
+            if (window)
+                glfwSetWindowTitle(window, title);
+            offline.present(window);
+            loadingFrames++;
+        }
+        if (!loader.done())
+        {
+            glfwTerminate();
+            return 0;
+        }
+        std::printf("models loaded in %.1f ms with %u loader threads (%u hardware threads), %d loading frames\n",
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count(),
+            loader.threadCount(), std::thread::hardware_concurrency(), loadingFrames);
+    }
     std::cout << "Models loaded successfully!" << std::endl;
+    textures.stats.print();
+
+    // The meshes are stored as 20-byte quantized vertices with the narrowest
+    // index type
+    city.stats.print("city");
+    car.stats.print("car");
+    barrel.stats.print("barrel");
+    printLevelsOfDetail("city", city);
+    printLevelsOfDetail("car", car);
+    printLevelsOfDetail("barrel", barrel);
+    ourShader.use();
+    PackedModel::bindSamplers(uniforms);
+
+    // The city never moves, so its mesh spheres are moved to world space
+    // here; the car and barrels are placed every frame.
+    const glm::mat4 cityTransform = glm::scale(glm::mat4(1.0f), CITY_SCALE);
+    std::vector<BoundingSphere> citySpheres;
+    for (const BoundingSphere& sphere : cityBounds.meshSpheres)
+        citySpheres.push_back(transformSphere(sphere, cityTransform));
+    SphereBatch cullBatch;
+    std::vector<uint32_t> visibleObjects, visibleCityMeshes;
+    CullStats cullStats;
 
-    // Setup Game Objects
-    GameObject player;
-    player.model = &carModel;
-    player.position = playerPosition;
-    player.scale = 0.1f;
-    player.collisionRadius = 1.8f;
+    // The city is also merged into one buffer and drawn with a multi-draw
+    // per material; its own meshes stay for the unbatched path
+    StaticBatch cityBatch;
+    cityBatch.build(city);
+    cityBatch.print("city");
+    unsigned long long cityFrames = 0, cityDrawTotal = 0;
+    double citySubmitTotal = 0.0;
 
-    // Lowered the Y-position for all barrels to the new ground level
-    obstacles.push_back({ glm::vec3(10.0f, -2.0f, -10.0f), 0.01f, 1.0f, &barrelModel });
-    obstacles.push_back({ glm::vec3(-5.0f, -2.0f, 20.0f), 0.01f, 1.0f, &barrelModel });
-    obstacles.push_back({ glm::vec3(10.0f, -2.0f, 15.0f), 0.01f, 1.0f, &barrelModel });
-    obstacles.push_back({ glm::vec3(-5.0f, -2.0f, -10.0f), 0.01f, 1.0f, &barrelModel });
-    obstacles.push_back({ glm::vec3(0.0f, -2.0f, 28.0f), 0.01f, 1.0f, &barrelModel });
+    // Every city, car and barrel mesh keeps the level it was drawn at, for
+    // the selector's hysteresis; the car and barrels keep theirs in their
+    // Renderable
+    LodSelector lodSelector;
+    std::vector<uint8_t> cityLevels(city.meshes.size(), 0);
+    unsigned long long triangleTotal = 0, fullTriangleTotal = 0;
+    double frameTotal = 0.0;
+
+    // Draws are sorted and issued with redundant binds removed
+    RenderQueue queue;
+
+    // Game state: the player's car, the barrels and the chase camera are
+    // entities of one World, stored by archetype (ecs.h)
+    World game;
+    Entity player = createCar(game, PLAYER_START, &car, carBounds.sphere);
+    for (const glm::vec3& position : BARREL_POSITIONS)
+    {
+        Renderable renderable;
+        renderable.model = &barrel;
+        renderable.bounds = barrelBounds.sphere;
+        renderable.scale = 0.01f;
+        renderable.local = glm::scale(glm::mat4(1.0f), glm::vec3(renderable.scale));
+        renderable.levels.assign(barrel.meshes.size(), 0);
+        game.create(Transform{ position, 0.0f }, Obstacle{ 1.0f }, std::move(renderable));
+    }
+    CameraRig rig;
+    rig.target = player;
+    rig.lookOffset = glm::vec3(0.0f, 0.2f, 0.0f);
+    Entity cameraRig = game.create(rig);
+
+    // Obstacles never move, so they go into the collision grid once. The car
+    // is swept along its motion each step, so it cannot jump over a barrel;
+    // touching one is reported once per crash.
+    std::vector<CollisionSphere> obstacleSpheres;
+    game.each<Transform, Obstacle>([&](Entity, const Transform& transform, const Obstacle& obstacle) {
+        obstacleSpheres.push_back({ transform.position, obstacle.radius });
+    });
+    SpatialHash obstacleGrid;
+    obstacleGrid.build(obstacleSpheres, 4.0f);
+    unsigned int crashes = 0;
+    EventLog events;     // crash lines, written out on its own thread
+
+    // The car steps at SIM_STEP whatever the frame rate; frames draw it
+    // between the last two steps
+    CarWorld carWorld;
+    carWorld.obstacles = &obstacleGrid;
+    carWorld.city = &cityBvh;
+    FixedTimestep simClock(SIM_STEP, MAX_SIM_STEPS_PER_FRAME);
+
+    // Systems run on the job scheduler, one job per chunk: movement and
+    // collision once per step, then interpolation, with the camera and
+    // render extraction side by side, once per frame. GL calls stay on this
+    // thread.
+    float alpha = 0.0f;
+    SystemGraph simulation, presentation;
+    simulation.add(movementSystem(SIM_STEP));
+    simulation.add(collisionSystem(carWorld));
+    presentation.add(interpolationSystem(alpha));
+    presentation.add(cameraFollowSystem(game));
+    presentation.add(renderExtractionSystem());
+    simulation.print("simulation");
+    presentation.print("presentation");
+    std::vector<Renderable*> drawables;
+
+    // Hidden city meshes, cars and barrels are dropped before submission by
+    // a masked software occlusion buffer (occlusion.h), drawn on the jobs
+    MaskedOcclusionBuffer occlusion;
+    occlusion.resize(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    unsigned long long occlusionFrames = 0, occlusionTested = 0, occlusionCulled = 0;
+    double occlusionMilliseconds = 0.0;
+
+    float lastTitleUpdate = 0.0f;
 
     // Render loop
-    while (!glfwWindowShouldClose(window))
+    while (!offline.shouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        auto frameStart = std::chrono::steady_clock::now();
+        float currentFrame = offline.time();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
+        if (window)
+            processInput(window);
 
         // Update Player State
-        if (playerSpeed > 0) playerSpeed -= FRICTION * deltaTime;
-        else if (playerSpeed < 0) playerSpeed += FRICTION * deltaTime;
-        if (playerSpeed > MAX_SPEED) playerSpeed = MAX_SPEED;
-        if (playerSpeed < -MAX_SPEED / 2.0f) playerSpeed = -MAX_SPEED / 2.0f;
-        glm::vec3 front;
-        front.x = cos(glm::radians(playerYaw));
-        front.y = 0.0f;
-        front.z = sin(glm::radians(playerYaw));
-        playerFront = glm::normalize(front);
-        playerPosition += playerFront * playerSpeed * deltaTime;
-        player.position = playerPosition;
-
-        // Simple Floor Collision
-        float groundLevel = -1.0f; // Matched to the new ground level
-        if (playerPosition.y < groundLevel)
-        {
-            playerPosition.y = groundLevel;
-            player.position.y = groundLevel;
+        int steps = simClock.advance(deltaTime);
+        CarBody* playerBody = game.get<CarBody>(player);
+        for (int step = 0; step < steps; step++)
+        {
+            playerBody->input = scriptedDrive ? scriptedInput((double)(simClock.total - steps + step) * SIM_STEP) : playerInput;
+            simulation.run(game, jobs);
+            for (unsigned int c = 0; c < playerBody->newCrashes; c++)
+                events.log(crashLog, crashes + c + 1);
+            crashes += playerBody->newCrashes;
         }
 
         // ====================== Update Camera (CLOSER) ======================
-        glm::vec3 cameraTarget = playerPosition + playerModelOffset;
-        glm::vec3 cameraPos = cameraTarget - playerFront * 8.0f + glm::vec3(0.0, 4.0, 0.0);
-        camera.Position = cameraPos;
-        camera.Front = glm::normalize(cameraTarget - cameraPos);
-
-        // Collision Detection & Response
-        for (auto& obstacle : obstacles)
-        {
-            if (checkCollision(player, obstacle))
-            {
-                std::cout << "CRASH! You hit a barrel." << std::endl;
-                playerPosition -= playerFront * 0.2f;
-                player.position = playerPosition;
-                playerSpeed = 0.0f;
-            }
-        }
+        // along with the poses and model matrices to draw
+        alpha = simClock.alpha();
+        presentation.run(game, jobs);
+        const CameraRig* chase = game.get<CameraRig>(cameraRig);
+        camera.Position = chase->position;
+        camera.Front = chase->front;
 
         // Render
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         ourShader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
+        const float nearPlane = 0.1f, farPlane = 200.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, nearPlane, farPlane);
         glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
+        uProjection.set(projection);
+        uView.set(view);
+        lodSelector.setProjection(glm::radians(camera.Zoom), (float)SCR_HEIGHT);
+
+        // Frustum culling: one sphere per city mesh, then one per entity
+        // drawn, tested in one batch
+        drawables.clear();
+        game.each<Renderable>([&](Entity, Renderable& renderable) { drawables.push_back(&renderable); });
+        cullStats.begin();
+        cullBatch.clear();
+        for (const BoundingSphere& sphere : citySpheres)
+            cullBatch.add(sphere);
+        for (const Renderable* drawable : drawables)
+            cullBatch.add(drawable->sphere);
+        visibleObjects.clear();
+        if (frustumCulling)
+            cullSpheres(Frustum(projection * view), cullBatch, visibleObjects);
+        else
+            for (uint32_t i = 0; i < cullBatch.size(); i++)
+                visibleObjects.push_back(i);
+        cullStats.end(cullBatch.size(), visibleObjects.size());
 
-        // Render the city
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(0.02f, 0.02f, 0.02f));
-        ourShader.setMat4("model", model);
-        cityModel.Draw(ourShader);
+        // Occlusion culling: the nearest visible city meshes are drawn as
+        // occluders into the CPU depth buffer, then everything left is
+        // tested against it
+        const uint32_t firstDrawable = (uint32_t)citySpheres.size();
+        if (occlusionCulling)
+        {
+            occlusion.begin(projection * view, nearPlane);
+            drawCityOccluders(occlusion, cityOccluders, visibleObjects, camera.Position, jobs);
+            occlusion.cull(cullBatch, visibleObjects);
+            occlusionFrames++;
+            occlusionTested += occlusion.stats.tested;
+            occlusionCulled += occlusion.stats.occluded;
+            occlusionMilliseconds += (occlusion.stats.renderMicroseconds + occlusion.stats.testMicroseconds) / 1000.0;
+        }
 
-        // Render the player (car)
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, playerPosition + playerModelOffset);
-        model = glm::rotate(model, glm::radians(-playerYaw + 90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(player.scale));
-        ourShader.setMat4("model", model);
-        carModel.Draw(ourShader);
+        // Levels of detail: each visible mesh takes the coarsest level whose
+        // error covers under a pixel at its object's distance
+        unsigned int triangles = 0, fullTriangles = 0;
+        auto chooseLevel = [&](const PackedMesh& mesh, uint8_t& level, const BoundingSphere& sphere, float scale) {
+            float distance = glm::length(sphere.center - camera.Position);
+            level = levelsOfDetail ? (uint8_t)lodSelector.select(mesh, level, lodSelector.pixelsPerUnit(distance, sphere.radius, scale)) : 0;
+            triangles += mesh.levelIndexCount(level) / 3;
+            fullTriangles += mesh.indexCount / 3;
+            return (int)level;
+        };
+
+        // Submit the city, batched or through the queue, timed on its own
+        auto cityStart = std::chrono::steady_clock::now();
+        unsigned int cityDraws = 0;
+        visibleCityMeshes.clear();
+        for (uint32_t index : visibleObjects)
+            if (index < firstDrawable)
+            {
+                visibleCityMeshes.push_back(index);
+                chooseLevel(city.meshes[index], cityLevels[index], citySpheres[index], CITY_SCALE.x);
+            }
+        if (staticBatching)
+        {
+            cityBatch.draw(visibleCityMeshes, cityLevels.data(), cityTransform, meshUniforms.model, meshUniforms.positionOffset, meshUniforms.positionScale);
+            cityDraws = cityBatch.stats.drawCalls;
+        }
+        else
+        {
+            for (uint32_t index : visibleCityMeshes)
+                submitMesh(queue, ourShader.ID, meshUniforms, city.meshes[index], cityLevels[index], cityTransform, view, farPlane);
+            queue.flush();
+            cityDraws = queue.stats.drawCalls;
+        }
+        double citySubmit = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cityStart).count();
+        cityFrames++;
+        cityDrawTotal += cityDraws;
+        citySubmitTotal += citySubmit;
 
-        // Render the obstacles (barrels)
-        for (const auto& obstacle : obstacles)
+        // then the player (car) and the obstacles (barrels); the queue
+        // decides their order
+        for (uint32_t index : visibleObjects)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, obstacle.position);
-            model = glm::scale(model, glm::vec3(obstacle.scale));
-            ourShader.setMat4("model", model);
-            obstacle.model->Draw(ourShader);
+            if (index < firstDrawable)
+                continue;
+            Renderable& drawable = *drawables[index - firstDrawable];
+            const std::vector<PackedMesh>& meshes = drawable.model->meshes;
+            for (size_t m = 0; m < meshes.size(); m++)
+                submitMesh(queue, ourShader.ID, meshUniforms, meshes[m], chooseLevel(meshes[m], drawable.levels[m], drawable.sphere, drawable.scale),
+                           drawable.matrix, view, farPlane);
         }
+        queue.flush();
+        queue.endFrame();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        offline.present(window);
+        triangleTotal += triangles;
+        fullTriangleTotal += fullTriangles;
+        frameTotal += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+        if (window && currentFrame - lastTitleUpdate > 1.0f)
+        {
+            const RenderQueueStats& q = queue.lastFrame;
+            char title[448];
+            std::snprintf(title, sizeof(title), "City Driver | %zu/%zu objects visible, %.1f us culling%s | %u occluded, %.2f ms%s | city %u draws, %.0f us submit%s | %u/%u triangles%s | %u draws, %u state changes (%u unsorted), %u textures, %u VAOs | %u crashes",
+                cullStats.visible, cullStats.submitted, cullStats.microseconds, frustumCulling ? "" : " (off)",
+                occlusionCulling ? occlusion.stats.occluded : 0u, occlusionCulling ? (occlusion.stats.renderMicroseconds + occlusion.stats.testMicroseconds) / 1000.0 : 0.0,
+                occlusionCulling ? "" : " (off)",
+                cityDraws, citySubmit, staticBatching ? " (batched)" : "",
+                triangles, fullTriangles, levelsOfDetail ? " (LOD)" : "",
+                q.drawCalls, q.stateChanges(), q.unsortedBinds, q.textureBinds, q.vaoBinds, crashes);
+            glfwSetWindowTitle(window, title);
+            lastTitleUpdate = currentFrame;
+        }
     }
 
+    events.flush();
+    if (cityFrames > 0)
+        std::printf("city: %.1f draws, %.1f us CPU submit per frame over %llu frames (%s)\n",
+            (double)cityDrawTotal / cityFrames, citySubmitTotal / cityFrames, cityFrames,
+            staticBatching ? "static batch" : "mesh by mesh");
+    if (cityFrames > 0)
+        std::printf("%.0f of %.0f triangles per frame (%.0f%%), %.2f ms per frame over %llu frames (levels of detail %s)\n",
+            (double)triangleTotal / cityFrames, (double)fullTriangleTotal / cityFrames,
+            fullTriangleTotal ? 100.0 * triangleTotal / fullTriangleTotal : 100.0, frameTotal / cityFrames, cityFrames,
+            levelsOfDetail ? "on" : "off");
+    if (occlusionFrames > 0)
+        std::printf("occlusion: %.1f of %.1f objects per frame culled (%.1f%%), %.3f ms per frame over %llu frames\n",
+            (double)occlusionCulled / occlusionFrames, (double)occlusionTested / occlusionFrames,
+            occlusionTested ? 100.0 * occlusionCulled / occlusionTested : 0.0, occlusionMilliseconds / occlusionFrames, occlusionFrames);
+    offline.finish();
+    cityBatch.destroy();
+    city.destroy();
+    car.destroy();
+    barrel.destroy();
+    textures.clear();
     glfwTerminate();
     return 0;
 }
@@ -196,18 +633,848 @@ void processInput(GLFWwindow* window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+    playerInput = CarInput();
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        playerSpeed += PLAYER_ACCELERATION * deltaTime;
+        playerInput.throttle += 1.0f;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        playerSpeed -= PLAYER_ACCELERATION * deltaTime;
-    if (abs(playerSpeed) > 0.1f)
-    {
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            playerYaw += PLAYER_TURN_SPEED * deltaTime;
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            playerYaw -= PLAYER_TURN_SPEED * deltaTime;
-    }
+        playerInput.throttle -= 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        playerInput.steer += 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        playerInput.steer -= 1.0f;
+
+    bool cullKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cullKey && !cullKeyDown)
+        frustumCulling = !frustumCulling;
+    cullKeyDown = cullKey;
+
+    bool batchKey = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+    if (batchKey && !batchKeyDown)
+        staticBatching = !staticBatching;
+    batchKeyDown = batchKey;
+
+    bool lodKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (lodKey && !lodKeyDown)
+        levelsOfDetail = !levelsOfDetail;
+    lodKeyDown = lodKey;
+
+    bool occlusionKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (occlusionKey && !occlusionKeyDown)
+        occlusionCulling = !occlusionCulling;
+    occlusionKeyDown = occlusionKey;
 }
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) { glViewport(0, 0, width, height); }
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {}
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) { camera.ProcessMouseScroll(static_cast<float>(yoffset)); }
\ No newline at end of file
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) { camera.ProcessMouseScroll(static_cast<float>(yoffset)); }
+
+// Loads the three models on the main thread, then through the asset loader
+// with 1, 2, 4, ... worker threads up to the core count, best of three runs
+// each. A first untimed load cooks missing caches and warms the OS file
+// cache, so every row reads the same bytes from memory.
+void runLoadBenchmark(const std::string* modelPaths, bool useMeshCache)
+{
+    auto load = [&](unsigned int threads) {
+        auto start = std::chrono::steady_clock::now();
+        PackedModel models[3];
+        ModelBounds bounds[3];
+        if (threads == 0)
+        {
+            auto loadTexture = [](const std::string& path, const std::string& directory) { return TextureRegistry::shared().load(directory + '/' + path); };
+            MeshCacheTimings timings;
+            for (int i = 0; i < 3; i++)
+                MeshCache::load<Model>(modelPaths[i], models[i], bounds[i], loadTexture, timings, useMeshCache);
+        }
+        else
+        {
+            JobScheduler loadJobs(threads + 1);
+            AssetLoader loader(loadJobs);
+            for (int i = 0; i < 3; i++)
+                loader.loadModel(modelPaths[i], models[i], bounds[i], useMeshCache);
+            loader.finish();
+        }
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (PackedModel& model : models)
+            model.destroy();
+        TextureRegistry::shared().clear();
+        return ms;
+    };
+
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("load benchmark: %u hardware threads, mesh cache %s\n", hardware, useMeshCache ? "on" : "off");
+    load(0);
+    std::vector<unsigned int> threadCounts(1, 0);
+    for (unsigned int threads = 1; threads < hardware; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardware);
+    double serial = 0.0;
+    for (unsigned int threads : threadCounts)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; run++)
+            best = std::min(best, load(threads));
+        if (threads == 0)
+        {
+            serial = best;
+            std::printf("  main thread      %8.1f ms\n", best);
+        }
+        else
+            std::printf("  %2u loader threads %8.1f ms  %.2fx\n", threads, best, serial / best);
+    }
+}
+
+// Swept queries of the car against growing fields of barrels, at the same
+// density, through the grid and through a scan of every barrel. Both must
+// agree; the scan is only run on as many queries as stay affordable.
+void runCollisionBenchmark()
+{
+    const int QUERIES = 200000;
+    const float SPACING = 4.0f; // one barrel per 4x4 m on average
+    const float CAR_RADIUS = 1.8f;
+    std::printf("collision benchmark: %d swept queries per count, %.0f m/s over a 30 fps frame\n", QUERIES, MAX_SPEED);
+    for (size_t count = 1000; count <= 1000000; count *= 10)
+    {
+        std::mt19937 rng(1234);
+        float side = SPACING * std::sqrt((float)count);
+        std::uniform_real_distribution<float> along(-side / 2.0f, side / 2.0f), radius(0.5f, 1.0f), angle(0.0f, 6.2831853f);
+        std::vector<CollisionSphere> spheres(count);
+        for (CollisionSphere& s : spheres)
+            s = { glm::vec3(along(rng), -2.0f, along(rng)), radius(rng) };
+        std::vector<glm::vec3> starts(QUERIES), motions(QUERIES);
+        for (int i = 0; i < QUERIES; i++)
+        {
+            float a = angle(rng);
+            starts[i] = glm::vec3(along(rng), -1.0f, along(rng));
+            motions[i] = glm::vec3(std::cos(a), 0.0f, std::sin(a)) * MAX_SPEED / 30.0f;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        SpatialHash grid;
+        grid.build(spheres, 4.0f);
+        double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<SweepHit> hits(QUERIES);
+        std::vector<char> found(QUERIES);
+        uint64_t candidates = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < QUERIES; i++)
+        {
+            found[i] = grid.sweep(starts[i], CAR_RADIUS, motions[i], hits[i]);
+            candidates += hits[i].candidates;
+        }
+        double gridSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        int scanned = (int)std::min<size_t>(QUERIES, std::max<size_t>(100, 200000000 / count));
+        int mismatches = 0, hitCount = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < scanned; i++)
+        {
+            SweepHit hit;
+            bool scanFound = sweepSpheres(spheres, starts[i], CAR_RADIUS, motions[i], hit);
+            if (scanFound != (bool)found[i] || (scanFound && (hit.id != hits[i].id || hit.t != hits[i].t)))
+                mismatches++;
+        }
+        double scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (char f : found)
+            hitCount += f;
+
+        std::printf("  %8zu barrels: build %7.1f ms, %6zu cells | grid %7.2f M queries/s, %.1f candidates, %4.1f%% hit | scan %8.4f M queries/s | %d mismatches\n",
+            count, buildMs, grid.cellCount(), QUERIES / gridSeconds / 1e6, (double)candidates / QUERIES,
+            100.0 * hitCount / QUERIES, scanned / scanSeconds / 1e6, mismatches);
+    }
+}
+
+// ---- city collision ---------------------------------------------------------
+
+// World-space positions of one cached city mesh, the quantized ones that
+// are drawn, and the indices of its full detail; indices out of range are
+// dropped with their triangle
+void readCachedCityMesh(const CachedModel& cached, size_t m, std::vector<glm::vec3>& positions, std::vector<uint32_t>& triangles)
+{
+    EncodedMesh layout = cached.layout(m);
+    positions.resize(layout.vertexCount);
+    for (size_t i = 0; i < layout.vertexCount; i++)
+    {
+        PackedVertex v;
+        std::memcpy(&v, cached.vertices(m) + i * sizeof(PackedVertex), sizeof(v));
+        glm::vec3 q = glm::max(glm::vec3(v.position[0], v.position[1], v.position[2]) / 32767.0f, glm::vec3(-1.0f));
+        positions[i] = (q * layout.positionScale + layout.positionOffset) * CITY_SCALE;
+    }
+    const uint8_t* indices = cached.indices(m);
+    auto index = [&](size_t i) -> uint32_t {
+        if (layout.indexType == GL_UNSIGNED_BYTE)
+            return indices[i];
+        if (layout.indexType == GL_UNSIGNED_SHORT)
+        {
+            uint16_t value;
+            std::memcpy(&value, indices + i * 2, 2);
+            return value;
+        }
+        uint32_t value;
+        std::memcpy(&value, indices + i * 4, 4);
+        return value;
+    };
+    triangles.clear();
+    for (size_t i = 0; i + 2 < (size_t)layout.indexCount; i += 3)
+    {
+        uint32_t a = index(i), b = index(i + 1), c = index(i + 2);
+        if (a < positions.size() && b < positions.size() && c < positions.size())
+            triangles.insert(triangles.end(), { a, b, c });
+    }
+}
+
+// World-space triangles of the city: the quantized positions that are drawn,
+// from the mesh cache when it is valid, otherwise the Assimp import. None if
+// the import fails, so no BVH is built or saved from it.
+std::vector<BvhTriangle> cityTriangles(const std::string& path, bool useMeshCache)
+{
+    std::vector<BvhTriangle> triangles;
+    CachedModel cached;
+    if (useMeshCache && cached.open(path + ".meshcache", hashModelSources(path)))
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        for (size_t m = 0; m < cached.records.size(); m++)
+        {
+            readCachedCityMesh(cached, m, positions, indices);
+            for (size_t i = 0; i < indices.size(); i += 3)
+                triangles.push_back({ positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]] });
+        }
+        return triangles;
+    }
+    ImportedModel model;
+    if (!importModel(path, model))
+    {
+        std::cout << "CITY::IMPORT_FAILED: " << path << std::endl;
+        return triangles;
+    }
+    for (const ImportedMesh& mesh : model.meshes)
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+            triangles.push_back({ mesh.vertices[mesh.indices[i]].Position * CITY_SCALE, mesh.vertices[mesh.indices[i + 1]].Position * CITY_SCALE,
+                                  mesh.vertices[mesh.indices[i + 2]].Position * CITY_SCALE });
+    return triangles;
+}
+
+// Occluders of the city, one per mesh in the order of the model's meshes:
+// the mesh at full detail, since a simplified level can reach past its
+// outline and hide what is visible. From the mesh cache when it is valid,
+// otherwise the Assimp import. Meshes smaller than OCCLUDER_MIN_RADIUS hide
+// little and only get their bounds. Safe to run on a loader thread.
+void loadCityOccluders(const std::string& path, bool useMeshCache, std::vector<CityOccluder>& occluders)
+{
+    auto start = std::chrono::steady_clock::now();
+    occluders.clear();
+    auto finish = [&](CityOccluder& occluder) {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const glm::vec3& p : occluder.vertices)
+        {
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        occluder.sphere = { (lo + hi) * 0.5f, glm::length(hi - lo) * 0.5f };
+        if (occluder.vertices.empty() || occluder.sphere.radius < OCCLUDER_MIN_RADIUS)
+        {
+            occluder.vertices.clear();
+            occluder.indices.clear();
+        }
+    };
+    CachedModel cached;
+    if (useMeshCache && cached.open(path + ".meshcache", hashModelSources(path)))
+    {
+        occluders.resize(cached.records.size());
+        for (size_t m = 0; m < cached.records.size(); m++)
+        {
+            readCachedCityMesh(cached, m, occluders[m].vertices, occluders[m].indices);
+            finish(occluders[m]);
+        }
+    }
+    else
+    {
+        ImportedModel model;
+        if (!importModel(path, model))
+        {
+            std::cout << "CITY_OCCLUDERS::IMPORT_FAILED: " << path << std::endl;
+            return;
+        }
+        occluders.resize(model.meshes.size());
+        for (size_t m = 0; m < model.meshes.size(); m++)
+        {
+            for (const ImportedVertex& vertex : model.meshes[m].vertices)
+                occluders[m].vertices.push_back(vertex.Position * CITY_SCALE);
+            occluders[m].indices.assign(model.meshes[m].indices.begin(), model.meshes[m].indices.end());
+            finish(occluders[m]);
+        }
+    }
+    size_t meshes = 0, triangles = 0;
+    for (const CityOccluder& occluder : occluders)
+    {
+        meshes += !occluder.indices.empty();
+        triangles += occluder.indices.size() / 3;
+    }
+    std::printf("city occluders: %zu of %zu meshes, %zu triangles, read in %.1f ms\n", meshes, occluders.size(), triangles,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Draws the occluders among the visible city meshes (indices past the
+// occluders are ignored), nearest first up to OCCLUDER_TRIANGLE_BUDGET
+void drawCityOccluders(MaskedOcclusionBuffer& occlusion, const std::vector<CityOccluder>& occluders, const std::vector<uint32_t>& visible,
+                       const glm::vec3& eye, JobScheduler& jobs)
+{
+    std::vector<std::pair<float, uint32_t>> order;  // distance, mesh
+    for (uint32_t index : visible)
+        if (index < occluders.size() && !occluders[index].indices.empty())
+            order.push_back({ glm::length(occluders[index].sphere.center - eye) - occluders[index].sphere.radius, index });
+    std::sort(order.begin(), order.end());
+    for (const auto& entry : order)
+    {
+        const CityOccluder& occluder = occluders[entry.second];
+        if (occlusion.stats.occluderTriangles + occluder.indices.size() / 3 > OCCLUDER_TRIANGLE_BUDGET)
+            break;
+        occlusion.addOccluder(occluder.vertices.data(), occluder.vertices.size(), occluder.indices.data(), occluder.indices.size() / 3);
+    }
+    occlusion.render(&jobs);
+}
+
+// The city's collision BVH. It is kept next to the mesh cache as
+// <city>.obj.bvh, keyed by the sources and the city scale, so it is only
+// built when they change, across jobs if given. Safe to run as a loader job.
+void loadCityBvh(const std::string& path, bool useMeshCache, TriangleBvh& bvh, JobScheduler* jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t key = 0;
+    if (useMeshCache)
+    {
+        key = hashBytes((const uint8_t*)&CITY_SCALE[0], sizeof(CITY_SCALE), hashModelSources(path));
+        if (bvh.load(path + ".bvh", key))
+        {
+            std::printf("city BVH: %zu triangles, %zu nodes, loaded in %.1f ms\n", bvh.triangles.size(), bvh.nodes.size(),
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            return;
+        }
+    }
+    std::vector<BvhTriangle> triangles = cityTriangles(path, useMeshCache);
+    double readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    bvh.build(triangles, jobs);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() - readMs;
+    if (useMeshCache && !bvh.empty())
+        bvh.save(path + ".bvh", key);
+    std::printf("city BVH: %zu triangles, %zu nodes, read in %.1f ms, built in %.1f ms\n", bvh.triangles.size(), bvh.nodes.size(), readMs, buildMs);
+}
+
+// Build time with one thread and with all of them, then the car's queries
+// against the city: ground rays, rays in any direction and wall sweeps,
+// checked against testing every triangle
+void runBvhBenchmark(const std::string& cityPath)
+{
+    std::vector<BvhTriangle> triangles = cityTriangles(cityPath, true);
+    if (triangles.empty())
+    {
+        std::cout << "BVH_BENCH::NO_TRIANGLES: " << cityPath << std::endl;
+        return;
+    }
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("BVH benchmark: %zu city triangles, %u hardware threads\n", triangles.size(), hardware);
+    TriangleBvh bvh;
+    for (unsigned int threads : { 1u, hardware })
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            JobScheduler jobs(threads);
+            bvh.build(triangles, &jobs);
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::printf("  build, %2u threads  %8.1f ms, %zu nodes\n", threads, best, bvh.nodes.size());
+        if (hardware == 1)
+            break;
+    }
+
+    glm::vec3 lo = glm::vec3(FLT_MAX), hi = glm::vec3(-FLT_MAX);
+    for (const BvhTriangle& t : triangles)
+    {
+        lo = glm::min(lo, glm::min(t.v0, glm::min(t.v1, t.v2)));
+        hi = glm::max(hi, glm::max(t.v0, glm::max(t.v1, t.v2)));
+    }
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> ux(lo.x, hi.x), uy(lo.y, hi.y), uz(lo.z, hi.z), unit(-1.0f, 1.0f);
+    auto direction = [&]() {
+        glm::vec3 d;
+        do d = glm::vec3(unit(rng), unit(rng), unit(rng));
+        while (glm::dot(d, d) > 1.0f || glm::dot(d, d) < 1e-4f);
+        return glm::normalize(d);
+    };
+    const int QUERIES = 200000, CHECKED = 200;
+    float reach = glm::length(hi - lo);
+    for (int kind = 0; kind < 3; kind++)
+    {
+        std::vector<glm::vec3> origins(QUERIES), dirs(QUERIES);
+        for (int i = 0; i < QUERIES; i++)
+        {
+            origins[i] = glm::vec3(ux(rng), kind == 0 ? hi.y + 1.0f : uy(rng), uz(rng));
+            dirs[i] = kind == 0 ? glm::vec3(0.0f, -1.0f, 0.0f) : direction();
+            if (kind == 2)
+                dirs[i] = glm::normalize(glm::vec3(dirs[i].x, 0.0f, dirs[i].z + 1e-3f)) * MAX_SPEED / 60.0f;
+        }
+        std::vector<float> found(QUERIES);
+        int hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < QUERIES; i++)
+        {
+            if (kind < 2)
+            {
+                BvhRayHit hit;
+                found[i] = bvh.raycast(origins[i], dirs[i], reach, hit) ? hit.t : -1.0f;
+            }
+            else
+            {
+                BvhSweepHit hit;
+                found[i] = bvh.sweep(origins[i], WALL_PROBE_RADIUS, dirs[i], hit, WALKABLE_NORMAL_Y) ? hit.t : -1.0f;
+            }
+            hits += found[i] >= 0.0f;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        int mismatches = 0;
+        for (int i = 0; i < CHECKED; i++)
+        {
+            float best = -1.0f;
+            for (const BvhTriangle& tri : bvh.triangles)
+            {
+                if (kind < 2)
+                {
+                    float t;
+                    if (rayTriangle(origins[i], dirs[i], tri, best < 0.0f ? reach : best, t))
+                        best = t;
+                    continue;
+                }
+                glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+                BvhSweepHit hit;
+                if (n.y * n.y <= WALKABLE_NORMAL_Y * WALKABLE_NORMAL_Y * glm::dot(n, n) &&
+                    sweepSphereTriangle(origins[i], WALL_PROBE_RADIUS, dirs[i], tri, best < 0.0f ? 1.0f : best, hit))
+                    best = hit.t;
+            }
+            if ((best < 0.0f) != (found[i] < 0.0f) || std::fabs(best - found[i]) > 1e-4f)
+                mismatches++;
+        }
+        const char* names[3] = { "ground rays", "random rays", "wall sweeps" };
+        std::printf("  %-12s %8.2f M queries/s, %4.1f%% hit, %d/%d mismatches against all triangles\n",
+            names[kind], QUERIES / seconds / 1e6, 100.0 * hits / QUERIES, mismatches, CHECKED);
+    }
+}
+
+// ---- headless drive ---------------------------------------------------------
+
+// The game's world without GL: the city BVH, from its cache when possible,
+// and the barrels
+CarWorld loadHeadlessWorld(TriangleBvh& cityBvh, SpatialHash& obstacleGrid)
+{
+    JobScheduler jobs;
+    loadCityBvh(FileSystem::getPath("resources/objects/City/city.obj"), true, cityBvh, &jobs);
+    std::vector<CollisionSphere> spheres;
+    for (const glm::vec3& position : BARREL_POSITIONS)
+        spheres.push_back({ position, 1.0f });
+    obstacleGrid.build(spheres, 4.0f);
+    CarWorld world;
+    world.obstacles = &obstacleGrid;
+    world.city = cityBvh.empty() ? nullptr : &cityBvh;
+    return world;
+}
+
+// The --drive script, a function of simulation time only: full throttle
+// with a right and a left turn, then braking into reverse, every 10 seconds
+CarInput scriptedInput(double t)
+{
+    double phase = std::fmod(t, 10.0);
+    CarInput input;
+    input.throttle = phase < 7.0 ? 1.0f : -1.0f;
+    input.steer = phase >= 2.0 && phase < 4.0 ? 1.0f : phase >= 5.0 && phase < 6.0 ? -1.0f : 0.0f;
+    return input;
+}
+
+// Drives the scripted car through the city and the barrels for the given
+// simulated time without a window, as fast as it goes. Then the frame clock
+// is fed the same wall time as irregular frames of 1 to 50 ms, with a 1 s
+// hitch every 10 s, and each frame is checked against the stepped drive: no
+// frame runs more than MAX_SIM_STEPS_PER_FRAME steps, the steps run, the
+// time dropped and the remainder add up to the frames' time, the drawn pose
+// is the stepped trajectory interpolated at the clock's time, and only the
+// hitches drop time, as much as the guard allows. The output (crashes,
+// final pose, a hash of every step) only depends on the build and the
+// assets, so it can be compared across runs as a regression test; the exit
+// code is 1 if a check fails.
+int runHeadlessDrive(float seconds)
+{
+    TriangleBvh cityBvh;
+    SpatialHash obstacleGrid;
+    CarWorld world = loadHeadlessWorld(cityBvh, obstacleGrid);
+    const unsigned long long totalSteps = (unsigned long long)std::llround(seconds / SIM_STEP);
+
+    // step by step, keeping every state for the frames to be checked against
+    std::vector<CarState> states(1, { glm::vec3(0.0f, -2.0f, 5.0f), 180.0f, 0.0f });
+    states.reserve(totalSteps + 1);
+    unsigned int crashes = 0;
+    uint64_t hash = hashBytes(nullptr, 0);
+    ContactEvents contacts;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long n = 0; n < totalSteps; n++)
+    {
+        CarState car = states.back();
+        crashes += stepCar(car, scriptedInput(n * (double)SIM_STEP), SIM_STEP, world, contacts);
+        hash = hashBytes((const uint8_t*)&car, sizeof(CarState), hash);
+        states.push_back(car);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // through the frame clock, as the game loop runs it
+    const double HITCH = 1.0, HITCH_EVERY = 10.0;
+    FixedTimestep clock(SIM_STEP, MAX_SIM_STEPS_PER_FRAME);
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<double> frameTime(0.001, 0.050);
+    CarState previous = states[0], car = states[0];
+    ContactEvents frameContacts;
+    double wall = 0.0, nextHitch = HITCH_EVERY, minDropped = 0.0, maxDropped = 0.0;
+    unsigned long long frames = 0;
+    int hitches = 0;
+    const char* failure = nullptr;
+    while (!failure)
+    {
+        bool hitch = wall >= nextHitch;
+        double elapsed = hitch ? HITCH : frameTime(rng);
+        if (wall + elapsed > totalSteps * clock.step)
+            break;
+        if (hitch)
+        {
+            // the accumulator held less than a step, so the hitch yields
+            // floor(HITCH / step) steps or one more, and the guard drops
+            // all but MAX_SIM_STEPS_PER_FRAME of them
+            double over = std::floor(HITCH / clock.step) - MAX_SIM_STEPS_PER_FRAME;
+            minDropped += over * clock.step;
+            maxDropped += (over + 1.0) * clock.step;
+            nextHitch += HITCH_EVERY;
+            hitches++;
+        }
+        wall += elapsed;
+        frames++;
+        int steps = clock.advance(elapsed);
+        if (steps > MAX_SIM_STEPS_PER_FRAME || clock.total > totalSteps)
+        {
+            failure = "a frame ran more steps than the guard allows";
+            break;
+        }
+        for (unsigned long long n = clock.total - steps; n < clock.total; n++)
+        {
+            previous = car;
+            stepCar(car, scriptedInput(n * (double)SIM_STEP), SIM_STEP, world, frameContacts);
+        }
+        CarState shown = interpolate(previous, car, clock.alpha());
+        CarState expected = clock.total > 0 ? interpolate(states[clock.total - 1], states[clock.total], clock.alpha()) : states[0];
+        if (std::fabs(((double)clock.total + clock.alpha()) * clock.step + clock.dropped - wall) > 1e-6)
+            failure = "the clock lost or gained time";
+        else if (std::memcmp(&car, &states[clock.total], sizeof(CarState)) != 0)
+            failure = "the steps left the stepped trajectory";
+        else if (clock.total > 0 && std::memcmp(&shown, &expected, sizeof(CarState)) != 0)
+            failure = "the drawn pose is not the stepped trajectory at the clock's time";
+    }
+    if (!failure && (clock.dropped < minDropped - 1e-6 || clock.dropped > maxDropped + 1e-6))
+        failure = "the time dropped does not match the hitches";
+
+    std::printf("drive: %.1f s simulated in %.1f ms (%.0fx real time), %llu steps of %.2f ms, city %s\n",
+        totalSteps * SIM_STEP, ms, totalSteps * SIM_STEP * 1000.0 / std::max(ms, 1e-3), totalSteps,
+        SIM_STEP * 1000.0f, world.city ? "loaded" : "missing (flat ground)");
+    std::printf("  %u crashes, final position (%.3f, %.3f, %.3f), yaw %.2f, speed %.3f, trajectory %016llx\n",
+        crashes, states.back().position.x, states.back().position.y, states.back().position.z, states.back().yaw,
+        states.back().speed, (unsigned long long)hash);
+    std::printf("  frame clock: %llu frames, %d hitches of %.0f s, %.3f s dropped, %llu steps: %s\n", frames, hitches, HITCH,
+        clock.dropped, clock.total, failure ? failure : "ok");
+    return failure ? 1 : 0;
+}
+
+// ---- batch simulation ---------------------------------------------------------
+
+// Simulated seconds of driving for 1k to 64k cars scattered over the city,
+// each with its own bot input (re-rolled twice a second): one car at a time
+// through stepCar(), as a CarBatch on one thread and on every thread.
+// Prints car steps per second and how far the batch ends up from the scalar
+// cars, which differ only in float rounding of the SIMD sine and cosine.
+void runBatchBenchmark()
+{
+    TriangleBvh cityBvh;
+    SpatialHash obstacleGrid;
+    CarWorld world = loadHeadlessWorld(cityBvh, obstacleGrid);
+    JobScheduler serialJobs(1), jobs;
+    const int STEPS = 120;
+    std::printf("batch benchmark: %d steps of %.2f ms, %zu SIMD lanes, %u threads\n", STEPS, SIM_STEP * 1000.0f, SIMD_LANES, jobs.threadCount());
+    for (size_t count = 1024; count <= 65536; count *= 4)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> along(-100.0f, 100.0f), angle(0.0f, 360.0f), unit(-1.0f, 1.0f);
+        std::vector<CarState> start(count);
+        for (CarState& car : start)
+            car = { glm::vec3(along(rng), -1.0f, along(rng)), angle(rng), 0.0f };
+        std::vector<CarInput> inputs(count * (STEPS / 60 + 1));
+        for (CarInput& input : inputs)
+            input = { unit(rng) * 0.5f + 0.5f, unit(rng) };
+        auto inputAt = [&](size_t car, int step) { return inputs[(size_t)(step / 60) * count + car]; };
+
+        // one car at a time
+        std::vector<CarState> scalar = start;
+        std::vector<ContactEvents> contacts(count);
+        auto begin = std::chrono::steady_clock::now();
+        for (int step = 0; step < STEPS; step++)
+            for (size_t i = 0; i < count; i++)
+                stepCar(scalar[i], inputAt(i, step), SIM_STEP, world, contacts[i]);
+        double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        double batchSeconds[2];
+        float deviation = 0.0f;
+        JobScheduler* schedulers[2] = { &serialJobs, &jobs };
+        for (int p = 0; p < 2; p++)
+        {
+            CarBatch batch;
+            for (const CarState& car : start)
+                batch.add(car);
+            double seconds = 0.0;
+            for (int step = 0; step < STEPS; step++)
+            {
+                if (step % 60 == 0)
+                    for (size_t i = 0; i < count; i++)
+                        batch.setInput(i, inputAt(i, step));
+                begin = std::chrono::steady_clock::now();
+                stepCars(*schedulers[p], batch, SIM_STEP, world);
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            }
+            batchSeconds[p] = seconds;
+            for (size_t i = 0; p == 0 && i < count; i++)
+                deviation = std::max(deviation, glm::length(batch.get(i).position - scalar[i].position));
+        }
+        double carSteps = (double)count * STEPS;
+        std::printf("  %6zu cars: scalar %7.2f M steps/s | batch, 1 thread %7.2f M steps/s (%.1fx) | %u threads %7.2f M steps/s (%.1fx) | max deviation %.2g m\n",
+            count, carSteps / scalarSeconds / 1e6, carSteps / batchSeconds[0] / 1e6, scalarSeconds / batchSeconds[0],
+            jobs.threadCount(), carSteps / batchSeconds[1] / 1e6, scalarSeconds / batchSeconds[1], deviation);
+    }
+}
+
+// ---- entity systems -----------------------------------------------------------
+
+// The game's systems over 100,000 car entities scattered over the city, each
+// holding a bot input, plus a camera following the first: frames of two
+// simulation steps and a presentation pass, on job schedulers of 1, 2, 4 ...
+// threads up to the core count. Prints time per frame, entity updates per
+// second and the speedup over one thread, and checks every run ends with the
+// same cars, as each car only reads its own state and the static world.
+void runEcsBenchmark()
+{
+    TriangleBvh cityBvh;
+    SpatialHash obstacleGrid;
+    CarWorld carWorld = loadHeadlessWorld(cityBvh, obstacleGrid);
+    const size_t CARS = 100000;
+    const int FRAMES = 10, STEPS_PER_FRAME = 2;
+    const BoundingSphere CAR_SPHERE = { glm::vec3(0.0f), 25.0f };   // in model units, like the car model's
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("ECS benchmark: %zu cars, %d frames of %d steps, %u hardware threads\n", CARS, FRAMES, STEPS_PER_FRAME, cores);
+
+    double oneThread = 0.0;
+    uint64_t reference = 0;
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, cores))
+    {
+        World game;
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> along(-100.0f, 100.0f), angle(0.0f, 360.0f), unit(-1.0f, 1.0f);
+        Entity first;
+        for (size_t i = 0; i < CARS; i++)
+        {
+            Entity car = createCar(game, { glm::vec3(along(rng), -1.0f, along(rng)), angle(rng), 0.0f }, nullptr, CAR_SPHERE);
+            game.get<CarBody>(car)->input = { unit(rng) * 0.5f + 0.5f, unit(rng) };
+            if (i == 0)
+                first = car;
+        }
+        CameraRig rig;
+        rig.target = first;
+        game.create(rig);
+
+        JobScheduler jobs(threads);
+        float alpha = 0.5f;
+        SystemGraph simulation, presentation;
+        simulation.add(movementSystem(SIM_STEP));
+        simulation.add(collisionSystem(carWorld));
+        presentation.add(interpolationSystem(alpha));
+        presentation.add(cameraFollowSystem(game));
+        presentation.add(renderExtractionSystem());
+        if (threads == 1)
+        {
+            simulation.print("simulation");
+            presentation.print("presentation");
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            for (int step = 0; step < STEPS_PER_FRAME; step++)
+                simulation.run(game, jobs);
+            presentation.run(game, jobs);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t hash = hashBytes(nullptr, 0);
+        game.each<CarBody>([&](Entity, const CarBody& body) { hash = hashBytes((const uint8_t*)&body.state, sizeof(CarState), hash); });
+        if (threads == 1)
+        {
+            oneThread = seconds;
+            reference = hash;
+        }
+        std::printf("  %2u threads: %8.1f ms per frame, %6.2f M entity updates/s, %.2fx, %llu jobs stolen, %s\n",
+            threads, seconds * 1000.0 / FRAMES, (double)CARS * FRAMES / seconds / 1e6, oneThread / seconds,
+            jobs.steals(), hash == reference ? "same cars" : "DIFFERENT cars");
+        if (threads == cores)
+            break;
+    }
+}
+
+// ---- occlusion culling --------------------------------------------------------
+
+// Occlusion culling along the --drive script without GL. For every 1/30 s
+// of a 20 s drive, the chase camera's view is frustum culled over the city
+// meshes, the nearest occluders drawn and the meshes left tested, on job
+// schedulers of 1, 2, 4 ... threads up to the core count. Prints the share
+// of meshes in the frustum that were culled and the milliseconds per frame
+// spent drawing occluders and testing.
+void runOcclusionBenchmark()
+{
+    std::vector<CityOccluder> occluders;
+    loadCityOccluders(FileSystem::getPath("resources/objects/City/city.obj"), true, occluders);
+    if (occluders.empty())
+    {
+        std::cout << "OCCLUSION_BENCH::NO_CITY" << std::endl;
+        return;
+    }
+    TriangleBvh cityBvh;
+    SpatialHash obstacleGrid;
+    CarWorld world = loadHeadlessWorld(cityBvh, obstacleGrid);
+
+    // the chase camera of every frame
+    const int FRAMES = 600, STEPS_PER_FRAME = 4;
+    std::vector<glm::vec3> eyes;
+    std::vector<glm::mat4> views;
+    CarState car = PLAYER_START;
+    ContactEvents contacts;
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        for (int step = 0; step < STEPS_PER_FRAME; step++)
+            stepCar(car, scriptedInput((double)(frame * STEPS_PER_FRAME + step) * SIM_STEP), SIM_STEP, world, contacts);
+        glm::vec3 lookAt = car.position + glm::vec3(0.0f, 0.2f, 0.0f);
+        glm::vec3 eye = lookAt - carFront(car.yaw) * 8.0f + glm::vec3(0.0f, 4.0f, 0.0f);
+        eyes.push_back(eye);
+        views.push_back(glm::lookAt(eye, lookAt, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+    const float nearPlane = 0.1f;
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, nearPlane, 200.0f);
+    SphereBatch spheres;
+    for (const CityOccluder& occluder : occluders)
+        spheres.add(occluder.sphere);
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("occlusion benchmark: %d frames, %zu city meshes, %dx%d buffer, %zu SIMD lanes, %u hardware threads\n",
+        FRAMES, occluders.size(), OCCLUSION_WIDTH, OCCLUSION_HEIGHT, SIMD_LANES, cores);
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, cores))
+    {
+        JobScheduler jobs(threads);
+        MaskedOcclusionBuffer occlusion;
+        occlusion.resize(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+        std::vector<uint32_t> visible;
+        unsigned long long inFrustum = 0, culled = 0, occluderTriangles = 0;
+        double drawMs = 0.0, testMs = 0.0;
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            glm::mat4 viewProjection = projection * views[frame];
+            visible.clear();
+            cullSpheres(Frustum(viewProjection), spheres, visible);
+            occlusion.begin(viewProjection, nearPlane);
+            drawCityOccluders(occlusion, occluders, visible, eyes[frame], jobs);
+            occlusion.cull(spheres, visible);
+            inFrustum += occlusion.stats.tested;
+            culled += occlusion.stats.occluded;
+            occluderTriangles += occlusion.stats.occluderTriangles;
+            drawMs += occlusion.stats.renderMicroseconds / 1000.0;
+            testMs += occlusion.stats.testMicroseconds / 1000.0;
+        }
+        std::printf("  %2u threads: %.1f of %.1f meshes in the frustum culled (%.1f%%), %.0f occluder triangles, %.3f ms drawing + %.3f ms testing per frame\n",
+            threads, (double)culled / FRAMES, (double)inFrustum / FRAMES, inFrustum ? 100.0 * culled / inFrustum : 0.0,
+            (double)occluderTriangles / FRAMES, drawMs / FRAMES, testMs / FRAMES);
+        if (threads == cores)
+            break;
+    }
+}
+
+// ---- event log ---------------------------------------------------------------
+
+// What a crash line costs the thread printing it: fprintf and a flush per
+// line as std::endl did, EventLog::log, and EventLog::log at a site limited
+// to 4 lines a second, all into a temporary file. Each of 1, 2, 4 ...
+// threads up to the core count logs frames of 1,000 lines; the log is
+// flushed between frames outside the timing, as its writer keeps up between
+// real frames. Prints the nanoseconds per line and the worst frame.
+void runLogBenchmark()
+{
+    const int FRAMES = 200, LINES_PER_FRAME = 1000;
+    const char* const names[] = { "printf + flush", "event log", "rate-limited log" };
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::printf("log benchmark: %d frames of %d lines per thread, %u hardware threads\n", FRAMES, LINES_PER_FRAME, cores);
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, cores))
+    {
+        for (int mode = 0; mode < 3; mode++)
+        {
+            FILE* file = std::tmpfile();
+            if (!file)
+            {
+                std::cout << "LOG_BENCH::NO_TEMPORARY_FILE" << std::endl;
+                return;
+            }
+            LogSite site(LOG_INFO, crashLog.format, mode == 2 ? 4 : 0);
+            std::atomic<long long> nanoseconds{ 0 }, worstFrame{ 0 };
+            unsigned long long written, suppressed, dropped;
+            {
+                EventLog events(file);
+                auto logFrames = [&](unsigned int thread) {
+                    for (int frame = 0; frame < FRAMES; frame++)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+                        for (int line = 0; line < LINES_PER_FRAME; line++)
+                        {
+                            unsigned int count = thread * FRAMES * LINES_PER_FRAME + frame * LINES_PER_FRAME + line;
+                            if (mode == 0)
+                            {
+                                std::fprintf(file, crashLog.format, count);
+                                std::fputc('\n', file);
+                                std::fflush(file);
+                            }
+                            else
+                                events.log(site, count);
+                        }
+                        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                        nanoseconds += ns;
+                        long long worst = worstFrame.load();
+                        while (ns > worst && !worstFrame.compare_exchange_weak(worst, ns))
+                            ;
+                        events.flush();
+                    }
+                };
+                std::vector<std::thread> loggers;
+                for (unsigned int t = 0; t < threads; t++)
+                    loggers.emplace_back(logFrames, t);
+                for (std::thread& logger : loggers)
+                    logger.join();
+                events.flush();
+                written = events.written();
+                suppressed = events.suppressed();
+                dropped = events.dropped();
+            }
+            std::fclose(file);
+            std::printf("  %2u threads, %-16s %8.1f ns per line, worst frame %7.3f ms | %llu written, %llu suppressed, %llu dropped\n",
+                threads, names[mode], (double)nanoseconds / ((double)threads * FRAMES * LINES_PER_FRAME), worstFrame / 1e6,
+                mode == 0 ? (unsigned long long)threads * FRAMES * LINES_PER_FRAME : written, suppressed, dropped);
+        }
+        if (threads == cores)
+            break;
+    }
+}
@@ -1,38 +1,63 @@
 #version 330 core
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec2 tex;
-layout(location = 3) in vec3 tangent;
-layout(location = 4) in vec3 bitangent;
-layout(location = 5) in ivec4 boneIds; 
-layout(location = 6) in vec4 weights;
+layout(location = 0) in vec4 pos;       // snorm16 inside the mesh's bounding box, w = bitangent sign
+layout(location = 1) in vec2 norm;      // octahedral
+layout(location = 2) in vec2 tex;       // half float
+layout(location = 5) in ivec4 boneIds;  // NO_BONE marks unused slots
+layout(location = 6) in vec4 weights;   // unorm8
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
 
-const int MAX_BONES = 100;
+// dequantization of the packed positions, per mesh
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[MAX_BONES];
+const int NO_BONE = 65535;
+
+// this character's bones in the frame's bone palette (bone_palette.h), four
+// RGBA32F texels per matrix from boneBase on
+uniform samplerBuffer bonePalette;
+uniform int boneBase;
+uniform int boneCount;
 
 out vec2 TexCoords;
 
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+mat4 boneMatrix(int bone)
+{
+    int texel = (boneBase + bone) * 4;
+    return mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1),
+                texelFetch(bonePalette, texel + 2), texelFetch(bonePalette, texel + 3));
+}
+
 void main()
 {
+    vec3 position = pos.xyz * positionScale + positionOffset;
+    vec3 normal = octDecode(norm);
     vec4 totalPosition = vec4(0.0f);
     for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
     {
-        if(boneIds[i] == -1) 
+        if(boneIds[i] == NO_BONE) 
             continue;
-        if(boneIds[i] >=MAX_BONES) 
+        if(boneIds[i] >= boneCount) 
         {
-            totalPosition = vec4(pos,1.0f);
+            totalPosition = vec4(position,1.0f);
             break;
         }
-        vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
+        mat4 bone = boneMatrix(boneIds[i]);
+        vec4 localPosition = bone * vec4(position,1.0f);
         totalPosition += localPosition * weights[i];
-        vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
+        vec3 localNormal = mat3(bone) * normal;
    }
 	
     mat4 viewModel = view * model;
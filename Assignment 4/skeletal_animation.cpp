@@ -10,17 +10,33 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/animator.h>
 #include <learnopengl/model_animation.h>
+#define LEARNOPENGL_COUNT_ALLOCATIONS
+#include <learnopengl/uniforms.h>
+#include <learnopengl/offline.h>
+#include <learnopengl/vertex_format.h>
+#include <learnopengl/asset_loader.h>
+#include <learnopengl/event_log.h>
+#include <learnopengl/bone_palette.h>
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+bool keyPressed(GLFWwindow* window, int key);
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
+const int BONE_PALETTE_UNIT = 4 * PackedModel::SAMPLERS_PER_TYPE;   // after the model's samplers
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -43,43 +59,64 @@ enum AnimState {
 	DANCE_IDLE
 };
 
-int main()
-{
-	// glfw: initialize and configure
-	// ------------------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// The state machine's state, logged every frame through the event log. A
+// repeat is suppressed for 10 seconds, so the log shows each change as it
+// happens and a line every 10 seconds while the state holds.
+LogSite stateTrace(LOG_TRACE, "state %s", 0, 10.0f);
 
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-	// glfw window creation
-	// --------------------
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+int main(int argc, char** argv)
+{
+	// glfw: initialize and configure (or a headless context for --offline)
+	// ---------------------------------------------------------------------
+	OfflineRenderer offline(argc, argv, SCR_WIDTH, SCR_HEIGHT);
+	// --mice <n> draws a crowd of n mice sharing the bone palette
+	int mouseCount = 1;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::strcmp(argv[i], "--mice") == 0)
+			mouseCount = std::max(1, std::atoi(argv[i + 1]));
+	GLFWwindow* window = NULL;
+	if (offline.active)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		if (!offline.createContext())
+			return -1;
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+	else
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 
-	// glad: load all OpenGL function pointers
-	// ---------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		// glfw window creation
+		// --------------------
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+
+		// tell GLFW to capture our mouse
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+		// glad: load all OpenGL function pointers
+		// ---------------------------------------
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
 	}
+	countUniformLookups();
 
 	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 	stbi_set_flip_vertically_on_load(true);
@@ -91,61 +128,146 @@ int main()
 	// build and compile shaders
 	// -------------------------
 	Shader ourShader("anim_model.vs", "anim_model.fs");
+	UniformTable uniforms(ourShader.ID);
+	Uniform<glm::mat4> uProjection = uniforms.get<glm::mat4>("projection");
+	Uniform<glm::mat4> uView = uniforms.get<glm::mat4>("view");
+	Uniform<glm::mat4> uModel = uniforms.get<glm::mat4>("model");
+	Uniform<int> uBoneBase = uniforms.get<int>("boneBase");
+	Uniform<int> uBoneCount = uniforms.get<int>("boneCount");
+	Uniform<glm::vec3> uPositionOffset = uniforms.get<glm::vec3>("positionOffset");
+	Uniform<glm::vec3> uPositionScale = uniforms.get<glm::vec3>("positionScale");
 
 
 	// load models
 	// -----------
-	Model ourModel(FileSystem::getPath("resources/objects/mouse/mouse.dae"));
+	// Model creates its buffers and textures in its constructor, so it loads
+	// on this thread (after one loading frame). The animations are parsed on
+	// a worker while loading frames are drawn; each one adds the bones it is
+	// missing to ourModel's bone map, so they are parsed one after another,
+	// in the same order as before, to get the same bone ids.
+	auto loadStart = std::chrono::steady_clock::now();
+	glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawLoadingBar(0.0f, SCR_WIDTH, SCR_HEIGHT);
+	if (window)
+		glfwSwapBuffers(window);
 
-	Animation idleAnimation(FileSystem::getPath("resources/objects/mouse/Idle.dae"), &ourModel);
-	Animation walkAnimation(FileSystem::getPath("resources/objects/mouse/Walking.dae"), &ourModel);
-	Animation jumpAnimation(FileSystem::getPath("resources/objects/mouse/Jump.dae"), &ourModel);
-	Animation danceAnimation(FileSystem::getPath("resources/objects/mouse/Dancing.dae"), &ourModel);
+	Model ourModel(FileSystem::getPath("resources/objects/mouse/mouse.dae"));
+	double modelTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+	const char* animationFiles[4] = { "Idle.dae", "Walking.dae", "Jump.dae", "Dancing.dae" };
+	std::unique_ptr<Animation> animations[4];
+	JobScheduler loadJobs(2); // this thread and one worker
+	AssetLoader loader(loadJobs); // declared after what its job writes, so it waits for it first
+	loader.run([&]() {
+		for (int i = 0; i < 4; i++)
+			animations[i].reset(new Animation(FileSystem::getPath(std::string("resources/objects/mouse/") + animationFiles[i]), &ourModel));
+	});
+
+	// re-encode the meshes into 32-byte quantized skinned vertices; the
+	// animations keep reading the bone map from ourModel
+	PackedModel packedModel;
+	packedModel.pack(ourModel, true);
+	packedModel.stats.print("mouse");
+
+	int loadingFrames = 0;
+	if (offline.active)
+		loader.finish(); // offline frames are all animation frames
+	while (!loader.done() && !offline.shouldClose(window))
+	{
+		loader.update(4.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		drawLoadingBar(0.5f + 0.5f * loader.progress(), SCR_WIDTH, SCR_HEIGHT);
+		offline.present(window);
+		loadingFrames++;
+	}
+	if (!loader.done())
+	{
+		glfwTerminate();
+		return 0;
+	}
+	std::printf("mouse loaded in %.1f ms (model %.1f ms on the GL thread, animations on a worker), %d loading frames\n",
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count(), modelTime, loadingFrames);
+	Animation& idleAnimation = *animations[0];
+	Animation& walkAnimation = *animations[1];
+	Animation& jumpAnimation = *animations[2];
+	Animation& danceAnimation = *animations[3];
+	ourShader.use();
+	PackedModel::bindSamplers(uniforms);
 
 	Animator animator(&idleAnimation);
+	// the rest of the crowd loops one animation each, out of step
+	std::vector<std::unique_ptr<Animator>> crowd;
+	for (int i = 1; i < mouseCount; i++)
+	{
+		crowd.emplace_back(new Animator(animations[i % 4].get()));
+		crowd.back()->UpdateAnimation(0.37f * i);
+	}
+
+	// every mouse's bones go into one texture buffer each frame, as many as
+	// the rig has. The palette has no fixed limit, but learnopengl's Animator
+	// always keeps 100 matrices and writes them by bone id unchecked, so it
+	// only supports rigs of up to 100 bones; the palette never reads more.
+	size_t boneCount = std::min((size_t)std::max(ourModel.GetBoneCount(), 1), animator.GetFinalBoneMatrices().size());
+	if ((size_t)ourModel.GetBoneCount() > boneCount)
+		std::cout << "BONE_PALETTE::TOO_MANY_BONES: " << ourModel.GetBoneCount() << ", the Animator computes " << boneCount << std::endl;
+	BonePalette palette;
+	palette.create(boneCount * mouseCount);
+	palette.bind(BONE_PALETTE_UNIT);
+	uniforms.get<int>("bonePalette").set(BONE_PALETTE_UNIT);
+	uBoneCount.set((int)boneCount);
+	if (palette.capacity < boneCount * mouseCount)
+		std::cout << "BONE_PALETTE::TOO_SMALL: room for " << palette.capacity / std::max<size_t>(boneCount, 1) << " of " << mouseCount << " mice" << std::endl;
+	std::vector<GLint> boneBases(mouseCount);
 	enum AnimState charState = IDLE;
 	float blendAmount = 0.0f;
 	float blendRate = 0.055f; // You can change this to blend faster/slower
+	const char* stateName = "idle";
+	EventLog events;
 
 	// draw in wireframe
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+	FrameCounters counters;
+	float lastTitleUpdate = 0.0f;
+
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	while (!offline.shouldClose(window))
 	{
 		// per-frame time logic
 		// --------------------
-		float currentFrame = (float)glfwGetTime();
+		float currentFrame = offline.time();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
 		// input
 		// -----
-		processInput(window);
+		if (window)
+			processInput(window);
 
 		// State machine logic
 		switch (charState) {
 		case IDLE:
 			// Check for transitions out of IDLE
-			if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+			if (keyPressed(window, GLFW_KEY_UP)) {
 				blendAmount = 0.0f;
 				animator.PlayAnimation(&idleAnimation, &walkAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
 				charState = IDLE_WALK;
 			}
 			// 'J' key for Jump
-			else if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
+			else if (keyPressed(window, GLFW_KEY_J)) {
 				blendAmount = 0.0f;
 				animator.PlayAnimation(&idleAnimation, &jumpAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
 				charState = IDLE_JUMP;
 			}
 			// 'K' key for Dance
-			else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+			else if (keyPressed(window, GLFW_KEY_K)) {
 				blendAmount = 0.0f;
 				animator.PlayAnimation(&idleAnimation, &danceAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
 				charState = IDLE_DANCE;
 			}
-			// printf("idle \n"); // uncomment for debugging
+			stateName = "idle";
 			break;
 
 			// --- WALK STATES ---
@@ -159,14 +281,14 @@ int main()
 				animator.PlayAnimation(&walkAnimation, NULL, startTime, 0.0f, blendAmount);
 				charState = WALK;
 			}
-			// printf("idle_walk \n");
+			stateName = "idle_walk";
 			break;
 		case WALK:
 			animator.PlayAnimation(&walkAnimation, NULL, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (glfwGetKey(window, GLFW_KEY_UP) != GLFW_PRESS) {
+			if (!keyPressed(window, GLFW_KEY_UP)) {
 				charState = WALK_IDLE;
 			}
-			// printf("walking\n");
+			stateName = "walking";
 			break;
 		case WALK_IDLE:
 			blendAmount += blendRate;
@@ -178,7 +300,7 @@ int main()
 				animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
 				charState = IDLE;
 			}
-			// printf("walk_idle \n");
+			stateName = "walk_idle";
 			break;
 
 			// --- JUMP STATES ---
@@ -192,7 +314,7 @@ int main()
 				animator.PlayAnimation(&jumpAnimation, NULL, startTime, 0.0f, blendAmount);
 				charState = JUMP_IDLE;
 			}
-			// printf("idle_jump\n");
+			stateName = "idle_jump";
 			break;
 		case JUMP_IDLE:
 			// !! IMPORTANT !!: Adjust this time (0.7f) to match your Jump animation length
@@ -206,10 +328,10 @@ int main()
 					animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
 					charState = IDLE;
 				}
-				// printf("jump_idle \n");
+				stateName = "jump_idle";
 			}
 			else {
-				// printf("jumping \n");
+				stateName = "jumping";
 			}
 			break;
 			
@@ -223,7 +345,7 @@ int main()
 				animator.PlayAnimation(&danceAnimation, NULL, startTime, 0.0f, blendAmount);
 				charState = DANCE_IDLE;
 			}
-			// printf("idle_dance\n");
+			stateName = "idle_dance";
 			break;
 		case DANCE_IDLE:
 			// !! IMPORTANT !!: Adjust this time (2.5f) to match your Dance animation length
@@ -237,15 +359,18 @@ int main()
 					animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
 					charState = IDLE;
 				}
-				// printf("dance_idle \n");
+				stateName = "dance_idle";
 			}
 			else {
-				// printf("dancing \n");
+				stateName = "dancing";
 			}
 			break;
 		} // END switch (charState)
+		events.log(stateTrace, stateName);
 
 		animator.UpdateAnimation(deltaTime);
+		for (auto& mouse : crowd)
+			mouse->UpdateAnimation(deltaTime);
 
 		// render
 		// ------
@@ -258,33 +383,63 @@ int main()
 		// view/projection transformations
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-
-		auto transforms = animator.GetFinalBoneMatrices();
-		for (int i = 0; i < transforms.size(); ++i)
-			ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-
-
-		// render the loaded model
-		glm::mat4 model = glm::mat4(1.0f);
-
-		// <-- ADJUST THESE VALUES!
-		model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-
-		ourShader.setMat4("model", model);
-		ourModel.Draw(ourShader);
+		uProjection.set(projection);
+		uView.set(view);
+
+		// every mouse's bones into this frame's share of the palette, then
+		// one base per mouse instead of a palette upload per draw. The
+		// Animator hands its matrices out by value; they are copied from
+		// there into mapped memory once.
+		palette.begin();
+		for (int i = 0; i < mouseCount; i++)
+		{
+			const std::vector<glm::mat4>& bones = (i == 0 ? animator : *crowd[i - 1]).GetFinalBoneMatrices();
+			boneBases[i] = palette.write(bones.data(), std::min(bones.size(), boneCount));
+		}
+		palette.end();
+
+
+		// render the loaded model, the crowd in rows of 8 behind it
+		for (int i = 0; i < mouseCount; i++)
+		{
+			if (boneBases[i] < 0)
+				continue;
+			glm::mat4 model = glm::mat4(1.0f);
+
+			// <-- ADJUST THESE VALUES!
+			model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
+			if (i > 0)
+				model = glm::translate(model, glm::vec3(((i - 1) % 8 - 3.5f) * 1.5f, 0.0f, -1.5f * (1 + (i - 1) / 8)));
+			model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
+
+			uModel.set(model);
+			uBoneBase.set(boneBases[i]);
+			packedModel.draw(uPositionOffset, uPositionScale);
+		}
 
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+		// offline: read the frame back and write it out instead
 		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		offline.present(window);
+
+		// uniform name lookups / heap allocations during the last frame
+		counters.endFrame();
+		if (window && currentFrame - lastTitleUpdate > 1.0f)
+		{
+			char title[192];
+			std::snprintf(title, sizeof(title), "LearnOpenGL | lookups/frame %llu | allocs/frame %llu | %zu mice, %zu bone matrices, %llu palette stalls",
+				counters.lookups, counters.allocations, palette.characters, palette.matrices, palette.stalls);
+			glfwSetWindowTitle(window, title);
+			lastTitleUpdate = currentFrame;
+		}
 	}
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
+	offline.finish();
+	palette.destroy();
+	packedModel.destroy();
 	glfwTerminate();
 	return 0;
 }
@@ -306,6 +461,13 @@ void processInput(GLFWwindow* window)
 		camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+// state machine input; offline runs have no window and therefore no keys
+// ---------------------------------------------------------------------
+bool keyPressed(GLFWwindow* window, int key)
+{
+	return window && glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -0,0 +1,448 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/culling.h>
+#include <learnopengl/jobs.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ---- GL-free import --------------------------------------------------------
+
+// learnopengl's Vertex layout, so encodeMesh and computeModelBounds accept it
+struct ImportedVertex
+{
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Normal = glm::vec3(0.0f);
+    glm::vec2 TexCoords = glm::vec2(0.0f);
+    glm::vec3 Tangent = glm::vec3(0.0f);
+    glm::vec3 Bitangent = glm::vec3(0.0f);
+    int m_BoneIDs[4] = { -1, -1, -1, -1 };
+    float m_Weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+struct ImportedMesh
+{
+    std::vector<ImportedVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<MeshTextureRef> textures;
+};
+
+struct ImportedModel
+{
+    std::vector<ImportedMesh> meshes;
+};
+
+// Reads a static model the way Model does (same post-processing, node order
+// and texture types) but only into memory, so it can run on any thread.
+inline bool importModel(const std::string& path, ImportedModel& model)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    const aiTextureType types[4] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+    const char* names[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    std::vector<const aiNode*> nodes(1, scene->mRootNode);
+    while (!nodes.empty())
+    {
+        const aiNode* node = nodes.back();
+        nodes.pop_back();
+        for (unsigned int n = 0; n < node->mNumMeshes; n++)
+        {
+            const aiMesh* source = scene->mMeshes[node->mMeshes[n]];
+            ImportedMesh mesh;
+            mesh.vertices.resize(source->mNumVertices);
+            for (unsigned int i = 0; i < source->mNumVertices; i++)
+            {
+                ImportedVertex& v = mesh.vertices[i];
+                v.Position = glm::vec3(source->mVertices[i].x, source->mVertices[i].y, source->mVertices[i].z);
+                if (source->HasNormals())
+                    v.Normal = glm::vec3(source->mNormals[i].x, source->mNormals[i].y, source->mNormals[i].z);
+                if (source->mTextureCoords[0])
+                {
+                    v.TexCoords = glm::vec2(source->mTextureCoords[0][i].x, source->mTextureCoords[0][i].y);
+                    v.Tangent = glm::vec3(source->mTangents[i].x, source->mTangents[i].y, source->mTangents[i].z);
+                    v.Bitangent = glm::vec3(source->mBitangents[i].x, source->mBitangents[i].y, source->mBitangents[i].z);
+                }
+            }
+            for (unsigned int f = 0; f < source->mNumFaces; f++)
+                mesh.indices.insert(mesh.indices.end(), source->mFaces[f].mIndices, source->mFaces[f].mIndices + source->mFaces[f].mNumIndices);
+
+            const aiMaterial* material = scene->mMaterials[source->mMaterialIndex];
+            for (int t = 0; t < 4; t++)
+                for (unsigned int i = 0; i < material->GetTextureCount(types[t]); i++)
+                {
+                    aiString file;
+                    material->GetTexture(types[t], i, &file);
+                    mesh.textures.push_back({ names[t], file.C_Str() });
+                }
+            model.meshes.push_back(std::move(mesh));
+        }
+        // children pushed in reverse so they pop in Model's recursion order
+        for (unsigned int c = node->mNumChildren; c-- > 0;)
+            nodes.push_back(node->mChildren[c]);
+    }
+    return true;
+}
+
+// Loading screen without a shader: a bar cleared through a scissor rect,
+// call after clearing the frame
+inline void drawLoadingBar(float progress, int width, int height)
+{
+    int x = width / 8, y = height / 2 - 8, w = width * 3 / 4;
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x, y, w, 16);
+    glClearColor(0.1f, 0.15f, 0.15f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(x, y, (int)(w * std::min(std::max(progress, 0.0f), 1.0f)), 16);
+    glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+// ---- asset loader ----------------------------------------------------------
+
+// Loads assets as jobs on a JobScheduler while the GL thread keeps
+// rendering. Jobs map mesh caches (or import with Assimp on a miss) and
+// prepare textures through the TextureRegistry in parallel; everything that
+// needs GL is handed to a bounded upload queue, which the GL thread drains
+// in update() within a per-frame time budget. A job that finds the queue
+// full waits, which caps the decoded-but-not-uploaded memory. Such a job
+// would block the GL thread if it ran there, so the GL thread must not wait
+// on the scheduler while loading, and the scheduler needs a thread besides
+// it.
+class AssetLoader
+{
+public:
+    explicit AssetLoader(JobScheduler& jobs, size_t queueBytes = 64u << 20) : jobs(jobs), queueLimit(queueBytes) {}
+
+    // Jobs not started yet are skipped, running ones are waited for
+    ~AssetLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(uploadMutex);
+            quit = true;
+            uploads.clear();
+        }
+        uploadSpace.notify_all();
+        jobs.wait(pending);
+    }
+
+    // threads loading besides the GL thread
+    unsigned int threadCount() const { return jobs.threadCount() - 1; }
+
+    // Loads a static model into packed and bounds, which must stay alive
+    // until done(). Same result as MeshCache::load, including the cache.
+    void loadModel(const std::string& path, PackedModel& packed, ModelBounds& bounds, bool useCache = true)
+    {
+        std::shared_ptr<ModelLoad> load = std::make_shared<ModelLoad>();
+        load->path = path;
+        load->directory = path.substr(0, path.find_last_of("/\\"));
+        load->packed = &packed;
+        load->bounds = &bounds;
+        load->useCache = useCache;
+        run([this, load]() { parseModel(load); });
+    }
+
+    // Offline cooking: brings the mesh cache of a model and the mip
+    // container of each of its textures up to date, without any GL work
+    void cookModel(const std::string& path)
+    {
+        run([this, path]() {
+            ModelLoad load;
+            load.path = path;
+            load.directory = path.substr(0, path.find_last_of("/\\"));
+            readMeshes(load);
+            for (const std::string& image : uniqueImages(load))
+            {
+                std::string filename = load.directory + '/' + image;
+                run([filename]() { TextureRegistry::shared().cook(filename); });
+            }
+        });
+    }
+
+    // Runs work as a job, then (optionally) then on the GL thread; one step
+    // of progress
+    void run(std::function<void()> work, std::function<void()> then = std::function<void()>())
+    {
+        stepsTotal++;
+        outstanding++;
+        pending++;
+        JobScheduler::Job job;
+        job.run = [](void* context, size_t) {
+            std::unique_ptr<std::function<void()>> task((std::function<void()>*)context);
+            (*task)();
+        };
+        job.context = new std::function<void()>([this, work, then]() {
+            if (quit)
+                return;
+            work();
+            if (then)
+                upload(then, 0);
+            stepsDone++;
+            outstanding--;
+        });
+        job.counter = &pending;
+        jobs.submit(&job, 1);
+    }
+
+    // GL thread: runs queued uploads until budgetMs is spent, at least one
+    void update(double budgetMs)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (bool first = true;; first = false)
+        {
+            if (!first && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs)
+                break;
+            Upload job;
+            {
+                std::lock_guard<std::mutex> lock(uploadMutex);
+                if (uploads.empty())
+                    break;
+                job = std::move(uploads.front());
+                uploads.pop_front();
+                queuedBytes -= job.bytes;
+            }
+            uploadSpace.notify_all();
+            job.run();
+            uploadCount++;
+            outstanding--;
+        }
+    }
+
+    // GL thread: blocks until everything is loaded
+    void finish()
+    {
+        while (!done())
+        {
+            update(1e9);
+            std::unique_lock<std::mutex> lock(uploadMutex);
+            uploadReady.wait_for(lock, std::chrono::milliseconds(1), [this] { return !uploads.empty(); });
+        }
+    }
+
+    bool done() const { return outstanding == 0; }
+
+    // Fraction of the known steps completed. Steps are discovered while
+    // loading (a model's meshes and textures once it is parsed), so the raw
+    // fraction can drop; the reported value never does.
+    float progress() const
+    {
+        int total = stepsTotal;
+        float fraction = total > 0 ? (float)stepsDone / total : 1.0f;
+        float shown = std::max(shownProgress.load(), done() ? 1.0f : std::min(fraction, 0.99f));
+        shownProgress = shown;
+        return shown;
+    }
+
+    unsigned int uploadsRun() const { return uploadCount; }
+
+private:
+    struct Upload
+    {
+        std::function<void()> run;
+        size_t bytes = 0;
+    };
+
+    struct ModelLoad
+    {
+        std::string path, directory;
+        PackedModel* packed = nullptr;
+        ModelBounds* bounds = nullptr;
+        bool useCache = true;
+
+        // either the mapped cache or the freshly encoded meshes
+        std::shared_ptr<CachedModel> cached;
+        std::vector<EncodedMesh> encoded;
+        std::vector<std::vector<MeshTextureRef>> textures;
+        ModelBounds meshBounds;
+
+        // GL thread only
+        std::unordered_map<std::string, unsigned int> textureIds;
+        int remaining = 0;  // mesh and texture uploads before the units are assigned
+    };
+
+    JobScheduler& jobs;
+    std::atomic<int> pending{ 0 };      // jobs submitted and not finished
+    std::atomic<bool> quit{ false };
+
+    std::mutex uploadMutex;
+    std::condition_variable uploadSpace, uploadReady;
+    std::deque<Upload> uploads;
+    size_t queuedBytes = 0;
+    const size_t queueLimit;
+
+    std::atomic<int> outstanding{ 0 };   // tasks and uploads not finished yet
+    std::atomic<int> stepsDone{ 0 }, stepsTotal{ 0 };
+    mutable std::atomic<float> shownProgress{ 0.0f };
+    unsigned int uploadCount = 0;
+
+    // Hands a GL job to the GL thread; waits while the queue holds more than
+    // its byte limit, unless it is empty so an oversized job still gets in
+    void upload(std::function<void()> job, size_t bytes)
+    {
+        outstanding++;
+        {
+            std::unique_lock<std::mutex> lock(uploadMutex);
+            uploadSpace.wait(lock, [&] { return quit || uploads.empty() || queuedBytes + bytes <= queueLimit; });
+            if (quit)
+            {
+                outstanding--;
+                return;
+            }
+            Upload entry;
+            entry.run = std::move(job);
+            entry.bytes = bytes;
+            uploads.push_back(std::move(entry));
+            queuedBytes += bytes;
+        }
+        uploadReady.notify_one();
+    }
+
+    // Worker: the mapped cache when it is valid, otherwise an Assimp import
+    // that is encoded (and cooked, with the cache on)
+    static void readMeshes(ModelLoad& load)
+    {
+        uint64_t hash = 0;
+        if (load.useCache)
+        {
+            hash = hashModelSources(load.path);
+            load.cached = std::make_shared<CachedModel>();
+            if (!load.cached->open(load.path + ".meshcache", hash))
+                load.cached.reset();
+        }
+        if (load.cached)
+        {
+            for (size_t m = 0; m < load.cached->records.size(); m++)
+                load.textures.push_back(load.cached->textures(m));
+            load.meshBounds = load.cached->bounds();
+            return;
+        }
+        // a failed import loads as an empty model and is not cached, or every
+        // later run would map the empty cache as valid
+        ImportedModel model;
+        if (!importModel(load.path, model))
+        {
+            std::cout << "ASSET_LOADER::IMPORT_FAILED: " << load.path << std::endl;
+            return;
+        }
+        for (const ImportedMesh& mesh : model.meshes)
+        {
+            load.encoded.push_back(PackedModel::encodeMesh(mesh, false));
+            buildMeshLods(mesh, load.encoded.back());
+            load.textures.push_back(mesh.textures);
+        }
+        load.meshBounds = computeModelBounds(model);
+        if (load.useCache)
+            writeMeshCache(load.path + ".meshcache", hash, load.encoded, load.textures, load.meshBounds);
+    }
+
+    // each image once, as Model does with textures_loaded
+    static std::vector<std::string> uniqueImages(const ModelLoad& load)
+    {
+        std::vector<std::string> images;
+        for (const auto& meshTextures : load.textures)
+            for (const MeshTextureRef& texture : meshTextures)
+                if (std::find(images.begin(), images.end(), texture.path) == images.end())
+                    images.push_back(texture.path);
+        return images;
+    }
+
+    // Worker: map the cache or import and cook, then fan out the texture
+    // decodes and queue the mesh uploads
+    void parseModel(std::shared_ptr<ModelLoad> load)
+    {
+        readMeshes(*load);
+        size_t meshCount = load->textures.size();
+        std::vector<std::string> images = uniqueImages(*load);
+
+        // decodes count as steps through run(), uploads here
+        load->remaining = (int)(meshCount + images.size());
+        stepsTotal += (int)(meshCount + images.size());
+        for (const std::string& image : images)
+            run([this, load, image]() { loadTexture(load, image); });
+
+        upload([load]() { *load->bounds = load->meshBounds; }, 0);
+        for (size_t m = 0; m < meshCount; m++)
+        {
+            size_t bytes = load->cached ? 0 : load->encoded[m].vertices.size() + load->encoded[m].indices.size();
+            upload([this, load, m]() {
+                PackedModel& packed = *load->packed;
+                if (load->cached)
+                    packed.meshes.push_back(packed.upload(load->cached->layout(m), load->cached->vertices(m), load->cached->indices(m), false));
+                else
+                {
+                    EncodedMesh& encoded = load->encoded[m];
+                    packed.meshes.push_back(packed.upload(encoded, encoded.vertices.data(), encoded.indices.data(), false));
+                    encoded = EncodedMesh();
+                }
+                stepsDone++;
+                finishUpload(load);
+            }, bytes);
+        }
+    }
+
+    // Worker: one image through the texture registry. The first model to
+    // claim an image prepares and uploads it; the others wait for its
+    // texture on the GL thread.
+    void loadTexture(std::shared_ptr<ModelLoad> load, const std::string& image)
+    {
+        TextureRegistry& registry = TextureRegistry::shared();
+        std::string filename = load->directory + '/' + image;
+        uint64_t key = registry.key(filename);
+        auto resolve = [this, load, image](unsigned int texture) {
+            load->textureIds[image] = texture;
+            stepsDone++;
+            finishUpload(load);
+        };
+        if (!registry.claim(key))
+        {
+            upload([key, resolve]() { TextureRegistry::shared().whenReady(key, resolve); }, 0);
+            return;
+        }
+        std::shared_ptr<TextureData> data = registry.prepare(filename, key);
+        upload([key, data, filename, resolve]() { resolve(TextureRegistry::shared().upload(key, *data, filename)); }, data->bytes());
+    }
+
+    // GL thread: once the meshes and textures of a model are all uploaded,
+    // the textures get their sampler units, in Mesh::Draw's order
+    void finishUpload(const std::shared_ptr<ModelLoad>& load)
+    {
+        if (--load->remaining > 0)
+            return;
+        for (size_t m = 0; m < load->textures.size(); m++)
+        {
+            int count[4] = { 0, 0, 0, 0 };
+            for (const MeshTextureRef& texture : load->textures[m])
+                PackedModel::addTexture(load->packed->meshes[m], texture.type, load->textureIds[texture.path], count);
+        }
+        load->cached.reset();
+    }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef BONE_PALETTE_H
+#define BONE_PALETTE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Bone matrices of every skinned character drawn in a frame, in one texture
+// buffer of RGBA32F texels, four per matrix. Each character takes a range
+// of the frame's share, writes its matrices straight into mapped memory and
+// draws with the first one as its base, so a frame costs one map, one
+// flush and one base uniform per character, whatever the bone count; the
+// buffer's size, not a uniform array, limits the bones.
+//
+// The buffer is a ring of BONE_PALETTE_FRAMES shares, so the CPU writes one
+// while the GPU may still read the frames before it; a fence per share
+// guards the wrap-around. The contexts are GL 3.3, so instead of a
+// persistent mapping (glBufferStorage, 4.4) each frame maps its share
+// unsynchronized and invalidated, which the fences make safe. Should
+// waiting on a fence fail, that share is mapped synchronized instead.
+//
+// Per frame: begin(), then allocate() or write() per character, end()
+// before drawing any of them, then draw with the bases. The next begin()
+// fences the frame's draws.
+const int BONE_PALETTE_FRAMES = 3;
+
+class BonePalette
+{
+public:
+    unsigned int buffer = 0, texture = 0;
+    size_t capacity = 0;    // matrices per frame
+
+    // stats of the last frame, and frames that waited for the GPU so far
+    size_t matrices = 0, characters = 0, overflows = 0;
+    unsigned long long stalls = 0;
+
+    // Room for matricesPerFrame matrices a frame, as far as the texture
+    // buffer size allows
+    void create(size_t matricesPerFrame)
+    {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        capacity = std::min(std::max<size_t>(matricesPerFrame, 1), (size_t)maxTexels / 4 / BONE_PALETTE_FRAMES);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capacity * BONE_PALETTE_FRAMES * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void destroy()
+    {
+        for (GLsync& fence : fences)
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    // Fences the last frame's draws and maps this frame's share, once the
+    // GPU is done with the frame that used it before
+    void begin()
+    {
+        if (share >= 0)
+            fences[share] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        share = (share + 1) % BONE_PALETTE_FRAMES;
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+        if (fences[share])
+        {
+            // flush once, then wait for as long as the GPU takes
+            GLenum status = glClientWaitSync(fences[share], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            if (status != GL_ALREADY_SIGNALED)
+                stalls++;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[share], 0, 1000000000ull);
+            if (status == GL_WAIT_FAILED)
+                access &= ~GL_MAP_UNSYNCHRONIZED_BIT;   // the GPU may still read the share
+            glDeleteSync(fences[share]);
+            fences[share] = 0;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        mapped = (glm::mat4*)glMapBufferRange(GL_TEXTURE_BUFFER, share * capacity * sizeof(glm::mat4), capacity * sizeof(glm::mat4), access);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        matrices = characters = overflows = 0;
+    }
+
+    // Room for one character's count matrices, to be written before end();
+    // base is what the shader adds to its bone ids. Null if the frame's
+    // share is full.
+    glm::mat4* allocate(size_t count, GLint& base)
+    {
+        if (!mapped || matrices + count > capacity)
+        {
+            overflows++;
+            return nullptr;
+        }
+        glm::mat4* room = mapped + matrices;
+        base = (GLint)(share * capacity + matrices);
+        matrices += count;
+        characters++;
+        return room;
+    }
+
+    // allocate() and copy; the base, or -1 if the share is full
+    GLint write(const glm::mat4* bones, size_t count)
+    {
+        GLint base = -1;
+        if (glm::mat4* room = allocate(count, base))
+            std::copy(bones, bones + count, room);
+        return base;
+    }
+
+    // Flushes what was written and unmaps, before the draws that read it
+    void end()
+    {
+        if (!mapped)
+            return;
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (matrices > 0)
+            glFlushMappedBufferRange(GL_TEXTURE_BUFFER, 0, matrices * sizeof(glm::mat4));
+        glUnmapBuffer(GL_TEXTURE_BUFFER);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        mapped = nullptr;
+    }
+
+    void bind(int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    GLsync fences[BONE_PALETTE_FRAMES] = {};
+    int share = -1;
+    glm::mat4* mapped = nullptr;
+};
+
+#endif
@@ -0,0 +1,647 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/jobs.h>
+#include <learnopengl/mesh_cache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Bounding volume hierarchy over a static triangle soup, for collision
+// queries against level geometry: the closest hit along a ray and the first
+// contact of a moving sphere. Built top-down with binned SAH; the upper
+// levels split into subtrees that are built as jobs. The built
+// tree can be saved and mapped back in, so it is only built when its source
+// changes. Trees are at most BVH_MAX_DEPTH deep, which bounds the queries'
+// traversal stacks; a loaded file deeper than that is rejected.
+//
+// File layout: BvhFileHeader, nodes, triangles.
+
+struct BvhTriangle
+{
+    glm::vec3 v0, v1, v2;
+};
+
+// 32 bytes. Inner nodes store their left child, the right one follows it.
+struct BvhNode
+{
+    glm::vec3 min;
+    uint32_t first;     // leaf: first triangle, inner: left child
+    glm::vec3 max;
+    uint32_t count;     // triangles of a leaf, 0 for inner nodes
+};
+
+struct BvhRayHit
+{
+    float t = 0.0f;
+    uint32_t triangle = 0;
+    glm::vec3 normal = glm::vec3(0.0f);    // facing the ray
+};
+
+struct BvhSweepHit
+{
+    float t = 1.0f;                         // fraction of the motion
+    uint32_t triangle = 0;
+    glm::vec3 normal = glm::vec3(0.0f);    // from the contact towards the sphere
+    glm::vec3 point = glm::vec3(0.0f);     // contact point
+};
+
+const uint32_t BVH_FILE_VERSION = 1;
+const int BVH_MAX_DEPTH = 60;   // edges from the root to the deepest leaf
+
+struct BvhFileHeader
+{
+    char magic[8];          // "LOGLBVH\0"
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t triangleCount;
+    uint32_t padding;
+    uint64_t key;           // identifies the source geometry, chosen by the caller
+    uint64_t fileSize;
+};
+
+// ---- triangle tests --------------------------------------------------------
+
+inline float boxArea(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Möller-Trumbore, both faces
+inline bool rayTriangle(const glm::vec3& origin, const glm::vec3& dir, const BvhTriangle& tri, float maxT, float& t)
+{
+    glm::vec3 e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0;
+    glm::vec3 p = glm::cross(dir, e2);
+    float det = glm::dot(e1, p);
+    if (std::fabs(det) < 1e-12f)
+        return false;
+    float inv = 1.0f / det;
+    glm::vec3 s = origin - tri.v0;
+    float u = glm::dot(s, p) * inv;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(dir, q) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(e2, q) * inv;
+    return t >= 0.0f && t < maxT;
+}
+
+// Closest point of a triangle to p (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const BvhTriangle& tri)
+{
+    const glm::vec3 &a = tri.v0, &b = tri.v1, &c = tri.v2;
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Smallest root of a t^2 + b t + c = 0 in [0, maxT)
+inline bool lowestRoot(float a, float b, float c, float maxT, float& root)
+{
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0.0f || a == 0.0f)
+        return false;
+    float s = std::sqrt(discriminant);
+    float r1 = (-b - s) / (2.0f * a), r2 = (-b + s) / (2.0f * a);
+    if (r1 > r2)
+        std::swap(r1, r2);
+    if (r1 >= 0.0f && r1 < maxT)
+    {
+        root = r1;
+        return true;
+    }
+    if (r2 >= 0.0f && r2 < maxT)
+    {
+        root = r2;
+        return true;
+    }
+    return false;
+}
+
+// First contact of a sphere moving by motion with a triangle, before
+// fraction maxT: against the face, then its edges and corners (Fauerby,
+// "Improved Collision detection and Response"). A sphere that already
+// touches the triangle only hits if it moves further in, so it can always
+// back out.
+inline bool sweepSphereTriangle(const glm::vec3& center, float radius, const glm::vec3& motion, const BvhTriangle& tri,
+                                float maxT, BvhSweepHit& hit)
+{
+    glm::vec3 closest = closestPointOnTriangle(center, tri);
+    glm::vec3 away = center - closest;
+    if (glm::dot(away, away) < radius * radius)
+    {
+        if (glm::dot(away, motion) >= 0.0f)
+            return false;
+        hit.t = 0.0f;
+        hit.point = closest;
+        hit.normal = glm::dot(away, away) > 0.0f ? glm::normalize(away) : -glm::normalize(motion);
+        return true;
+    }
+
+    glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+    float length = glm::length(n);
+    if (length == 0.0f)
+        return false;
+    n /= length;
+    float distance = glm::dot(center - tri.v0, n);
+    if (distance < 0.0f)
+    {
+        n = -n;
+        distance = -distance;
+    }
+
+    // the face: the sphere reaches the plane inside the triangle
+    float approach = glm::dot(motion, n);
+    if (approach < 0.0f && distance >= radius)
+    {
+        float t = (distance - radius) / -approach;
+        if (t >= maxT)
+            return false;   // edges and corners lie in the plane too
+        glm::vec3 contact = center + motion * t - n * radius;
+        glm::vec3 e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0, p = contact - tri.v0;
+        float d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+        float dp1 = glm::dot(p, e1), dp2 = glm::dot(p, e2);
+        float denom = d11 * d22 - d12 * d12;
+        float u = (d22 * dp1 - d12 * dp2), v = (d11 * dp2 - d12 * dp1);
+        if (u >= 0.0f && v >= 0.0f && u + v <= denom)
+        {
+            hit.t = t;
+            hit.point = contact;
+            hit.normal = n;
+            return true;
+        }
+    }
+
+    // corners and edges
+    bool found = false;
+    float best = maxT;
+    float speed2 = glm::dot(motion, motion);
+    const glm::vec3* corners[3] = { &tri.v0, &tri.v1, &tri.v2 };
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec3& v = *corners[i];
+        float t;
+        if (lowestRoot(speed2, 2.0f * glm::dot(motion, center - v), glm::dot(center - v, center - v) - radius * radius, best, t))
+        {
+            best = t;
+            hit.point = v;
+            found = true;
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec3& a = *corners[i];
+        glm::vec3 edge = *corners[(i + 1) % 3] - a;
+        glm::vec3 toStart = a - center;
+        float edge2 = glm::dot(edge, edge);
+        float edgeMotion = glm::dot(edge, motion);
+        float edgeStart = glm::dot(edge, toStart);
+        float t;
+        if (!lowestRoot(edge2 * -speed2 + edgeMotion * edgeMotion,
+                        edge2 * 2.0f * glm::dot(motion, toStart) - 2.0f * edgeMotion * edgeStart,
+                        edge2 * (radius * radius - glm::dot(toStart, toStart)) + edgeStart * edgeStart, best, t))
+            continue;
+        float f = (edgeMotion * t - edgeStart) / edge2;
+        if (f >= 0.0f && f <= 1.0f)
+        {
+            best = t;
+            hit.point = a + edge * f;
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+    hit.t = best;
+    glm::vec3 toCenter = center + motion * best - hit.point;
+    hit.normal = glm::dot(toCenter, toCenter) > 0.0f ? glm::normalize(toCenter) : n;
+    return true;
+}
+
+// ---- the tree --------------------------------------------------------------
+
+class TriangleBvh
+{
+public:
+    std::vector<BvhNode> nodes;             // nodes[0] is the root
+    std::vector<BvhTriangle> triangles;     // in leaf order
+
+    bool empty() const { return nodes.empty(); }
+
+    // Builds on the calling thread, or splits the upper levels across jobs
+    void build(const std::vector<BvhTriangle>& source, JobScheduler* jobs = nullptr)
+    {
+        nodes.clear();
+        triangles.clear();
+        if (source.empty())
+            return;
+        unsigned int threads = jobs ? jobs->threadCount() : 1;
+
+        Build b;
+        b.source = &source;
+        b.order.resize(source.size());
+        b.boxes.resize(source.size());
+        b.centroids.resize(source.size());
+        for (uint32_t i = 0; i < source.size(); i++)
+        {
+            const BvhTriangle& tri = source[i];
+            b.order[i] = i;
+            b.boxes[i].min = glm::min(tri.v0, glm::min(tri.v1, tri.v2));
+            b.boxes[i].max = glm::max(tri.v0, glm::max(tri.v1, tri.v2));
+            b.centroids[i] = (b.boxes[i].min + b.boxes[i].max) * 0.5f;
+        }
+        nodes.resize(2 * source.size());
+        b.nodes = nodes.data();
+        b.nodeCount = 1;
+        b.jobs = jobs;
+        int spawnDepth = 0;
+        while ((1u << spawnDepth) < threads)
+            spawnDepth++;
+        buildNode(b, 0, 0, (uint32_t)source.size(), 0, spawnDepth);
+        nodes.resize(b.nodeCount);
+
+        triangles.resize(source.size());
+        for (size_t i = 0; i < source.size(); i++)
+            triangles[i] = source[b.order[i]];
+    }
+
+    // Closest triangle along origin + dir * t, t < maxT
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxT, BvhRayHit& hit) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inv = 1.0f / dir;
+        bool found = false;
+        float best = maxT;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode& node = nodes[stack[--top]];
+            if (!slabs(origin, inv, node.min, node.max, best))
+                continue;
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    float t;
+                    if (rayTriangle(origin, dir, triangles[i], best, t))
+                    {
+                        best = t;
+                        hit.triangle = i;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            // nearer child on top of the stack
+            uint32_t left = node.first, right = node.first + 1;
+            float enterLeft = entry(origin, inv, nodes[left]), enterRight = entry(origin, inv, nodes[right]);
+            if (enterLeft < enterRight)
+                std::swap(left, right);
+            if (top + 2 > STACK_SIZE)
+                continue;   // only deeper than BVH_MAX_DEPTH, which build() and load() rule out
+            stack[top++] = left;
+            stack[top++] = right;
+        }
+        if (found)
+        {
+            const BvhTriangle& tri = triangles[hit.triangle];
+            hit.t = best;
+            hit.normal = glm::normalize(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+            if (glm::dot(hit.normal, dir) > 0.0f)
+                hit.normal = -hit.normal;
+        }
+        return found;
+    }
+
+    // First triangle a sphere touches moving from center by motion.
+    // Triangles whose normal has |y| above maxNormalY (floors, for a
+    // threshold below 1) are skipped, so a probe can slide over the ground
+    // and only stop at walls.
+    bool sweep(const glm::vec3& center, float radius, const glm::vec3& motion, BvhSweepHit& hit,
+               float maxNormalY = 1.0f) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inv = 1.0f / motion;
+        glm::vec3 grow(radius);
+        bool found = false;
+        float best = 1.0f;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode& node = nodes[stack[--top]];
+            if (!slabs(center, inv, node.min - grow, node.max + grow, best))
+                continue;
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    const BvhTriangle& tri = triangles[i];
+                    if (maxNormalY < 1.0f)
+                    {
+                        glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+                        if (n.y * n.y > maxNormalY * maxNormalY * glm::dot(n, n))
+                            continue;
+                    }
+                    BvhSweepHit candidate;
+                    if (sweepSphereTriangle(center, radius, motion, tri, best, candidate) && (!found || candidate.t < best))
+                    {
+                        best = candidate.t;
+                        hit = candidate;
+                        hit.triangle = i;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            if (top + 2 > STACK_SIZE)
+                continue;
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+        return found;
+    }
+
+    // Saves the tree under key, through a temporary file
+    bool save(const std::string& path, uint64_t key) const
+    {
+        BvhFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "LOGLBVH", 8);
+        header.version = BVH_FILE_VERSION;
+        header.nodeCount = (uint32_t)nodes.size();
+        header.triangleCount = (uint32_t)triangles.size();
+        header.key = key;
+        header.fileSize = sizeof(header) + nodes.size() * sizeof(BvhNode) + triangles.size() * sizeof(BvhTriangle);
+
+        std::string temporary = path + ".tmp";
+        FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+            return false;
+        bool written = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                       std::fwrite(nodes.data(), sizeof(BvhNode), nodes.size(), out) == nodes.size() &&
+                       std::fwrite(triangles.data(), sizeof(BvhTriangle), triangles.size(), out) == triangles.size();
+        written = std::fclose(out) == 0 && written;
+        if (written)
+            std::remove(path.c_str()); // rename does not replace on Windows
+        if (!written || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            std::cout << "BVH::WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Loads a tree saved under the same key; false if there is none or it
+    // is stale or damaged. Children must follow their parent, as build()
+    // lays them out, so a damaged file cannot loop, and no leaf may lie
+    // deeper than BVH_MAX_DEPTH.
+    bool load(const std::string& path, uint64_t key)
+    {
+        nodes.clear();
+        triangles.clear();
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(BvhFileHeader))
+            return false;
+        BvhFileHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, "LOGLBVH", 8) != 0 || header.version != BVH_FILE_VERSION || header.key != key ||
+            header.fileSize != file.size() || header.nodeCount == 0 ||
+            header.fileSize != sizeof(header) + (uint64_t)header.nodeCount * sizeof(BvhNode) + (uint64_t)header.triangleCount * sizeof(BvhTriangle))
+            return false;
+        nodes.resize(header.nodeCount);
+        triangles.resize(header.triangleCount);
+        std::memcpy(nodes.data(), file.data() + sizeof(header), nodes.size() * sizeof(BvhNode));
+        std::memcpy(triangles.data(), file.data() + sizeof(header) + nodes.size() * sizeof(BvhNode), triangles.size() * sizeof(BvhTriangle));
+        std::vector<uint8_t> depth(nodes.size(), 0);
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const BvhNode& node = nodes[i];
+            bool valid = node.count > 0 ? (uint64_t)node.first + node.count <= triangles.size()
+                                        : node.first > i && (uint64_t)node.first + 1 < nodes.size() && depth[i] < BVH_MAX_DEPTH;
+            if (valid && node.count == 0)
+                for (uint32_t child = node.first; child <= node.first + 1; child++)
+                    depth[child] = std::max<uint8_t>(depth[child], depth[i] + 1);
+            if (!valid)
+            {
+                nodes.clear();
+                triangles.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static const int BINS = 16;
+    static const uint32_t MAX_LEAF = 8;
+    static const uint32_t PARALLEL_MIN = 16384;  // smaller subtrees are not worth a job
+    // Past this depth nodes split at the median, which halves them, so any
+    // 32-bit triangle count runs out before BVH_MAX_DEPTH; SAH alone may peel
+    // off a bin a level.
+    static const int MEDIAN_DEPTH = BVH_MAX_DEPTH - 32;
+    static const int STACK_SIZE = BVH_MAX_DEPTH + 2;
+
+    struct Box
+    {
+        glm::vec3 min, max;
+    };
+
+    struct Build
+    {
+        const std::vector<BvhTriangle>* source;
+        std::vector<uint32_t> order;
+        std::vector<Box> boxes;
+        std::vector<glm::vec3> centroids;
+        BvhNode* nodes;
+        std::atomic<uint32_t> nodeCount;
+        JobScheduler* jobs;
+    };
+
+    struct Subtree
+    {
+        Build* b;
+        uint32_t index, begin, end;
+        int depth, spawnDepth;
+    };
+
+    // Ray against a box; true if it enters before maxT
+    static bool slabs(const glm::vec3& origin, const glm::vec3& inv, const glm::vec3& min, const glm::vec3& max, float maxT)
+    {
+        glm::vec3 t0 = (min - origin) * inv, t1 = (max - origin) * inv;
+        glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+        float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+        float exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, maxT));
+        return enter <= exit;
+    }
+
+    static float entry(const glm::vec3& origin, const glm::vec3& inv, const BvhNode& node)
+    {
+        glm::vec3 t0 = (node.min - origin) * inv, t1 = (node.max - origin) * inv;
+        glm::vec3 lo = glm::min(t0, t1);
+        return std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+    }
+
+    static void buildNode(Build& b, uint32_t index, uint32_t begin, uint32_t end, int depth, int spawnDepth)
+    {
+        BvhNode& node = b.nodes[index];
+        Box bounds = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+        Box centers = bounds;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            uint32_t t = b.order[i];
+            bounds.min = glm::min(bounds.min, b.boxes[t].min);
+            bounds.max = glm::max(bounds.max, b.boxes[t].max);
+            centers.min = glm::min(centers.min, b.centroids[t]);
+            centers.max = glm::max(centers.max, b.centroids[t]);
+        }
+        node.min = bounds.min;
+        node.max = bounds.max;
+        uint32_t count = end - begin;
+
+        // binned SAH: cost of each split plane between the bins of every axis
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        glm::vec3 extent = centers.max - centers.min;
+        for (int axis = 0; axis < 3 && count > 1 && depth < MEDIAN_DEPTH; axis++)
+        {
+            if (extent[axis] <= 0.0f)
+                continue;
+            Box binBox[BINS];
+            uint32_t binCount[BINS] = {};
+            for (int k = 0; k < BINS; k++)
+                binBox[k] = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+            float scale = BINS / extent[axis];
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t t = b.order[i];
+                int k = std::min(BINS - 1, (int)((b.centroids[t][axis] - centers.min[axis]) * scale));
+                binCount[k]++;
+                binBox[k].min = glm::min(binBox[k].min, b.boxes[t].min);
+                binBox[k].max = glm::max(binBox[k].max, b.boxes[t].max);
+            }
+            float rightArea[BINS];
+            uint32_t rightCount[BINS];
+            Box grow = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+            uint32_t n = 0;
+            for (int k = BINS - 1; k > 0; k--)
+            {
+                grow.min = glm::min(grow.min, binBox[k].min);
+                grow.max = glm::max(grow.max, binBox[k].max);
+                n += binCount[k];
+                rightArea[k] = boxArea(grow.min, grow.max);
+                rightCount[k] = n;
+            }
+            grow = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+            n = 0;
+            for (int k = 0; k < BINS - 1; k++)
+            {
+                grow.min = glm::min(grow.min, binBox[k].min);
+                grow.max = glm::max(grow.max, binBox[k].max);
+                n += binCount[k];
+                if (n == 0 || rightCount[k + 1] == 0)
+                    continue;
+                float cost = boxArea(grow.min, grow.max) * n + rightArea[k + 1] * rightCount[k + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = k + 1;
+                }
+            }
+        }
+
+        // a leaf when splitting does not pay for the extra traversal step
+        float area = boxArea(bounds.min, bounds.max);
+        bool split = bestAxis >= 0 && (count > MAX_LEAF || 1.0f + bestCost / std::max(area, 1e-30f) < (float)count);
+        uint32_t middle = begin;
+        if (split)
+        {
+            float scale = BINS / extent[bestAxis];
+            float lo = centers.min[bestAxis];
+            middle = (uint32_t)(std::partition(b.order.begin() + begin, b.order.begin() + end, [&](uint32_t t) {
+                return std::min(BINS - 1, (int)((b.centroids[t][bestAxis] - lo) * scale)) < bestSplit;
+            }) - b.order.begin());
+        }
+        else if (count > MAX_LEAF && depth < MEDIAN_DEPTH)
+            middle = begin + count / 2;   // identical centroids: any halving will do
+        else if (count > MAX_LEAF)
+        {
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+            middle = begin + count / 2;
+            std::nth_element(b.order.begin() + begin, b.order.begin() + middle, b.order.begin() + end,
+                             [&](uint32_t l, uint32_t r) { return b.centroids[l][axis] < b.centroids[r][axis]; });
+        }
+        if (middle == begin || middle == end || depth >= BVH_MAX_DEPTH)
+        {
+            node.first = begin;
+            node.count = count;
+            return;
+        }
+
+        uint32_t left = b.nodeCount.fetch_add(2);
+        node.first = left;
+        node.count = 0;
+        if (spawnDepth > 0 && count >= PARALLEL_MIN)
+        {
+            // the left subtree as a job, the right one here
+            Subtree other = { &b, left, begin, middle, depth + 1, spawnDepth - 1 };
+            std::atomic<int> pending(1);
+            JobScheduler::Job job;
+            job.run = [](void* context, size_t) {
+                Subtree& s = *(Subtree*)context;
+                buildNode(*s.b, s.index, s.begin, s.end, s.depth, s.spawnDepth);
+            };
+            job.context = &other;
+            job.counter = &pending;
+            b.jobs->submit(&job, 1);
+            buildNode(b, left + 1, middle, end, depth + 1, spawnDepth - 1);
+            b.jobs->wait(pending);
+        }
+        else
+        {
+            buildNode(b, left, begin, middle, depth + 1, 0);
+            buildNode(b, left + 1, middle, end, depth + 1, 0);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/simd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    bool empty() const { return min.x > max.x; }
+};
+
+// Model-space bounds of a loaded model, one box and sphere per mesh plus the
+// whole model. Computed once right after loading, the vertices never change.
+struct ModelBounds
+{
+    std::vector<BoundingBox> meshBoxes;
+    std::vector<BoundingSphere> meshSpheres;
+    BoundingBox box;
+    BoundingSphere sphere = { glm::vec3(0.0f), 0.0f };
+
+    // whole-model box and sphere from the per-mesh ones
+    void enclose()
+    {
+        box = BoundingBox();
+        sphere = { glm::vec3(0.0f), 0.0f };
+        for (const BoundingBox& meshBox : meshBoxes)
+        {
+            box.grow(meshBox.min);
+            box.grow(meshBox.max);
+        }
+        if (box.empty())
+            return;
+        sphere.center = (box.min + box.max) * 0.5f;
+        for (const BoundingSphere& s : meshSpheres)
+            sphere.radius = std::max(sphere.radius, glm::length(s.center - sphere.center) + s.radius);
+    }
+};
+
+// Sphere around a vertex set: centered on the box, radius from the farthest
+// vertex, which is tighter than the box's half diagonal for most meshes.
+template <typename VertexT>
+BoundingSphere sphereAround(const std::vector<VertexT>& vertices, const BoundingBox& box)
+{
+    BoundingSphere sphere = { (box.min + box.max) * 0.5f, 0.0f };
+    float radius2 = 0.0f;
+    for (const VertexT& v : vertices)
+    {
+        glm::vec3 d = v.Position - sphere.center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    sphere.radius = std::sqrt(radius2);
+    return sphere;
+}
+
+// Works on anything shaped like learnopengl's Model: meshes[i].vertices[j].Position
+template <typename ModelT>
+ModelBounds computeModelBounds(const ModelT& model)
+{
+    ModelBounds bounds;
+    bounds.meshBoxes.reserve(model.meshes.size());
+    bounds.meshSpheres.reserve(model.meshes.size());
+    for (const auto& mesh : model.meshes)
+    {
+        BoundingBox box;
+        for (const auto& v : mesh.vertices)
+            box.grow(v.Position);
+        if (box.empty())
+            box.min = box.max = glm::vec3(0.0f);
+        bounds.meshBoxes.push_back(box);
+        bounds.meshSpheres.push_back(sphereAround(mesh.vertices, box));
+    }
+    bounds.enclose();
+    return bounds;
+}
+
+// Sphere under an affine model matrix; the radius grows with the largest axis scale
+inline BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& model)
+{
+    float scale2 = std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                      glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))),
+                                      glm::dot(glm::vec3(model[2]), glm::vec3(model[2])));
+    return { glm::vec3(model * glm::vec4(sphere.center, 1.0f)), sphere.radius * std::sqrt(scale2) };
+}
+
+// The six clip planes of projection * view (Gribb & Hartmann), normalized and
+// facing inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        planes[0] = row[3] + row[0];    // left
+        planes[1] = row[3] - row[0];    // right
+        planes[2] = row[3] + row[1];    // bottom
+        planes[3] = row[3] - row[1];    // top
+        planes[4] = row[3] + row[2];    // near
+        planes[5] = row[3] - row[2];    // far
+        for (glm::vec4& p : planes)
+            p /= glm::length(glm::vec3(p));
+    }
+
+    bool intersects(const BoundingSphere& s) const
+    {
+        for (const glm::vec4& p : planes)
+            if (glm::dot(glm::vec3(p), s.center) + p.w < -s.radius)
+                return false;
+        return true;
+    }
+};
+
+// World-space spheres in structure-of-arrays form, so the test can load
+// 4 or 8 of them per plane at once.
+struct SphereBatch
+{
+    std::vector<float> x, y, z, radius;
+
+    size_t size() const { return x.size(); }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        radius.clear();
+    }
+
+    void resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+
+    void add(const BoundingSphere& s)
+    {
+        x.push_back(s.center.x);
+        y.push_back(s.center.y);
+        z.push_back(s.center.z);
+        radius.push_back(s.radius);
+    }
+
+    BoundingSphere sphere(size_t i) const { return { glm::vec3(x[i], y[i], z[i]), radius[i] }; }
+};
+
+// Appends the indices of the spheres that touch the frustum to visible,
+// in increasing order, and returns how many were appended. A sphere is
+// culled when it lies entirely behind any one plane.
+inline size_t cullSpheres(const Frustum& frustum, const SphereBatch& batch, std::vector<uint32_t>& visible)
+{
+    size_t count = batch.size(), first = visible.size(), i = 0;
+    visible.resize(first + count); // worst case, trimmed below
+    uint32_t* out = visible.data() + first;
+    const float *px = batch.x.data(), *py = batch.y.data(), *pz = batch.z.data(), *pr = batch.radius.data();
+
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    vfloat nx[6], ny[6], nz[6], nw[6];
+    for (int p = 0; p < 6; p++)
+    {
+        nx[p] = vset1(frustum.planes[p].x);
+        ny[p] = vset1(frustum.planes[p].y);
+        nz[p] = vset1(frustum.planes[p].z);
+        nw[p] = vset1(frustum.planes[p].w);
+    }
+    const int allLanes = (1 << SIMD_LANES) - 1;
+    for (; i + SIMD_LANES <= count; i += SIMD_LANES)
+    {
+        vfloat x = vload(px + i), y = vload(py + i), z = vload(pz + i);
+        vfloat r = vsub(vset1(0.0f), vload(pr + i));
+        int outside = 0;
+        for (int p = 0; p < 6 && outside != allLanes; p++)
+        {
+            vfloat d = vmuladd(nx[p], x, vmuladd(ny[p], y, vmuladd(nz[p], z, nw[p])));
+            outside |= vmask(vless(d, r));
+        }
+        int mask = ~outside & allLanes;
+        for (size_t lane = 0; lane < SIMD_LANES; lane++)
+            if (mask & (1 << lane))
+                *out++ = (uint32_t)(i + lane);
+    }
+#endif
+
+    // tail, and the whole batch without SIMD
+    for (; i < count; i++)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            inside = plane.x * px[i] + plane.y * py[i] + plane.z * pz[i] + plane.w >= -pr[i];
+        }
+        if (inside)
+            *out++ = (uint32_t)i;
+    }
+
+    size_t appended = (size_t)(out - (visible.data() + first));
+    visible.resize(first + appended);
+    return appended;
+}
+
+// Submitted / visible object counts and CPU cost of culling, per frame
+struct CullStats
+{
+    size_t submitted = 0;
+    size_t visible = 0;
+    double microseconds = 0.0;
+
+    void begin()
+    {
+        submitted = visible = 0;
+        start = std::chrono::steady_clock::now();
+    }
+
+    void end(size_t submittedCount, size_t visibleCount)
+    {
+        submitted = submittedCount;
+        visible = visibleCount;
+        microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
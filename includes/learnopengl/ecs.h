@@ -0,0 +1,444 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <learnopengl/jobs.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ============== Entities and components ==============
+// Entities are grouped by archetype, the exact set of component types they
+// have. An archetype stores its entities in fixed-size chunks, each holding
+// one array per component type (structure of arrays), so a system that
+// touches positions walks a contiguous run of positions and nothing else.
+// Destroying an entity moves the archetype's last entity into its slot, so
+// chunks stay packed.
+
+typedef uint32_t ComponentMask;         // bit i: component type i
+const int MAX_COMPONENT_TYPES = 32;
+const size_t ECS_CHUNK_BYTES = 16 * 1024;
+
+// What a chunk needs to know to move and destroy a component it holds
+struct ComponentType
+{
+    size_t size, align;
+    void (*moveConstruct)(void* to, void* from);
+    void (*destroy)(void* item);
+};
+
+inline std::vector<ComponentType>& componentTypes()
+{
+    static std::vector<ComponentType> types;
+    return types;
+}
+
+// Ids are handed out on first use; that first use (creating an entity or a
+// system with the type) must happen on one thread
+template <typename T>
+int componentId()
+{
+    static const int id = [] {
+        std::vector<ComponentType>& types = componentTypes();
+        assert(types.size() < (size_t)MAX_COMPONENT_TYPES);
+        types.push_back({ sizeof(T), alignof(T),
+                          [](void* to, void* from) { new (to) T(std::move(*(T*)from)); },
+                          [](void* item) { ((T*)item)->~T(); } });
+        return (int)types.size() - 1;
+    }();
+    return id;
+}
+
+template <typename... Ts>
+ComponentMask componentMask()
+{
+    ComponentMask mask = 0;
+    int ids[] = { componentId<Ts>()... };
+    for (int id : ids)
+        mask |= ComponentMask(1) << id;
+    return mask;
+}
+
+// A handle that goes stale when its entity is destroyed
+struct Entity
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+class Archetype
+{
+public:
+    ComponentMask mask;
+    size_t capacity;                        // entities per chunk
+    size_t entityCount = 0;
+    int32_t offsets[MAX_COMPONENT_TYPES];   // of each column in a chunk, -1 if absent
+
+    struct Chunk
+    {
+        std::unique_ptr<uint8_t[]> storage;
+        uint8_t* bytes;                     // storage aligned to 64
+        uint32_t count = 0;
+    };
+    std::vector<Chunk> chunks;
+
+    explicit Archetype(ComponentMask mask) : mask(mask)
+    {
+        const std::vector<ComponentType>& types = componentTypes();
+        size_t perEntity = sizeof(Entity), columns = 1;
+        for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+            if (mask & (ComponentMask(1) << id))
+            {
+                perEntity += types[id].size;
+                columns++;
+            }
+        // every column may lose up to 64 bytes to alignment
+        capacity = (ECS_CHUNK_BYTES - 64 * columns) / perEntity;
+        assert(capacity > 0);
+        size_t offset = capacity * sizeof(Entity);
+        for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+        {
+            offsets[id] = -1;
+            if (!(mask & (ComponentMask(1) << id)))
+                continue;
+            offset = (offset + 63) & ~size_t(63);
+            offsets[id] = (int32_t)offset;
+            offset += capacity * types[id].size;
+        }
+    }
+
+    ~Archetype()
+    {
+        for (Chunk& chunk : chunks)
+            for (uint32_t row = 0; row < chunk.count; row++)
+                destroyRow(chunk, row);
+    }
+
+    Entity* entities(const Chunk& chunk) const { return (Entity*)chunk.bytes; }
+    void* component(const Chunk& chunk, int id, uint32_t row) const
+    {
+        return chunk.bytes + offsets[id] + row * componentTypes()[id].size;
+    }
+
+    // A free row at the end; the caller constructs its components
+    void allocate(Entity entity, uint32_t& chunkIndex, uint32_t& row)
+    {
+        if (chunks.empty() || chunks.back().count == capacity)
+        {
+            Chunk chunk;
+            chunk.storage.reset(new uint8_t[ECS_CHUNK_BYTES + 63]);
+            chunk.bytes = (uint8_t*)(((uintptr_t)chunk.storage.get() + 63) & ~uintptr_t(63));
+            chunks.push_back(std::move(chunk));
+        }
+        chunkIndex = (uint32_t)chunks.size() - 1;
+        row = chunks.back().count++;
+        entities(chunks.back())[row] = entity;
+        entityCount++;
+    }
+
+    // Destroys a row and moves the last entity into it; returns that entity,
+    // or an invalid one if the row was the last
+    Entity remove(uint32_t chunkIndex, uint32_t row)
+    {
+        Chunk& chunk = chunks[chunkIndex];
+        Chunk& last = chunks.back();
+        uint32_t lastRow = last.count - 1;
+        destroyRow(chunk, row);
+        Entity moved;
+        if (&chunk != &last || row != lastRow)
+        {
+            const std::vector<ComponentType>& types = componentTypes();
+            for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+                if (offsets[id] >= 0)
+                {
+                    types[id].moveConstruct(component(chunk, id, row), component(last, id, lastRow));
+                    types[id].destroy(component(last, id, lastRow));
+                }
+            moved = entities(last)[lastRow];
+            entities(chunk)[row] = moved;
+        }
+        if (--last.count == 0)
+            chunks.pop_back();
+        entityCount--;
+        return moved;
+    }
+
+private:
+    void destroyRow(Chunk& chunk, uint32_t row)
+    {
+        const std::vector<ComponentType>& types = componentTypes();
+        for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+            if (offsets[id] >= 0)
+                types[id].destroy(component(chunk, id, row));
+    }
+};
+
+// One chunk of a query's result: count entities and their columns
+struct ChunkView
+{
+    Archetype* archetype = nullptr;
+    uint32_t chunk = 0, count = 0;
+
+    const Entity* entities() const { return archetype->entities(archetype->chunks[chunk]); }
+
+    // null if the archetype lacks T
+    template <typename T>
+    T* column() const
+    {
+        int id = componentId<T>();
+        if (archetype->offsets[id] < 0)
+            return nullptr;
+        return (T*)(archetype->chunks[chunk].bytes + archetype->offsets[id]);
+    }
+};
+
+class World
+{
+public:
+    template <typename... Ts>
+    Entity create(Ts... components)
+    {
+        Archetype& archetype = findArchetype(componentMask<Ts...>());
+        Entity entity;
+        if (!freeIndices.empty())
+        {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        }
+        else
+        {
+            entity.index = (uint32_t)locations.size();
+            locations.emplace_back();
+        }
+        Location& location = locations[entity.index];
+        entity.generation = location.generation;
+        location.archetype = &archetype;
+        archetype.allocate(entity, location.chunk, location.row);
+        const Archetype::Chunk& chunk = archetype.chunks[location.chunk];
+        void* targets[] = { archetype.component(chunk, componentId<Ts>(), location.row)... };
+        construct(targets, std::move(components)...);
+        liveCount++;
+        return entity;
+    }
+
+    void destroy(Entity entity)
+    {
+        if (!alive(entity))
+            return;
+        Location& location = locations[entity.index];
+        Entity moved = location.archetype->remove(location.chunk, location.row);
+        if (moved.index != UINT32_MAX)
+        {
+            locations[moved.index].chunk = location.chunk;
+            locations[moved.index].row = location.row;
+        }
+        location.archetype = nullptr;
+        location.generation++;
+        freeIndices.push_back(entity.index);
+        liveCount--;
+    }
+
+    bool alive(Entity entity) const
+    {
+        return entity.index < locations.size() && locations[entity.index].generation == entity.generation &&
+               locations[entity.index].archetype != nullptr;
+    }
+
+    // null if the entity is gone or lacks T; safe from systems, which may
+    // not create or destroy entities while they run
+    template <typename T>
+    T* get(Entity entity) const
+    {
+        if (!alive(entity))
+            return nullptr;
+        const Location& location = locations[entity.index];
+        int id = componentId<T>();
+        if (location.archetype->offsets[id] < 0)
+            return nullptr;
+        return (T*)location.archetype->component(location.archetype->chunks[location.chunk], id, location.row);
+    }
+
+    size_t size() const { return liveCount; }
+    size_t archetypeCount() const { return archetypes.size(); }
+
+    // Every chunk of every archetype with all components in required
+    void query(ComponentMask required, std::vector<ChunkView>& chunks) const
+    {
+        chunks.clear();
+        for (const std::unique_ptr<Archetype>& archetype : archetypes)
+            if ((archetype->mask & required) == required)
+                for (uint32_t c = 0; c < archetype->chunks.size(); c++)
+                    chunks.push_back({ archetype.get(), c, archetype->chunks[c].count });
+    }
+
+    // f(entity, components...) for every entity with Ts, on this thread
+    template <typename... Ts, typename F>
+    void each(F f) const
+    {
+        std::vector<ChunkView> chunks;
+        query(componentMask<Ts...>(), chunks);
+        for (const ChunkView& chunk : chunks)
+            for (uint32_t i = 0; i < chunk.count; i++)
+                f(chunk.entities()[i], chunk.column<Ts>()[i]...);
+    }
+
+private:
+    struct Location
+    {
+        Archetype* archetype = nullptr;
+        uint32_t chunk = 0, row = 0;
+        uint32_t generation = 0;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::vector<Location> locations;    // by entity index
+    std::vector<uint32_t> freeIndices;
+    size_t liveCount = 0;
+
+    Archetype& findArchetype(ComponentMask mask)
+    {
+        for (const std::unique_ptr<Archetype>& archetype : archetypes)
+            if (archetype->mask == mask)
+                return *archetype;
+        archetypes.emplace_back(new Archetype(mask));
+        return *archetypes.back();
+    }
+
+    static void construct(void**) {}
+
+    template <typename T, typename... Rest>
+    static void construct(void** targets, T&& component, Rest&&... rest)
+    {
+        new (targets[0]) typename std::decay<T>::type(std::forward<T>(component));
+        construct(targets + 1, std::forward<Rest>(rest)...);
+    }
+};
+
+// ============== Systems ==============
+// A system runs over every entity with its query components, one job per
+// chunk, and declares every component type it reads and writes, including
+// ones of other entities it looks up. Two systems conflict if one writes
+// what the other reads or writes; a system waits for the earlier systems of
+// its graph it conflicts with and runs alongside the rest.
+struct System
+{
+    std::string name;
+    ComponentMask query = 0;
+    ComponentMask reads = 0, writes = 0;
+    std::function<void(const ChunkView&)> run;  // called for chunks concurrently
+};
+
+inline bool systemsConflict(const System& a, const System& b)
+{
+    return (a.writes & (b.reads | b.writes)) != 0 || (b.writes & a.reads) != 0;
+}
+
+// Systems in the order they were added, run as a dependency graph on a job
+// scheduler: when the last chunk of a system is done, the job that finished
+// it starts the systems that were only waiting for it. The world must not
+// change shape (create or destroy entities) during run().
+class SystemGraph
+{
+public:
+    void add(System system)
+    {
+        std::unique_ptr<Node> node(new Node());
+        node->system = std::move(system);
+        node->graph = this;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (systemsConflict(nodes[i]->system, node->system))
+            {
+                nodes[i]->dependents.push_back(nodes.size());
+                node->dependencies.push_back(i);
+            }
+        nodes.push_back(std::move(node));
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    void run(World& world, JobScheduler& jobs)
+    {
+        scheduler = &jobs;
+        unfinished = (int)nodes.size();
+        for (std::unique_ptr<Node>& node : nodes)
+        {
+            world.query(node->system.query, node->chunks);
+            node->waiting = (int)node->dependencies.size();
+            node->remaining = (int)node->chunks.size();
+        }
+        for (std::unique_ptr<Node>& node : nodes)
+            if (node->dependencies.empty())
+                launch(*node);
+        jobs.wait(unfinished);
+    }
+
+    // Which system waits for which
+    void print(const char* name) const
+    {
+        std::printf("%s: %zu systems\n", name, nodes.size());
+        for (const std::unique_ptr<Node>& node : nodes)
+        {
+            std::string after;
+            for (size_t d : node->dependencies)
+                after += (after.empty() ? " after " : ", ") + nodes[d]->system.name;
+            std::printf("  %s%s\n", node->system.name.c_str(), after.empty() ? ", no wait" : after.c_str());
+        }
+    }
+
+private:
+    struct Node
+    {
+        System system;
+        SystemGraph* graph = nullptr;
+        std::vector<size_t> dependencies, dependents;
+        std::vector<ChunkView> chunks;
+        std::vector<JobScheduler::Job> jobs;
+        std::atomic<int> waiting{ 0 }, remaining{ 0 };
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    JobScheduler* scheduler = nullptr;
+    std::atomic<int> unfinished{ 0 };
+
+    void launch(Node& node)
+    {
+        if (node.chunks.empty())
+        {
+            finish(node);
+            return;
+        }
+        node.jobs.resize(node.chunks.size());
+        for (size_t c = 0; c < node.chunks.size(); c++)
+            node.jobs[c] = { &SystemGraph::runChunk, &node, c, nullptr };
+        scheduler->submit(node.jobs.data(), node.jobs.size());
+    }
+
+    static void runChunk(void* context, size_t index)
+    {
+        Node& node = *(Node*)context;
+        node.system.run(node.chunks[index]);
+        if (node.remaining.fetch_sub(1) == 1)
+            node.graph->finish(node);
+    }
+
+    void finish(Node& node)
+    {
+        for (size_t d : node.dependents)
+            if (nodes[d]->waiting.fetch_sub(1) == 1)
+                launch(*nodes[d]);
+        unfinished.fetch_sub(1);
+    }
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Logging that can stay on in the frame loops. log() copies a call site and
+// up to LOG_MAX_ARGS arguments into a 64-byte record on the calling thread's
+// ring, a lock-free single-producer single-consumer queue, and returns. A
+// writer thread drains the rings every few milliseconds, formats the records
+// in time order with snprintf and writes them out, so the logging thread
+// never formats, locks or waits for I/O. A full ring drops the record and
+// counts it instead of blocking.
+//
+// Each call site is a static LogSite holding its level, printf format and
+// limits, and belongs to one log. perSecond caps the records a second; with
+// dedupSeconds, a record with the same arguments as the last one admitted is
+// suppressed until they change or that much time has passed. Suppressed
+// records are counted: the next line of the site says how many came before
+// it, and a flush reports the rest.
+//
+// Arguments are copied as they are, so they must be numbers, enums or
+// pointers; a string must outlive the log, as literals do.
+
+enum LogLevel { LOG_TRACE, LOG_INFO, LOG_WARNING, LOG_ERROR };
+
+const size_t LOG_MAX_ARGS = 4;
+
+struct LogSite
+{
+    LogSite(LogLevel level, const char* format, unsigned int perSecond = 0, float dedupSeconds = 0.0f)
+        : level(level), format(format), perSecond(perSecond), dedupNanos((uint64_t)(dedupSeconds * 1e9f))
+    {
+    }
+
+    const LogLevel level;
+    const char* const format;
+    const unsigned int perSecond;   // 0: no limit
+    const uint64_t dedupNanos;      // 0: no deduplication
+
+    // Whether a record made at now with these arguments gets written. The
+    // limits are approximate when several threads log here at once.
+    bool admit(uint64_t hash, uint64_t now)
+    {
+        if (dedupNanos && hash == lastHash.load(std::memory_order_relaxed) &&
+            now - lastTime.load(std::memory_order_relaxed) < dedupNanos)
+        {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (perSecond)
+        {
+            uint64_t second = now / 1000000000ull;
+            if (window.load(std::memory_order_relaxed) != second)
+            {
+                window.store(second, std::memory_order_relaxed);
+                windowCount.store(0, std::memory_order_relaxed);
+            }
+            if (windowCount.load(std::memory_order_relaxed) >= perSecond ||
+                windowCount.fetch_add(1, std::memory_order_relaxed) >= perSecond)
+            {
+                suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        if (dedupNanos)
+        {
+            lastHash.store(hash, std::memory_order_relaxed);
+            lastTime.store(now, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    std::atomic<uint64_t> window{ 0 }, lastHash{ 0 }, lastTime{ 0 };
+    std::atomic<unsigned int> windowCount{ 0 };
+    std::atomic<unsigned int> suppressed{ 0 };      // since the last record admitted
+    bool known = false;                             // by the writer of the log using the site
+};
+
+// A call of log(): the site, a function formatting the arguments as the
+// types they were given with, and the arguments, one 8-byte slot each
+struct LogRecord
+{
+    LogSite* site;
+    int (*format)(const LogRecord& record, char* out, size_t size);
+    uint64_t time;          // steady clock, nanoseconds
+    unsigned int thread;    // filled in by the writer
+    unsigned int skipped;   // records of the site suppressed before this one
+    uint64_t args[LOG_MAX_ARGS];
+};
+static_assert(sizeof(LogRecord) <= 64, "a log record is one cache line");
+
+class EventLog
+{
+public:
+    // ringRecords per logging thread, rounded up to a power of two
+    explicit EventLog(FILE* out = stdout, size_t ringRecords = 4096)
+        : out(out), capacity(1), id(++nextId), start(now())
+    {
+        while (capacity < ringRecords)
+            capacity *= 2;
+        batch.reserve(capacity);
+        writer = std::thread(&EventLog::writerLoop, this);
+    }
+
+    ~EventLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    // Records below level are dropped at the call, before anything is copied
+    void setLevel(LogLevel level) { minimum.store(level, std::memory_order_relaxed); }
+
+    // Queues a record of site; false if it was filtered, suppressed or the
+    // ring was full
+    template <typename... Args>
+    bool log(LogSite& site, Args... args)
+    {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+        if (site.level < minimum.load(std::memory_order_relaxed))
+            return false;
+        LogRecord record = {};
+        record.site = &site;
+        record.format = &formatRecord<Args...>;
+        record.time = now();
+        size_t slot = 0;
+        (store(record, slot++, args), ...);
+        if (site.dedupNanos || site.perSecond)
+        {
+            if (!site.admit(hashArgs(record), record.time))
+                return false;
+            record.skipped = site.suppressed.exchange(0, std::memory_order_relaxed);
+        }
+
+        Ring& ring = threadRing();
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.cachedTail >= capacity)
+        {
+            ring.cachedTail = ring.tail.load(std::memory_order_acquire);
+            if (head - ring.cachedTail >= capacity)
+            {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                site.suppressed.fetch_add(record.skipped, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        ring.records[head & (capacity - 1)] = record;
+        ring.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Waits until everything logged before the call is written out
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t request = ++flushRequests;
+        wake.notify_one();
+        flushed.wait(lock, [&] { return flushesDone >= request; });
+    }
+
+    unsigned long long written() const { return writtenCount.load(); }
+    unsigned long long suppressed() const { return suppressedCount.load(); }
+    unsigned long long dropped() const { return droppedCount.load(); }
+
+private:
+    struct Ring
+    {
+        Ring(size_t capacity, unsigned int thread) : records(capacity), thread(thread), owner(std::this_thread::get_id()) {}
+
+        std::vector<LogRecord> records;
+        const unsigned int thread;
+        const std::thread::id owner;
+        alignas(64) std::atomic<uint64_t> head{ 0 };    // producer
+        uint64_t cachedTail = 0;                        // producer's last look at tail
+        std::atomic<unsigned long long> dropped{ 0 };
+        alignas(64) std::atomic<uint64_t> tail{ 0 };    // writer
+    };
+
+    FILE* out;
+    size_t capacity;
+    const uint64_t id;
+    const uint64_t start;
+    std::atomic<int> minimum{ LOG_TRACE };
+
+    std::mutex mutex;                           // rings, flushes and quit
+    std::condition_variable wake, flushed;
+    std::vector<std::unique_ptr<Ring>> rings;
+    uint64_t flushRequests = 0, flushesDone = 0;
+    bool quit = false;
+    std::thread writer;
+
+    // the writer's
+    std::vector<Ring*> draining;
+    std::vector<LogRecord> batch;
+    std::vector<LogSite*> sites;
+    std::atomic<unsigned long long> writtenCount{ 0 }, suppressedCount{ 0 }, droppedCount{ 0 };
+
+    static inline std::atomic<uint64_t> nextId{ 0 };
+
+    static uint64_t now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    template <typename T>
+    static void store(LogRecord& record, size_t slot, T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(uint64_t),
+                      "log arguments are numbers, enums or pointers");
+        std::memcpy(&record.args[slot], &value, sizeof(T));
+    }
+
+    template <typename T>
+    static T load(const LogRecord& record, size_t slot)
+    {
+        T value;
+        std::memcpy(&value, &record.args[slot], sizeof(T));
+        return value;
+    }
+
+    template <typename... Args, size_t... I>
+    static int formatArgs(const LogRecord& record, char* out, size_t size, std::index_sequence<I...>)
+    {
+        // the extra argument is ignored; it spares a format without any
+        // arguments the non-literal format warning
+        return std::snprintf(out, size, record.site->format, load<Args>(record, I)..., 0);
+    }
+
+    template <typename... Args>
+    static int formatRecord(const LogRecord& record, char* out, size_t size)
+    {
+        return formatArgs<Args...>(record, out, size, std::index_sequence_for<Args...>());
+    }
+
+    static uint64_t hashArgs(const LogRecord& record)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint64_t slot : record.args)
+            hash = (hash ^ slot) * 1099511628211ull;
+        return (hash ^ (uint64_t)(uintptr_t)record.format) * 1099511628211ull;
+    }
+
+    // The calling thread's ring, registered on its first record
+    Ring& threadRing()
+    {
+        struct Cached
+        {
+            uint64_t log;
+            Ring* ring;
+        };
+        thread_local Cached cached = { 0, nullptr };
+        if (cached.log == id)
+            return *cached.ring;
+        std::lock_guard<std::mutex> lock(mutex);
+        Ring* ring = nullptr;
+        for (const std::unique_ptr<Ring>& r : rings)
+            if (r->owner == std::this_thread::get_id())
+                ring = r.get();
+        if (!ring)
+        {
+            rings.push_back(std::make_unique<Ring>(capacity, (unsigned int)rings.size()));
+            ring = rings.back().get();
+        }
+        cached = { id, ring };
+        return *ring;
+    }
+
+    static const char* prefix(LogLevel level)
+    {
+        switch (level)
+        {
+        case LOG_TRACE: return "trace: ";
+        case LOG_WARNING: return "WARNING: ";
+        case LOG_ERROR: return "ERROR: ";
+        default: return "";
+        }
+    }
+
+    void writerLoop()
+    {
+        for (;;)
+        {
+            uint64_t requests;
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return quit || flushRequests > flushesDone; });
+                requests = flushRequests;
+                stopping = quit;
+                draining.clear();
+                for (const std::unique_ptr<Ring>& ring : rings)
+                    draining.push_back(ring.get());
+            }
+            drain(requests > flushesDone || stopping);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                flushesDone = requests;
+            }
+            flushed.notify_all();
+            if (stopping)
+                return;
+        }
+    }
+
+    // Writes out every queued record, and with reportAll the records
+    // suppressed since the last one admitted at each site
+    void drain(bool reportAll)
+    {
+        batch.clear();
+        unsigned long long lost = 0;
+        for (Ring* ring : draining)
+        {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail != head; tail++)
+            {
+                batch.push_back(ring->records[tail & (capacity - 1)]);
+                batch.back().thread = ring->thread;
+            }
+            ring->tail.store(head, std::memory_order_release);
+            lost += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        std::sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) {
+            return a.time != b.time ? a.time < b.time : a.thread < b.thread;
+        });
+
+        char text[512];
+        for (const LogRecord& record : batch)
+        {
+            LogSite& site = *record.site;
+            if (!site.known)
+            {
+                site.known = true;
+                sites.push_back(&site);
+            }
+            record.format(record, text, sizeof(text));
+            suppressedCount += record.skipped;
+            if (record.skipped)
+                std::fprintf(out, "[%9.3f t%u] %s%s (after %u suppressed)\n", seconds(record.time), record.thread, prefix(site.level), text, record.skipped);
+            else
+                std::fprintf(out, "[%9.3f t%u] %s%s\n", seconds(record.time), record.thread, prefix(site.level), text);
+        }
+        writtenCount += batch.size();
+        if (reportAll)
+        {
+            for (LogSite* site : sites)
+                if (unsigned int skipped = site->suppressed.exchange(0, std::memory_order_relaxed))
+                {
+                    suppressedCount += skipped;
+                    std::fprintf(out, "[%9.3f] %u more suppressed: %s%s\n", seconds(now()), skipped, prefix(site->level), site->format);
+                }
+        }
+        if (lost)
+        {
+            droppedCount += lost;
+            std::fprintf(out, "[%9.3f] LOG::DROPPED: %llu records, the rings were full\n", seconds(now()), lost);
+        }
+        if (!batch.empty() || lost || reportAll)
+            std::fflush(out);
+    }
+
+    double seconds(uint64_t time) const { return (double)(int64_t)(time - start) / 1e9; }
+};
+
+#endif
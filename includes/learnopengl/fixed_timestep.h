@@ -0,0 +1,47 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <algorithm>
+#include <cmath>
+
+// Fixed-rate simulation clock ("Fix Your Timestep!", Glenn Fiedler).
+// advance() banks each frame's elapsed time and returns how many whole steps
+// to run; the remainder carries over to the next frame and alpha() tells the
+// renderer how far it is between the last two simulation states. When a
+// frame would need more than maxSteps steps (a hitch, a debugger break) the
+// excess is dropped instead of caught up, since catching up makes the next
+// frame slower still and the game never recovers.
+class FixedTimestep
+{
+public:
+    const double step;
+    const int maxSteps;
+    double dropped = 0.0;           // seconds thrown away by the guard
+    unsigned long long total = 0;   // steps run so far
+
+    explicit FixedTimestep(double step, int maxSteps = 8) : step(step), maxSteps(maxSteps) {}
+
+    int advance(double elapsed)
+    {
+        if (elapsed > 0.0)
+            accumulator += elapsed;
+        int steps = (int)std::floor(accumulator / step);
+        if (steps > maxSteps)
+        {
+            dropped += (steps - maxSteps) * step;
+            accumulator -= (steps - maxSteps) * step;
+            steps = maxSteps;
+        }
+        accumulator -= steps * step;
+        total += steps;
+        return steps;
+    }
+
+    // 0 at the previous state, 1 at the current one
+    float alpha() const { return (float)std::min(std::max(accumulator / step, 0.0), 1.0); }
+
+private:
+    double accumulator = 0.0;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler. Every thread, the one that created the
+// scheduler included, owns a queue: it pushes and pops its own jobs at the
+// back, most recent first while they are still in cache, and idle threads
+// steal the oldest job from the front of another queue. A job may submit
+// more jobs, e.g. the next system of a graph when its last chunk is done.
+// Waiting on a counter runs jobs instead of blocking, so the caller is one
+// of the workers and a scheduler of one thread runs everything inline.
+class JobScheduler
+{
+public:
+    // A job is a function pointer with a context and an index; finishing it
+    // decrements counter, if any
+    struct Job
+    {
+        void (*run)(void* context, size_t index) = nullptr;
+        void* context = nullptr;
+        size_t index = 0;
+        std::atomic<int>* counter = nullptr;
+    };
+
+    explicit JobScheduler(unsigned int threads = std::thread::hardware_concurrency())
+        : queues(std::max(threads, 1u))
+    {
+        owner() = { this, 0 };
+        for (unsigned int t = 1; t < queues.size(); t++)
+            workers.emplace_back(&JobScheduler::workerLoop, this, t);
+    }
+
+    ~JobScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        if (owner().scheduler == this)
+            owner() = { nullptr, 0 };
+    }
+
+    unsigned int threadCount() const { return (unsigned int)queues.size(); }
+
+    // Queues jobs on the calling thread's queue; their counter must already
+    // include them
+    void submit(const Job* jobs, size_t count)
+    {
+        if (count == 0)
+            return;
+        Queue& queue = queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.insert(queue.jobs.end(), jobs, jobs + count);
+        }
+        queued += (int)count;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex); // no lost wake-up
+        }
+        if (count == 1)
+            wake.notify_one();
+        else
+            wake.notify_all();
+    }
+
+    // Runs jobs until counter reaches zero
+    void wait(std::atomic<int>& counter)
+    {
+        unsigned int self = threadIndex();
+        while (counter.load(std::memory_order_acquire) > 0)
+        {
+            Job job;
+            if (take(self, job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // f(i) for every i in [0, count), one job each, and waits for them
+    template <typename F>
+    void parallelFor(size_t count, F& f)
+    {
+        std::atomic<int> counter((int)count);
+        std::vector<Job> jobs(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            jobs[i].run = [](void* context, size_t index) { (*(F*)context)(index); };
+            jobs[i].context = (void*)&f;
+            jobs[i].index = i;
+            jobs[i].counter = &counter;
+        }
+        submit(jobs.data(), jobs.size());
+        wait(counter);
+    }
+
+    // f(begin, end) over [0, count) in one range per thread at most, each at
+    // least minChunk long and starting on a multiple of align (e.g. a SIMD
+    // batch), and waits for them. A single range runs inline.
+    template <typename F>
+    void parallelFor(size_t count, size_t minChunk, F&& f, size_t align = 1)
+    {
+        size_t chunks = std::min<size_t>(threadCount(), (count + minChunk - 1) / std::max<size_t>(minChunk, 1));
+        if (chunks <= 1)
+        {
+            f((size_t)0, count);
+            return;
+        }
+        size_t chunk = (count + chunks - 1) / chunks;
+        chunk = (chunk + align - 1) / align * align;
+        auto range = [&](size_t i) { f(i * chunk, std::min(count, (i + 1) * chunk)); };
+        parallelFor((count + chunk - 1) / chunk, range);
+    }
+
+    unsigned long long steals() const { return stolen.load(); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    struct Owner
+    {
+        JobScheduler* scheduler;
+        unsigned int index;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{ 0 };
+    std::atomic<unsigned long long> stolen{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quit = false;
+
+    static Owner& owner()
+    {
+        thread_local Owner current = { nullptr, 0 };
+        return current;
+    }
+
+    // threads outside the scheduler share the creating thread's queue
+    unsigned int threadIndex() const { return owner().scheduler == this ? owner().index : 0; }
+
+    bool take(unsigned int self, Job& job)
+    {
+        if (queued.load(std::memory_order_acquire) == 0)
+            return false;
+        {
+            Queue& own = queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++)
+        {
+            Queue& victim = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                queued--;
+                stolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void execute(const Job& job)
+    {
+        job.run(job.context, job.index);
+        if (job.counter)
+            job.counter->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        owner() = { this, index };
+        for (;;)
+        {
+            Job job;
+            if (take(index, job))
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return quit || queued.load() > 0; });
+            if (quit)
+                return;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ---- quadric error simplification -----------------------------------------
+
+// Sum of squared distances to a set of planes, weighted by the area they came
+// from (Garland & Heckbert, "Surface Simplification Using Quadric Error
+// Metrics"). The symmetric 4x4 matrix is kept as its 10 distinct entries.
+struct Quadric
+{
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    // plane n.p + d = 0 with unit normal n
+    static Quadric plane(double a, double b, double c, double d, double weight)
+    {
+        Quadric q;
+        q.a2 = a * a * weight; q.ab = a * b * weight; q.ac = a * c * weight; q.ad = a * d * weight;
+        q.b2 = b * b * weight; q.bc = b * c * weight; q.bd = b * d * weight;
+        q.c2 = c * c * weight; q.cd = c * d * weight;
+        q.d2 = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    void add(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd; d2 += q.d2; weight += q.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double sum = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+                     b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                     c2 * z * z + 2 * cd * z + d2;
+        return weight > 0 ? std::max(sum, 0.0) / weight : 0.0;
+    }
+};
+
+// Simplifies an indexed triangle list towards targetTriangles by collapsing
+// edges onto one of their two ends, cheapest first, so the result indexes
+// the same vertices and shares the vertex buffer of the full mesh.
+// Vertices are welded by position first, so hard edges and UV seams, where
+// the loader split vertices, can still collapse; each corner then takes the
+// vertex at its new position whose normal and UV are closest to its own.
+// Open borders stay fixed and collapses that would flip a triangle are
+// skipped. Returns the largest error accepted, as an RMS distance in model
+// units.
+template <typename VertexT>
+float simplifyMesh(const std::vector<VertexT>& vertices, const std::vector<uint32_t>& indices,
+                   size_t targetTriangles, std::vector<uint32_t>& out)
+{
+    // weld by position
+    std::vector<uint32_t> groupOf(vertices.size());
+    std::vector<glm::vec3> position;
+    {
+        std::unordered_map<std::string, uint32_t> seen;
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            std::string key((const char*)&vertices[v].Position, sizeof(glm::vec3));
+            auto inserted = seen.emplace(key, (uint32_t)position.size());
+            if (inserted.second)
+                position.push_back(vertices[v].Position);
+            groupOf[v] = inserted.first->second;
+        }
+    }
+    size_t groups = position.size();
+    std::vector<std::vector<uint32_t>> groupVertices(groups);
+    for (uint32_t v = 0; v < vertices.size(); v++)
+        groupVertices[groupOf[v]].push_back(v);
+
+    // triangles over groups, corners remember their vertex
+    struct Triangle
+    {
+        uint32_t corner[3];
+        uint32_t group[3];
+        bool alive;
+    };
+    std::vector<Triangle> triangles;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        Triangle t;
+        for (int k = 0; k < 3; k++)
+        {
+            t.corner[k] = indices[i + k];
+            t.group[k] = groupOf[indices[i + k]];
+        }
+        t.alive = t.group[0] != t.group[1] && t.group[1] != t.group[2] && t.group[0] != t.group[2];
+        if (t.alive)
+            triangles.push_back(t);
+    }
+    size_t aliveCount = triangles.size();
+
+    auto edgeKey = [](uint32_t a, uint32_t b) { return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a; };
+    std::vector<std::vector<uint32_t>> around(groups);
+    std::vector<Quadric> quadrics(groups);
+    std::vector<bool> locked(groups, false);
+    std::unordered_map<uint64_t, uint32_t> edgeUse;
+    for (uint32_t t = 0; t < triangles.size(); t++)
+    {
+        const Triangle& tri = triangles[t];
+        glm::vec3 p0 = position[tri.group[0]], p1 = position[tri.group[1]], p2 = position[tri.group[2]];
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        double length = std::sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+        Quadric q;
+        if (length > 0)
+        {
+            double a = n.x / length, b = n.y / length, c = n.z / length;
+            q = Quadric::plane(a, b, c, -(a * p0.x + b * p0.y + c * p0.z), length * 0.5);
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            around[tri.group[k]].push_back(t);
+            quadrics[tri.group[k]].add(q);
+            edgeUse[edgeKey(tri.group[k], tri.group[(k + 1) % 3])]++;
+        }
+    }
+    // borders (one triangle) and non-manifold edges (more than two) keep
+    // their ends in place
+    for (const auto& edge : edgeUse)
+        if (edge.second != 2)
+            locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = true;
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t versionFrom, versionTo;
+        bool operator<(const Collapse& other) const { return cost > other.cost; } // cheapest on top
+    };
+    std::priority_queue<Collapse> heap;
+    std::vector<uint32_t> version(groups, 0);
+    std::vector<bool> removed(groups, false);
+    auto consider = [&](uint32_t a, uint32_t b) {
+        for (int direction = 0; direction < 2; direction++)
+        {
+            uint32_t from = direction ? b : a, to = direction ? a : b;
+            if (locked[from])
+                continue;
+            Quadric q = quadrics[from];
+            q.add(quadrics[to]);
+            heap.push({ q.error(position[to]), from, to, version[from], version[to] });
+        }
+    };
+    for (const auto& edge : edgeUse)
+        consider((uint32_t)(edge.first >> 32), (uint32_t)(edge.first & 0xffffffffu));
+
+    double worst = 0.0;
+    std::vector<uint32_t> neighbours, ringFrom, ringTo;
+    while (aliveCount > targetTriangles && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+        if (removed[c.from] || removed[c.to] || version[c.from] != c.versionFrom || version[c.to] != c.versionTo)
+            continue;
+
+        // The two ends may only share the neighbours across the triangles
+        // on the edge (the link condition), or the collapse would fold two
+        // triangles onto each other
+        auto ring = [&](uint32_t g, std::vector<uint32_t>& out) {
+            out.clear();
+            for (uint32_t t : around[g])
+                if (triangles[t].alive)
+                    for (int k = 0; k < 3; k++)
+                        if (triangles[t].group[k] != g)
+                            out.push_back(triangles[t].group[k]);
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        };
+        ring(c.from, ringFrom);
+        ring(c.to, ringTo);
+        size_t shared = 0, common = 0;
+        for (uint32_t t : around[c.from])
+        {
+            const Triangle& tri = triangles[t];
+            if (tri.alive && (tri.group[0] == c.to || tri.group[1] == c.to || tri.group[2] == c.to))
+                shared++;
+        }
+        for (size_t i = 0, j = 0; i < ringFrom.size() && j < ringTo.size();)
+        {
+            if (ringFrom[i] < ringTo[j])
+                i++;
+            else if (ringTo[j] < ringFrom[i])
+                j++;
+            else
+            {
+                common++;
+                i++;
+                j++;
+            }
+        }
+        if (common != shared)
+            continue;
+
+        // and must not turn any remaining triangle over, by more than about
+        // 75 degrees, or into a sliver
+        bool flips = false;
+        for (uint32_t t : around[c.from])
+        {
+            const Triangle& tri = triangles[t];
+            if (!tri.alive || tri.group[0] == c.to || tri.group[1] == c.to || tri.group[2] == c.to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = position[tri.group[k]];
+                q[k] = tri.group[k] == c.from ? position[c.to] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            glm::vec3 e0 = q[1] - q[0], e1 = q[2] - q[1], e2 = q[0] - q[2];
+            float longest = std::max(std::max(glm::dot(e0, e0), glm::dot(e1, e1)), glm::dot(e2, e2));
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after) ||
+                glm::length(after) <= 1e-3f * longest)
+            {
+                flips = true;
+                break;
+            }
+        }
+        if (flips)
+            continue;
+
+        worst = std::max(worst, c.cost);
+        for (uint32_t t : around[c.from])
+        {
+            Triangle& tri = triangles[t];
+            if (!tri.alive)
+                continue;
+            if (tri.group[0] == c.to || tri.group[1] == c.to || tri.group[2] == c.to)
+            {
+                tri.alive = false;
+                aliveCount--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+                if (tri.group[k] == c.from)
+                    tri.group[k] = c.to;
+            around[c.to].push_back(t);
+        }
+        around[c.from].clear();
+        removed[c.from] = true;
+        quadrics[c.to].add(quadrics[c.from]);
+        version[c.to]++;
+
+        // drop dead triangles and requeue the edges around to
+        std::vector<uint32_t>& list = around[c.to];
+        list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t) { return !triangles[t].alive; }), list.end());
+        neighbours.clear();
+        for (uint32_t t : list)
+            for (int k = 0; k < 3; k++)
+                if (triangles[t].group[k] != c.to)
+                    neighbours.push_back(triangles[t].group[k]);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (uint32_t n : neighbours)
+            consider(c.to, n);
+    }
+
+    // each corner takes the closest matching vertex at its new position
+    auto match = [&](uint32_t corner, uint32_t group) {
+        if (groupOf[corner] == group)
+            return corner;
+        const VertexT& original = vertices[corner];
+        uint32_t best = groupVertices[group][0];
+        float bestScore = -1e30f;
+        for (uint32_t v : groupVertices[group])
+        {
+            glm::vec2 uv = vertices[v].TexCoords - original.TexCoords;
+            float score = glm::dot(vertices[v].Normal, original.Normal) - std::sqrt(glm::dot(uv, uv));
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = v;
+            }
+        }
+        return best;
+    };
+    out.clear();
+    for (const Triangle& tri : triangles)
+        if (tri.alive)
+            for (int k = 0; k < 3; k++)
+                out.push_back(match(tri.corner[k], tri.group[k]));
+    return (float)std::sqrt(worst);
+}
+
+// Simplified levels of a mesh for the cooked cache: each aims at half the
+// triangles of the one before, stopping at MAX_MESH_LODS levels, below
+// LOD_MIN_TRIANGLES, or when a level saves less than a tenth (what is left
+// is pinned by borders). Their indices are appended to the encoded index
+// buffer after the full mesh. A level's error is the largest of its own and
+// the finer levels', so errors grow with the level.
+const size_t LOD_MIN_TRIANGLES = 64;
+
+template <typename MeshT>
+void buildMeshLods(const MeshT& mesh, EncodedMesh& encoded)
+{
+    std::vector<uint32_t> current(mesh.indices.begin(), mesh.indices.end()), next;
+    uint32_t first = (uint32_t)encoded.indexCount;
+    float error = 0.0f;
+    encoded.lodCount = 0;
+    while (encoded.lodCount < (uint32_t)MAX_MESH_LODS && current.size() / 3 >= LOD_MIN_TRIANGLES)
+    {
+        error = std::max(error, simplifyMesh(mesh.vertices, current, current.size() / 6, next));
+        if (next.size() > current.size() * 9 / 10)
+            break;
+        MeshLod& lod = encoded.lods[encoded.lodCount++];
+        lod.firstIndex = first;
+        lod.indexCount = (uint32_t)next.size();
+        lod.error = error;
+        first += lod.indexCount;
+        std::vector<uint8_t> narrow = narrowIndices(next, encoded.indexType);
+        encoded.indices.insert(encoded.indices.end(), narrow.begin(), narrow.end());
+        current.swap(next);
+    }
+}
+
+// Triangles of a model at each level, meshes without that many levels
+// counting at their coarsest
+inline void printLevelsOfDetail(const char* name, const PackedModel& model)
+{
+    size_t triangles[MAX_MESH_LODS + 1] = {};
+    for (const PackedMesh& mesh : model.meshes)
+        for (int level = 0; level <= MAX_MESH_LODS; level++)
+            triangles[level] += mesh.levelIndexCount(std::min(level, (int)mesh.lodCount)) / 3;
+    std::printf("%-8s triangles per level of detail: %zu", name, triangles[0]);
+    for (int level = 1; level <= MAX_MESH_LODS; level++)
+        std::printf(" -> %zu", triangles[level]);
+    std::printf("\n");
+}
+
+// ---- selection -------------------------------------------------------------
+
+// Picks a level per object from how many pixels each level's error covers at
+// the object's distance: the coarsest level whose error stays under
+// pixelThreshold. To stop an object flickering between two levels near the
+// boundary, it only coarsens once the error is under
+// pixelThreshold * (1 - hysteresis) and only refines once it is above
+// pixelThreshold * (1 + hysteresis).
+struct LodSelector
+{
+    float pixelThreshold = 1.0f;
+    float hysteresis = 0.25f;
+    float pixelsPerUnitAtOne = 1.0f;    // viewport height / (2 tan(fovy / 2))
+
+    void setProjection(float fovyRadians, float viewportHeight)
+    {
+        pixelsPerUnitAtOne = viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f));
+    }
+
+    // Pixels per model unit of an object whose bounding sphere is at the
+    // given distance from the eye, drawn at scale
+    float pixelsPerUnit(float distance, float radius, float scale) const
+    {
+        return pixelsPerUnitAtOne * scale / std::max(distance - radius, 0.1f);
+    }
+
+    int select(const PackedMesh& mesh, int current, float pixelsPerUnit) const
+    {
+        int levels = (int)mesh.lodCount + 1;
+        current = std::min(std::max(current, 0), levels - 1);
+        // refine while the current level is clearly too coarse
+        while (current > 0 && mesh.levelError(current) * pixelsPerUnit > pixelThreshold * (1.0f + hysteresis))
+            current--;
+        // coarsen while the next level is clearly fine
+        while (current + 1 < levels && mesh.levelError(current + 1) * pixelsPerUnit < pixelThreshold * (1.0f - hysteresis))
+            current++;
+        return current;
+    }
+};
+
+#endif
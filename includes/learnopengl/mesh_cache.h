@@ -0,0 +1,598 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/culling.h>
+#include <learnopengl/lod.h>
+#include <learnopengl/vertex_format.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary mesh cache. The first load of a model goes through Assimp; the
+// packed vertex and index bytes, the mesh table (bounds, dequantization,
+// textures) are then written next to the source as <source>.meshcache.
+// Later loads map that file and hand the blobs straight to glBufferData, so
+// nothing is parsed or copied per vertex. The cache stores a hash of the
+// .obj and the .mtl files it names and is rebuilt when they change.
+//
+// File layout, little-endian, every blob 16-byte aligned:
+//   MeshCacheHeader
+//   MeshCacheRecord  x meshCount
+//   MeshCacheTexture x textureCount
+//   string blob: each string a uint32 length and its bytes
+//   vertex and index blobs
+
+// ---- memory-mapped files ---------------------------------------------------
+
+// Read-only view of a whole file
+class MappedFile
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        bytes = (size_t)length.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            bytes = (size_t)info.st_size;
+            view = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view == MAP_FAILED)
+                view = NULL;
+        }
+        ::close(fd); // the mapping keeps the file open
+#endif
+        if (!view)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (view)
+            UnmapViewOfFile(view);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view)
+            munmap(view, bytes);
+#endif
+        view = NULL;
+        bytes = 0;
+    }
+
+    const uint8_t* data() const { return (const uint8_t*)view; }
+    size_t size() const { return bytes; }
+
+private:
+    void* view = NULL;
+    size_t bytes = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// ---- source hashing --------------------------------------------------------
+
+// 64-bit FNV-1a
+inline uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hash of an .obj and every material library it references (mtllib lines).
+// A missing file hashes as empty, so creating it later invalidates the cache.
+inline uint64_t hashModelSources(const std::string& path)
+{
+    MappedFile obj;
+    if (!obj.open(path))
+        return 0;
+    uint64_t hash = hashBytes(obj.data(), obj.size());
+
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    const char* text = (const char*)obj.data();
+    const char* end = text + obj.size();
+    for (const char* line = text; line < end;)
+    {
+        const char* next = (const char*)std::memchr(line, '\n', end - line);
+        next = next ? next + 1 : end;
+        if (end - line > 7 && std::memcmp(line, "mtllib ", 7) == 0)
+        {
+            std::string name(line + 7, next);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r' || name.back() == ' '))
+                name.pop_back();
+            MappedFile library;
+            if (library.open(directory + name))
+                hash = hashBytes(library.data(), library.size(), hash);
+            hash = hashBytes((const uint8_t*)name.data(), name.size(), hash);
+        }
+        line = next;
+    }
+    return hash;
+}
+
+// ---- file format -----------------------------------------------------------
+
+const uint32_t MESH_CACHE_VERSION = 3;   // 2: levels of detail, 3: string blob
+
+struct MeshCacheHeader
+{
+    char magic[8];          // "LOGLMESH"
+    uint32_t version;
+    uint32_t vertexStride;  // sizeof(PackedVertex) when written
+    uint64_t sourceHash;
+    uint64_t fileSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint64_t stringBytes;
+};
+
+struct MeshCacheRecord
+{
+    uint64_t vertexOffset, indexOffset;
+    uint32_t vertexCount, indexCount;
+    uint32_t indexType;
+    uint32_t sourceStride;
+    uint32_t firstTexture, textureCount;
+    float positionOffset[3], positionScale[3];
+    float boxMin[3], boxMax[3];
+    float sphere[4];        // center, radius
+    uint32_t lodCount;      // levels after the full-detail indices
+    MeshLod lods[MAX_MESH_LODS];
+};
+
+// A texture reference as Assimp gave it: type and path relative to the
+// model, as offsets of their strings in the string blob
+struct MeshCacheTexture
+{
+    uint32_t type;
+    uint32_t path;
+};
+
+// Where the load time went, in milliseconds
+struct MeshCacheTimings
+{
+    bool hit = false;
+    double hash = 0.0;
+    double import = 0.0;    // Assimp, on a miss (includes its texture loads)
+    double write = 0.0;     // encoding and writing the cache, on a miss
+    double map = 0.0;       // mapping and validating the cache, on a hit
+    double upload = 0.0;
+    double textures = 0.0;  // on a hit
+    double total = 0.0;
+
+    void print(const char* name) const
+    {
+        if (hit)
+            std::printf("%-8s cache hit  %8.1f ms (hash %.1f, map %.2f, upload %.1f, textures %.1f)\n",
+                name, total, hash, map, upload, textures);
+        else
+            std::printf("%-8s cache miss %8.1f ms (hash %.1f, assimp %.1f, cook %.1f, upload %.1f)\n",
+                name, total, hash, import, write, upload);
+    }
+};
+
+// ---- reading and writing --------------------------------------------------
+
+// A texture reference of one mesh: sampler type (texture_diffuse, ...) and
+// path relative to the model's directory
+struct MeshTextureRef
+{
+    std::string type;
+    std::string path;
+};
+
+// A mapped and validated cache file. The vertex and index pointers stay
+// valid as long as the object lives.
+class CachedModel
+{
+public:
+    std::vector<MeshCacheRecord> records;
+
+    bool open(const std::string& cachePath, uint64_t hash)
+    {
+        records.clear();
+        textureTable.clear();
+        if (!file.open(cachePath) || file.size() < sizeof(MeshCacheHeader))
+            return false;
+        MeshCacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, "LOGLMESH", 8) != 0 || header.version != MESH_CACHE_VERSION ||
+            header.vertexStride != sizeof(PackedVertex) || header.sourceHash != hash || header.fileSize != file.size())
+            return fail();
+
+        uint64_t tableEnd = sizeof(MeshCacheHeader) + (uint64_t)header.meshCount * sizeof(MeshCacheRecord) +
+                            (uint64_t)header.textureCount * sizeof(MeshCacheTexture);
+        if (tableEnd > file.size() || header.stringBytes > file.size() - tableEnd)
+            return fail();
+        records.resize(header.meshCount);
+        textureTable.resize(header.textureCount);
+        std::memcpy(records.data(), file.data() + sizeof(MeshCacheHeader), records.size() * sizeof(MeshCacheRecord));
+        std::memcpy(textureTable.data(), file.data() + sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheRecord),
+                    textureTable.size() * sizeof(MeshCacheTexture));
+        strings = file.data() + tableEnd;
+        stringBytes = header.stringBytes;
+        for (const MeshCacheTexture& t : textureTable)
+            if (!validString(t.type) || !validString(t.path))
+                return fail();
+        for (const MeshCacheRecord& r : records)
+        {
+            if (r.indexType != GL_UNSIGNED_BYTE && r.indexType != GL_UNSIGNED_SHORT && r.indexType != GL_UNSIGNED_INT)
+                return fail();
+            if (r.lodCount > (uint32_t)MAX_MESH_LODS)
+                return fail();
+            uint64_t indexCount = r.indexCount;
+            for (uint32_t l = 0; l < r.lodCount; l++)
+            {
+                if (r.lods[l].firstIndex != indexCount)
+                    return fail();
+                indexCount += r.lods[l].indexCount;
+            }
+            if (r.vertexOffset + (uint64_t)r.vertexCount * sizeof(PackedVertex) > file.size() ||
+                r.indexOffset + indexCount * indexSize(r.indexType) > file.size() ||
+                (uint64_t)r.firstTexture + r.textureCount > header.textureCount)
+                return fail();
+        }
+        return true;
+    }
+
+    // sizes and dequantization of a mesh; the byte vectors stay empty
+    EncodedMesh layout(size_t mesh) const
+    {
+        const MeshCacheRecord& r = records[mesh];
+        EncodedMesh layout;
+        layout.vertexCount = r.vertexCount;
+        layout.indexCount = (GLsizei)r.indexCount;
+        layout.indexType = r.indexType;
+        layout.sourceStride = r.sourceStride;
+        layout.positionOffset = glm::vec3(r.positionOffset[0], r.positionOffset[1], r.positionOffset[2]);
+        layout.positionScale = glm::vec3(r.positionScale[0], r.positionScale[1], r.positionScale[2]);
+        layout.lodCount = r.lodCount;
+        std::copy(r.lods, r.lods + r.lodCount, layout.lods);
+        return layout;
+    }
+
+    const uint8_t* vertices(size_t mesh) const { return file.data() + records[mesh].vertexOffset; }
+    const uint8_t* indices(size_t mesh) const { return file.data() + records[mesh].indexOffset; }
+
+    std::vector<MeshTextureRef> textures(size_t mesh) const
+    {
+        std::vector<MeshTextureRef> refs;
+        const MeshCacheRecord& r = records[mesh];
+        for (uint32_t t = r.firstTexture; t < r.firstTexture + r.textureCount; t++)
+        {
+            const MeshCacheTexture& entry = textureTable[t];
+            refs.push_back({ stringAt(entry.type), stringAt(entry.path) });
+        }
+        return refs;
+    }
+
+    ModelBounds bounds() const
+    {
+        ModelBounds bounds;
+        for (const MeshCacheRecord& r : records)
+        {
+            BoundingBox box;
+            box.min = glm::vec3(r.boxMin[0], r.boxMin[1], r.boxMin[2]);
+            box.max = glm::vec3(r.boxMax[0], r.boxMax[1], r.boxMax[2]);
+            bounds.meshBoxes.push_back(box);
+            bounds.meshSpheres.push_back({ glm::vec3(r.sphere[0], r.sphere[1], r.sphere[2]), r.sphere[3] });
+        }
+        bounds.enclose();
+        return bounds;
+    }
+
+private:
+    MappedFile file;
+    std::vector<MeshCacheTexture> textureTable;
+    const uint8_t* strings = NULL;
+    uint64_t stringBytes = 0;
+
+    static uint32_t readLength(const uint8_t* at)
+    {
+        uint32_t length;
+        std::memcpy(&length, at, sizeof(length));
+        return length;
+    }
+
+    bool validString(uint32_t offset) const
+    {
+        return (uint64_t)offset + sizeof(uint32_t) <= stringBytes &&
+               readLength(strings + offset) <= stringBytes - offset - sizeof(uint32_t);
+    }
+
+    std::string stringAt(uint32_t offset) const
+    {
+        return std::string((const char*)strings + offset + sizeof(uint32_t), readLength(strings + offset));
+    }
+
+    bool fail()
+    {
+        records.clear();
+        textureTable.clear();
+        strings = NULL;
+        stringBytes = 0;
+        file.close();
+        return false;
+    }
+};
+
+// Writes a cache file for the encoded meshes, to a temporary file first so a
+// crash never leaves a torn one behind. Safe to call from any thread.
+inline bool writeMeshCache(const std::string& cachePath, uint64_t hash, const std::vector<EncodedMesh>& meshes,
+                           const std::vector<std::vector<MeshTextureRef>>& meshTextures, const ModelBounds& bounds)
+{
+    auto align16 = [](uint64_t offset) { return (offset + 15) & ~(uint64_t)15; };
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "LOGLMESH", 8);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexStride = sizeof(PackedVertex);
+    header.sourceHash = hash;
+    header.meshCount = (uint32_t)meshes.size();
+
+    std::vector<MeshCacheRecord> records(meshes.size());
+    std::vector<MeshCacheTexture> textures;
+    std::vector<uint8_t> strings;
+    std::unordered_map<std::string, uint32_t> stringOffsets; // the same types recur on every mesh
+    auto addString = [&](const std::string& value) {
+        auto found = stringOffsets.find(value);
+        if (found != stringOffsets.end())
+            return found->second;
+        uint32_t offset = (uint32_t)strings.size();
+        uint32_t length = (uint32_t)value.size();
+        strings.insert(strings.end(), (const uint8_t*)&length, (const uint8_t*)&length + sizeof(length));
+        strings.insert(strings.end(), value.begin(), value.end());
+        stringOffsets.emplace(value, offset);
+        return offset;
+    };
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        MeshCacheRecord& r = records[m];
+        std::memset(&r, 0, sizeof(r));
+        r.vertexCount = (uint32_t)meshes[m].vertexCount;
+        r.indexCount = (uint32_t)meshes[m].indexCount;
+        r.indexType = meshes[m].indexType;
+        r.sourceStride = (uint32_t)meshes[m].sourceStride;
+        r.firstTexture = (uint32_t)textures.size();
+        for (const MeshTextureRef& texture : meshTextures[m])
+        {
+            MeshCacheTexture t;
+            t.type = addString(texture.type);
+            t.path = addString(texture.path);
+            textures.push_back(t);
+        }
+        r.textureCount = (uint32_t)textures.size() - r.firstTexture;
+        for (int i = 0; i < 3; i++)
+        {
+            r.positionOffset[i] = meshes[m].positionOffset[i];
+            r.positionScale[i] = meshes[m].positionScale[i];
+            r.boxMin[i] = bounds.meshBoxes[m].min[i];
+            r.boxMax[i] = bounds.meshBoxes[m].max[i];
+            r.sphere[i] = bounds.meshSpheres[m].center[i];
+        }
+        r.sphere[3] = bounds.meshSpheres[m].radius;
+        r.lodCount = meshes[m].lodCount;
+        std::copy(meshes[m].lods, meshes[m].lods + meshes[m].lodCount, r.lods);
+    }
+    header.textureCount = (uint32_t)textures.size();
+    header.stringBytes = strings.size();
+
+    uint64_t offset = align16(sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheRecord) +
+                              textures.size() * sizeof(MeshCacheTexture) + strings.size());
+    for (size_t m = 0; m < records.size(); m++)
+    {
+        records[m].vertexOffset = offset;
+        offset = align16(offset + meshes[m].vertices.size());
+        records[m].indexOffset = offset;
+        offset = align16(offset + meshes[m].indices.size());
+    }
+    header.fileSize = offset;
+
+    std::string temporary = cachePath + ".tmp";
+    FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (!out)
+        return false;
+    static const uint8_t padding[16] = {};
+    uint64_t position = 0;
+    auto put = [&](const void* data, size_t size) {
+        position += size;
+        return size == 0 || std::fwrite(data, 1, size, out) == size;
+    };
+    bool written = put(&header, sizeof(header)) &&
+                   put(records.data(), records.size() * sizeof(MeshCacheRecord)) &&
+                   put(textures.data(), textures.size() * sizeof(MeshCacheTexture)) &&
+                   put(strings.data(), strings.size());
+    for (size_t m = 0; m < records.size() && written; m++)
+    {
+        written = put(padding, (size_t)(records[m].vertexOffset - position)) &&
+                  put(meshes[m].vertices.data(), meshes[m].vertices.size()) &&
+                  put(padding, (size_t)(records[m].indexOffset - position)) &&
+                  put(meshes[m].indices.data(), meshes[m].indices.size());
+    }
+    written = written && put(padding, (size_t)(header.fileSize - position));
+    written = std::fclose(out) == 0 && written;
+
+    if (written)
+        std::remove(cachePath.c_str()); // rename does not replace on Windows
+    if (!written || std::rename(temporary.c_str(), cachePath.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        std::cout << "MESH_CACHE::WRITE_FAILED: " << cachePath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ---- loading ---------------------------------------------------------------
+
+class MeshCache
+{
+public:
+    // Loads a static model into packed and bounds, from the cache when it is
+    // valid for the current sources and through ModelT (learnopengl's Model)
+    // otherwise, writing a fresh cache. loadTexture(path, directory) returns
+    // a texture name, e.g. TextureFromFile. With useCache = false the cache
+    // is neither read nor written.
+    template <typename ModelT, typename TextureLoader>
+    static void load(const std::string& path, PackedModel& packed, ModelBounds& bounds, TextureLoader loadTexture,
+                     MeshCacheTimings& timings, bool useCache = true)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto lap = start;
+
+        timings = MeshCacheTimings();
+        std::string cachePath = path + ".meshcache";
+        uint64_t hash = 0;
+        if (useCache)
+        {
+            hash = hashModelSources(path);
+            timings.hash = lapTime(lap);
+            CachedModel cached;
+            timings.hit = cached.open(cachePath, hash);
+            if (timings.hit)
+                loadCached(cached, path, packed, bounds, loadTexture, timings, lap);
+        }
+        if (!timings.hit)
+        {
+            ModelT model(path);
+            timings.import = lapTime(lap);
+            cook(model, useCache ? cachePath : std::string(), hash, packed, bounds, timings, lap);
+        }
+        timings.total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    static double lapTime(std::chrono::steady_clock::time_point& lap)
+    {
+        auto now = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - lap).count();
+        lap = now;
+        return ms;
+    }
+
+    template <typename TextureLoader>
+    static void loadCached(const CachedModel& cached, const std::string& path, PackedModel& packed, ModelBounds& bounds,
+                           TextureLoader& loadTexture, MeshCacheTimings& timings, std::chrono::steady_clock::time_point& lap)
+    {
+        timings.map = lapTime(lap);
+
+        // straight from the mapping into the buffers
+        for (size_t m = 0; m < cached.records.size(); m++)
+            packed.meshes.push_back(packed.upload(cached.layout(m), cached.vertices(m), cached.indices(m), false));
+        bounds = cached.bounds();
+        timings.upload = lapTime(lap);
+
+        // each image once, as Model does with textures_loaded
+        std::string directory = path.substr(0, path.find_last_of("/\\"));
+        std::unordered_map<std::string, unsigned int> loaded;
+        for (size_t m = 0; m < cached.records.size(); m++)
+        {
+            int count[4] = { 0, 0, 0, 0 };
+            for (const MeshTextureRef& texture : cached.textures(m))
+            {
+                auto found = loaded.find(texture.path);
+                if (found == loaded.end())
+                    found = loaded.emplace(texture.path, loadTexture(texture.path, directory)).first;
+                PackedModel::addTexture(packed.meshes[m], texture.type, found->second, count);
+            }
+        }
+        timings.textures = lapTime(lap);
+    }
+
+    // Packs the loaded model, writes the cache given a cachePath and uploads
+    template <typename ModelT>
+    static void cook(ModelT& model, const std::string& cachePath, uint64_t hash, PackedModel& packed, ModelBounds& bounds,
+                     MeshCacheTimings& timings, std::chrono::steady_clock::time_point& lap)
+    {
+        bounds = computeModelBounds(model);
+        std::vector<EncodedMesh> encoded;
+        std::vector<std::vector<MeshTextureRef>> textures;
+        for (const auto& mesh : model.meshes)
+        {
+            encoded.push_back(PackedModel::encodeMesh(mesh, false));
+            buildMeshLods(mesh, encoded.back());
+            textures.emplace_back();
+            for (const auto& texture : mesh.textures)
+                textures.back().push_back({ texture.type, texture.path });
+        }
+        if (!cachePath.empty())
+            writeMeshCache(cachePath, hash, encoded, textures, bounds);
+        timings.write = lapTime(lap);
+
+        for (size_t m = 0; m < model.meshes.size(); m++)
+        {
+            PackedMesh mesh = packed.upload(encoded[m], encoded[m].vertices.data(), encoded[m].indices.data(), false);
+            int count[4] = { 0, 0, 0, 0 };
+            for (const auto& texture : model.meshes[m].textures)
+                PackedModel::addTexture(mesh, texture.type, texture.id, count);
+            packed.meshes.push_back(mesh);
+            PackedModel::releaseMeshBuffers(model.meshes[m]);
+        }
+        timings.upload = lapTime(lap);
+    }
+};
+
+#endif
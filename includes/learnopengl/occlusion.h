@@ -0,0 +1,441 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/simd.h>
+#include <learnopengl/jobs.h>
+#include <learnopengl/culling.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// ============== Masked software occlusion culling ==============
+// Occluder triangles are rasterized on the CPU into a small depth buffer
+// that stores no per-pixel depth. The screen is cut into tiles of 8x4
+// pixels, and each tile keeps two depths and a 32-bit coverage mask (after
+// Andersson et al., "Masked Software Occlusion Culling", HPG 2016). Every
+// pixel of the tile is no farther than zMax0. The pixels in mask are also
+// no farther than zMax1, the working layer. Triangles are merged into the
+// working layer, and once it covers the whole tile it becomes the new
+// zMax0. Bounds are then tested against zMax0 of the tiles they cover:
+// anything farther than all of them is hidden. The buffer is conservative
+// for the geometry it is given, so only overly large occluders cull too much.
+//
+// Depths are view distances (clip w), larger is farther. Coverage of one
+// row of a tile is one SIMD compare on AVX2, and the tile test reads rows of
+// zMax0 a vector at a time. Setup is split across the job scheduler by
+// triangles and rasterization by bands of tile rows, so no two jobs write
+// the same tile and the result does not depend on the thread count.
+const int OCCLUSION_TILE_WIDTH = 8;
+const int OCCLUSION_TILE_HEIGHT = 4;
+const int OCCLUSION_BAND_ROWS = 4;          // tile rows per rasterization job
+const size_t OCCLUSION_SETUP_BATCH = 2048;  // vertices or triangles per setup job
+
+struct OcclusionStats
+{
+    unsigned int occluderTriangles = 0;     // given
+    unsigned int rasterizedTriangles = 0;   // left after clipping
+    unsigned int tested = 0, occluded = 0;
+    double renderMicroseconds = 0.0, testMicroseconds = 0.0;
+};
+
+class MaskedOcclusionBuffer
+{
+public:
+    OcclusionStats stats;   // since begin()
+
+    // Rounds the size up to whole tiles
+    void resize(int width, int height)
+    {
+        tilesX = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+        tilesY = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+        zMax0.assign((size_t)tilesX * tilesY, FLT_MAX);
+        zMax1.assign(zMax0.size(), 0.0f);
+        mask.assign(zMax0.size(), 0u);
+    }
+
+    int width() const { return tilesX * OCCLUSION_TILE_WIDTH; }
+    int height() const { return tilesY * OCCLUSION_TILE_HEIGHT; }
+
+    // Clears the buffer for a view; nearPlane is the projection's
+    void begin(const glm::mat4& viewProjection, float nearPlane)
+    {
+        this->viewProjection = viewProjection;
+        this->nearPlane = nearPlane;
+        std::fill(zMax0.begin(), zMax0.end(), FLT_MAX);
+        std::fill(zMax1.begin(), zMax1.end(), 0.0f);
+        std::fill(mask.begin(), mask.end(), 0u);
+        occluders.clear();
+        clipCount = 0;
+        stats = OcclusionStats();
+    }
+
+    // Queues an indexed world-space mesh for render(); the arrays must stay
+    // alive until then. Nearer occluders first cull more of the rest.
+    void addOccluder(const glm::vec3* vertices, size_t vertexCount, const uint32_t* indices, size_t triangleCount)
+    {
+        if (triangleCount > 0)
+            occluders.push_back({ vertices, vertexCount, indices, triangleCount, clipCount });
+        clipCount += vertexCount;
+        stats.occluderTriangles += (unsigned int)triangleCount;
+    }
+
+    // Rasterizes the queued occluders, on the scheduler's threads if given
+    void render(JobScheduler* jobs)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // every vertex is transformed once, then the triangles set up from
+        // the clip-space vertices, then each band drawn
+        clip.resize(clipCount);
+        vertexBatches.clear();
+        batches.clear();
+        for (const Occluder& occluder : occluders)
+        {
+            for (size_t first = 0; first < occluder.vertexCount; first += OCCLUSION_SETUP_BATCH)
+                vertexBatches.push_back({ occluder.vertices + first, occluder.firstClip + first, std::min(OCCLUSION_SETUP_BATCH, occluder.vertexCount - first) });
+            for (size_t first = 0; first < occluder.triangleCount; first += OCCLUSION_SETUP_BATCH)
+                batches.push_back({ &occluder, first, std::min(OCCLUSION_SETUP_BATCH, occluder.triangleCount - first), {} });
+        }
+
+        auto transform = [this](size_t b) {
+            const VertexBatch& batch = vertexBatches[b];
+            for (size_t v = 0; v < batch.count; v++)
+                clip[batch.firstClip + v] = viewProjection * glm::vec4(batch.vertices[v], 1.0f);
+        };
+        auto setup = [this](size_t b) { setupBatch(batches[b]); };
+        auto rasterize = [this](size_t band) { rasterizeBand((int)band * OCCLUSION_BAND_ROWS, std::min(((int)band + 1) * OCCLUSION_BAND_ROWS, tilesY)); };
+        size_t bands = (size_t)(tilesY + OCCLUSION_BAND_ROWS - 1) / OCCLUSION_BAND_ROWS;
+        if (jobs)
+        {
+            jobs->parallelFor(vertexBatches.size(), transform);
+            jobs->parallelFor(batches.size(), setup);
+            jobs->parallelFor(bands, rasterize);
+        }
+        else
+        {
+            for (size_t b = 0; b < vertexBatches.size(); b++)
+                transform(b);
+            for (size_t b = 0; b < batches.size(); b++)
+                setup(b);
+            for (size_t band = 0; band < bands; band++)
+                rasterize(band);
+        }
+        for (const Batch& batch : batches)
+            stats.rasterizedTriangles += (unsigned int)batch.triangles.size();
+        stats.renderMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // False if the world-space box is behind the occluders everywhere it
+    // covers the screen
+    bool visible(const glm::vec3& lo, const glm::vec3& hi) const
+    {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y, corner & 4 ? hi.z : lo.z, 1.0f);
+            if (clip.w < nearPlane)
+                return true;    // reaches the camera
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * width(), y = (clip.y / clip.w * 0.5f + 0.5f) * height();
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.w);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width() || minY >= (float)height())
+            return true;        // off screen, frustum culling's call
+        int tx0 = std::max((int)minX, 0) / OCCLUSION_TILE_WIDTH, tx1 = std::min((int)maxX, width() - 1) / OCCLUSION_TILE_WIDTH;
+        int ty0 = std::max((int)minY, 0) / OCCLUSION_TILE_HEIGHT, ty1 = std::min((int)maxY, height() - 1) / OCCLUSION_TILE_HEIGHT;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            const float* row = &zMax0[(size_t)ty * tilesX];
+            int tx = tx0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+            const vfloat depth = vset1(nearest);
+            for (; tx + (int)SIMD_LANES <= tx1 + 1; tx += (int)SIMD_LANES)
+                if (vmask(vless(vload(row + tx), depth)) != (1 << SIMD_LANES) - 1)
+                    return true;
+#endif
+            for (; tx <= tx1; tx++)
+                if (!(row[tx] < nearest))
+                    return true;
+        }
+        return false;
+    }
+
+    bool visible(const BoundingSphere& sphere) const
+    {
+        return visible(sphere.center - glm::vec3(sphere.radius), sphere.center + glm::vec3(sphere.radius));
+    }
+
+    // Removes the occluded spheres from indices (into spheres)
+    void cull(const SphereBatch& spheres, std::vector<uint32_t>& indices)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t kept = 0;
+        for (uint32_t index : indices)
+            if (visible(spheres.sphere(index)))
+                indices[kept++] = index;
+        stats.tested += (unsigned int)indices.size();
+        stats.occluded += (unsigned int)(indices.size() - kept);
+        indices.resize(kept);
+        stats.testMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Fraction of tiles with a finite zMax0, i.e. fully covered
+    float coverage() const
+    {
+        size_t covered = 0;
+        for (float z : zMax0)
+            covered += z < FLT_MAX;
+        return zMax0.empty() ? 0.0f : (float)covered / zMax0.size();
+    }
+
+private:
+    // A triangle in pixels, counter-clockwise: edge k is inside where
+    // a[k] x + b[k] y + c[k] >= 0, and 1/w is the plane dx x + dy y + d0
+    struct ScreenTriangle
+    {
+        float a[3], b[3], c[3];
+        float dx, dy, d0;
+        float farthest;     // smallest 1/w of the corners
+        float nearest;      // view distance of the nearest corner
+        int tx0, ty0, tx1, ty1;
+    };
+
+    struct Occluder
+    {
+        const glm::vec3* vertices;
+        size_t vertexCount;
+        const uint32_t* indices;
+        size_t triangleCount;
+        size_t firstClip;   // of its vertices in clip
+    };
+
+    struct VertexBatch
+    {
+        const glm::vec3* vertices;
+        size_t firstClip, count;
+    };
+
+    // triangles [first, first + count) of an occluder and what they became
+    struct Batch
+    {
+        const Occluder* occluder;
+        size_t first, count;
+        std::vector<ScreenTriangle> triangles;
+    };
+
+    int tilesX = 0, tilesY = 0;
+    std::vector<float> zMax0, zMax1;    // per tile, row by row
+    std::vector<uint32_t> mask;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    float nearPlane = 0.1f;
+    std::vector<Occluder> occluders;
+    size_t clipCount = 0;
+    std::vector<glm::vec4> clip;        // every occluder vertex, in clip space
+    std::vector<VertexBatch> vertexBatches;
+    std::vector<Batch> batches;
+
+    void setupBatch(Batch& batch) const
+    {
+        batch.triangles.clear();
+        const glm::vec4* vertices = &clip[batch.occluder->firstClip];
+        const uint32_t* indices = batch.occluder->indices + batch.first * 3;
+        for (size_t t = 0; t < batch.count; t++)
+        {
+            const glm::vec4 in[3] = { vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]] };
+            glm::vec4 out[4];
+            if (in[0].w >= nearPlane && in[1].w >= nearPlane && in[2].w >= nearPlane)
+            {
+                setupTriangle(in[0], in[1], in[2], batch.triangles);
+                continue;
+            }
+
+            // clip against the near plane, w = nearPlane in clip space
+            int count = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const glm::vec4& p = in[k];
+                const glm::vec4& q = in[(k + 1) % 3];
+                bool pIn = p.w >= nearPlane, qIn = q.w >= nearPlane;
+                if (pIn)
+                    out[count++] = p;
+                if (pIn != qIn)
+                    out[count++] = glm::mix(p, q, (nearPlane - p.w) / (q.w - p.w));
+            }
+            for (int k = 1; k + 1 < count; k++)
+                setupTriangle(out[0], out[k], out[k + 1], batch.triangles);
+        }
+    }
+
+    void setupTriangle(const glm::vec4& p0, const glm::vec4& p1, const glm::vec4& p2, std::vector<ScreenTriangle>& triangles) const
+    {
+        const glm::vec4* p[3] = { &p0, &p1, &p2 };
+        // outside one side plane of the frustum entirely
+        for (int axis = 0; axis < 2; axis++)
+        {
+            if (p0[axis] > p0.w && p1[axis] > p1.w && p2[axis] > p2.w)
+                return;
+            if (p0[axis] < -p0.w && p1[axis] < -p1.w && p2[axis] < -p2.w)
+                return;
+        }
+        float x[3], y[3], iw[3];
+        for (int k = 0; k < 3; k++)
+        {
+            iw[k] = 1.0f / p[k]->w;
+            x[k] = (p[k]->x * iw[k] * 0.5f + 0.5f) * width();
+            y[k] = (p[k]->y * iw[k] * 0.5f + 0.5f) * height();
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f)
+        {
+            // occluders are two-sided
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(iw[1], iw[2]);
+            area = -area;
+        }
+        float minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width() || minY >= (float)height())
+            return;
+
+        ScreenTriangle tri;
+        for (int k = 0; k < 3; k++)
+        {
+            int j = (k + 1) % 3;
+            tri.a[k] = y[k] - y[j];
+            tri.b[k] = x[j] - x[k];
+            tri.c[k] = -(tri.a[k] * x[k] + tri.b[k] * y[k]);
+        }
+        tri.dx = ((iw[1] - iw[0]) * (y[2] - y[0]) - (iw[2] - iw[0]) * (y[1] - y[0])) / area;
+        tri.dy = ((iw[2] - iw[0]) * (x[1] - x[0]) - (iw[1] - iw[0]) * (x[2] - x[0])) / area;
+        tri.d0 = iw[0] - tri.dx * x[0] - tri.dy * y[0];
+        tri.farthest = std::min(iw[0], std::min(iw[1], iw[2]));
+        tri.nearest = 1.0f / std::max(iw[0], std::max(iw[1], iw[2]));
+        tri.tx0 = std::max((int)minX, 0) / OCCLUSION_TILE_WIDTH;
+        tri.tx1 = std::min((int)maxX, width() - 1) / OCCLUSION_TILE_WIDTH;
+        tri.ty0 = std::max((int)minY, 0) / OCCLUSION_TILE_HEIGHT;
+        tri.ty1 = std::min((int)maxY, height() - 1) / OCCLUSION_TILE_HEIGHT;
+        triangles.push_back(tri);
+    }
+
+    // Every triangle, in submission order, into tile rows [rowBegin, rowEnd)
+    void rasterizeBand(int rowBegin, int rowEnd)
+    {
+        for (const Batch& batch : batches)
+            for (const ScreenTriangle& tri : batch.triangles)
+            {
+                int ty0 = std::max(tri.ty0, rowBegin), ty1 = std::min(tri.ty1, rowEnd - 1);
+                for (int ty = ty0; ty <= ty1; ty++)
+                {
+                    // only the tiles between the edges on this row of tiles
+                    float y0 = ty * OCCLUSION_TILE_HEIGHT + 0.5f, y1 = (ty + 1) * OCCLUSION_TILE_HEIGHT - 0.5f;
+                    float left = -FLT_MAX, right = FLT_MAX;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (tri.a[k] == 0.0f)
+                            continue;
+                        float at0 = -(tri.b[k] * y0 + tri.c[k]) / tri.a[k], at1 = -(tri.b[k] * y1 + tri.c[k]) / tri.a[k];
+                        if (tri.a[k] > 0.0f)
+                            left = std::max(left, std::min(at0, at1));
+                        else
+                            right = std::min(right, std::max(at0, at1));
+                    }
+                    int tx0 = std::max(tri.tx0, (int)std::floor(std::max(left - 0.5f, -1.0f) / OCCLUSION_TILE_WIDTH));
+                    int tx1 = std::min(tri.tx1, (int)std::floor(std::min(right - 0.5f, (float)width()) / OCCLUSION_TILE_WIDTH));
+                    for (int tx = tx0; tx <= tx1; tx++)
+                        rasterizeTile(tri, tx, ty);
+                }
+            }
+    }
+
+    void rasterizeTile(const ScreenTriangle& tri, int tx, int ty)
+    {
+        const float x0 = (float)(tx * OCCLUSION_TILE_WIDTH), y0 = (float)(ty * OCCLUSION_TILE_HEIGHT);
+        const float x1 = x0 + OCCLUSION_TILE_WIDTH, y1 = y0 + OCCLUSION_TILE_HEIGHT;
+        size_t t = (size_t)ty * tilesX + tx;
+        if (tri.nearest >= zMax0[t])
+            return;     // the tile is already nearer than all of the triangle
+
+        // each edge at the pixel centres nearest to its inside and outside
+        bool full = true;
+        for (int k = 0; k < 3; k++)
+        {
+            float best = tri.c[k] + tri.a[k] * (tri.a[k] > 0.0f ? x1 - 0.5f : x0 + 0.5f) + tri.b[k] * (tri.b[k] > 0.0f ? y1 - 0.5f : y0 + 0.5f);
+            float worst = tri.c[k] + tri.a[k] * (tri.a[k] > 0.0f ? x0 + 0.5f : x1 - 0.5f) + tri.b[k] * (tri.b[k] > 0.0f ? y0 + 0.5f : y1 - 0.5f);
+            if (best < 0.0f)
+                return;
+            full = full && worst >= 0.0f;
+        }
+
+        uint32_t coverage = 0xffffffffu;
+        if (!full)
+        {
+            coverage = 0;
+            for (int row = 0; row < OCCLUSION_TILE_HEIGHT; row++)
+            {
+                float y = y0 + row + 0.5f;
+                int lane = 0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+                static const float LANE_OFFSETS[8] = { 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f };
+                const vfloat laneOffsets = vload(LANE_OFFSETS);
+                for (; lane + (int)SIMD_LANES <= OCCLUSION_TILE_WIDTH; lane += (int)SIMD_LANES)
+                {
+                    vfloat x = vadd(vset1(x0 + lane + 0.5f), laneOffsets);
+                    vfloat e = vset1(FLT_MAX);
+                    for (int k = 0; k < 3; k++)
+                        e = vmin(e, vmuladd(vset1(tri.a[k]), x, vset1(tri.b[k] * y + tri.c[k])));
+                    uint32_t outside = (uint32_t)vmask(vless(e, vset1(0.0f)));
+                    coverage |= (~outside & ((1u << SIMD_LANES) - 1)) << (row * OCCLUSION_TILE_WIDTH + lane);
+                }
+#endif
+                for (; lane < OCCLUSION_TILE_WIDTH; lane++)
+                {
+                    float x = x0 + lane + 0.5f;
+                    bool inside = true;
+                    for (int k = 0; k < 3; k++)
+                        inside = inside && tri.a[k] * x + tri.b[k] * y + tri.c[k] >= 0.0f;
+                    if (inside)
+                        coverage |= 1u << (row * OCCLUSION_TILE_WIDTH + lane);
+                }
+            }
+            if (coverage == 0)
+                return;
+        }
+
+        // the farthest the triangle gets inside the tile: 1/w is linear on
+        // screen, smallest at a tile corner or at a triangle corner
+        float corner = std::min(std::min(tri.d0 + tri.dx * x0 + tri.dy * y0, tri.d0 + tri.dx * x1 + tri.dy * y0),
+                                std::min(tri.d0 + tri.dx * x0 + tri.dy * y1, tri.d0 + tri.dx * x1 + tri.dy * y1));
+        float zTriangle = 1.0f / std::max(corner, tri.farthest);
+
+        if (zTriangle >= zMax0[t])
+            return;     // adds nothing over layer 0
+        // a working layer much farther than the new triangle is dropped
+        // rather than holding the triangle back
+        if (zMax1[t] - zTriangle > zMax0[t] - zMax1[t])
+        {
+            zMax1[t] = 0.0f;
+            mask[t] = 0;
+        }
+        zMax1[t] = std::max(zMax1[t], zTriangle);
+        mask[t] |= coverage;
+        if (mask[t] == 0xffffffffu)
+        {
+            zMax0[t] = zMax1[t];
+            zMax1[t] = 0.0f;
+            mask[t] = 0;
+        }
+    }
+};
+
+#endif
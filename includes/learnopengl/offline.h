@@ -0,0 +1,334 @@
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#ifdef LEARNOPENGL_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offline render-to-file mode shared by the demos.
+//
+//   demo --offline <frames> [--out <path>] [--dt <seconds>]
+//
+// Renders <frames> frames at a fixed timestep into an offscreen framebuffer
+// and streams them out through two pixel pack buffers, so the readback of
+// frame N overlaps the rendering of frame N+1. A path containing '%' is
+// used as a printf pattern for a PPM image sequence (default frame_%05d.ppm),
+// any other path receives raw top-down RGBA frames ("-" is stdout), e.g.
+//
+//   demo --offline 600 --out - | ffmpeg -f rawvideo -pix_fmt rgba -s 800x600 -r 60 -i - out.mp4
+//
+// With "-" the frames keep stdout to themselves: the constructor moves the
+// original stdout to a stream of its own and points stdout at stderr, so
+// everything else the process prints (std::cout, printf, logs) lands on
+// stderr instead of in the video.
+//
+// Built with LEARNOPENGL_HEADLESS_EGL the context comes from surfaceless EGL
+// (Mesa llvmpipe works without any display or GPU), otherwise from a hidden
+// GLFW window. Without --offline the object is inert: time() is glfwGetTime()
+// and present() swaps and polls as usual.
+class OfflineRenderer
+{
+public:
+    bool active = false;
+    int frames = 0;
+    float timestep = 1.0f / 60.0f;
+    std::string output = "frame_%05d.ppm";
+    int frame = 0;
+
+    OfflineRenderer(int argc, char** argv, unsigned int width, unsigned int height)
+        : width(width), height(height)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strcmp(argv[i], "--offline") == 0 && i + 1 < argc)
+            {
+                active = true;
+                frames = std::atoi(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+                output = argv[++i];
+            else if (std::strcmp(argv[i], "--dt") == 0 && i + 1 < argc)
+                timestep = (float)std::atof(argv[++i]);
+        }
+        if (active && output == "-")
+            takeStdout();
+    }
+
+    // create the GL context, load GLAD and set up the offscreen target
+    // ------------------------------------------------------------------
+    bool createContext()
+    {
+#ifdef LEARNOPENGL_HEADLESS_EGL
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+                                     : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cerr << "Failed to initialize surfaceless EGL display" << std::endl;
+            return false;
+        }
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cerr << "Failed to create surfaceless EGL context" << std::endl;
+            return false;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cerr << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+#else
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        hiddenWindow = glfwCreateWindow(width, height, "offline", NULL, NULL);
+        if (hiddenWindow == NULL)
+        {
+            std::cerr << "Failed to create hidden GLFW window" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(hiddenWindow);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cerr << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+#endif
+        return createTarget();
+    }
+
+    // framebuffer the demo should treat as "the screen"
+    unsigned int framebuffer() const { return active ? fbo : 0; }
+
+    float time() const
+    {
+        return active ? frame * timestep : (float)glfwGetTime();
+    }
+
+    bool shouldClose(GLFWwindow* window) const
+    {
+        return active ? frame >= frames : glfwWindowShouldClose(window);
+    }
+
+    // end of frame: queue the async readback and write out the previous frame
+    // ------------------------------------------------------------------------
+    void present(GLFWwindow* window)
+    {
+        if (!active)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            return;
+        }
+        if (frame == 0)
+            start = std::chrono::steady_clock::now();
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frame % 2]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        if (frame > 0)
+            writeFrame(frame - 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        frame++;
+    }
+
+    // drain the last readback, report throughput and release the target;
+    // the context itself lives until glfwTerminate() / destruction
+    // ------------------------------------------------------------------
+    void finish()
+    {
+        if (!active)
+            return;
+        if (frame > 0)
+        {
+            writeFrame(frame - 1);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        // the clock starts at the first present(), so frame 0 is not in the rate
+        std::cerr << "offline: " << frame << " frames (" << width << "x" << height << ") in " << seconds << " s, "
+                  << (seconds > 0.0 && frame > 1 ? (frame - 1) / seconds : 0.0) << " fps end to end, "
+                  << (seconds > 0.0 ? writeSeconds / seconds * 100.0 : 0.0) << "% of it writing" << std::endl;
+
+        if (stream)
+            std::fclose(stream);
+        stream = NULL;
+        glDeleteBuffers(2, pbo);
+        glDeleteRenderbuffers(2, rbo);
+        glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+    }
+
+    ~OfflineRenderer()
+    {
+#ifdef LEARNOPENGL_HEADLESS_EGL
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+#endif
+    }
+
+private:
+    unsigned int width, height;
+    unsigned int fbo = 0;
+    unsigned int rbo[2] = { 0, 0 };
+    unsigned int pbo[2] = { 0, 0 };
+    FILE* stream = NULL;
+    std::vector<unsigned char> row;
+    std::chrono::steady_clock::time_point start;
+    double writeSeconds = 0.0;
+#ifdef LEARNOPENGL_HEADLESS_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#else
+    GLFWwindow* hiddenWindow = NULL;
+#endif
+
+    bool sequence() const { return output.find('%') != std::string::npos; }
+
+    // the frames get a duplicate of stdout's descriptor, stdout becomes stderr
+    void takeStdout()
+    {
+        std::fflush(stdout);
+#ifdef _WIN32
+        int video = _dup(1);
+        if (video < 0 || _dup2(2, 1) != 0)
+            return;
+        _setmode(video, _O_BINARY);
+        stream = _fdopen(video, "wb");
+#else
+        int video = dup(1);
+        if (video < 0 || dup2(2, 1) < 0)
+            return;
+        stream = fdopen(video, "wb");
+#endif
+    }
+
+    bool createTarget()
+    {
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenRenderbuffers(2, rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, rbo[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "ERROR::FRAMEBUFFER:: Offline framebuffer is not complete!" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+
+        glGenBuffers(2, pbo);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+        if (!sequence())
+        {
+            if (!stream && output != "-")
+                stream = std::fopen(output.c_str(), "wb");
+            if (!stream)
+            {
+                std::cerr << "Failed to open " << output << std::endl;
+                return false;
+            }
+        }
+        row.resize((size_t)width * 4);
+        return true;
+    }
+
+    // GL rows are bottom-up, both outputs are written top-down
+    void writeFrame(int index)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index % 2]);
+        const unsigned char* pixels = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (pixels)
+        {
+            const size_t pitch = (size_t)width * 4;
+            if (sequence())
+            {
+                char path[512];
+                std::snprintf(path, sizeof(path), output.c_str(), index);
+                if (FILE* file = std::fopen(path, "wb"))
+                {
+                    std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+                    for (int y = (int)height - 1; y >= 0; y--)
+                    {
+                        const unsigned char* src = pixels + y * pitch;
+                        for (unsigned int x = 0; x < width; x++)
+                        {
+                            row[x * 3 + 0] = src[x * 4 + 0];
+                            row[x * 3 + 1] = src[x * 4 + 1];
+                            row[x * 3 + 2] = src[x * 4 + 2];
+                        }
+                        std::fwrite(row.data(), 1, (size_t)width * 3, file);
+                    }
+                    std::fclose(file);
+                }
+            }
+            else
+            {
+                for (int y = (int)height - 1; y >= 0; y--)
+                    std::fwrite(pixels + y * pitch, 1, pitch, stream);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// (texture unit, texture) pairs, e.g. PackedMesh::textures
+typedef std::vector<std::pair<int, unsigned int>> TextureBindings;
+
+// 64-bit sort key, most significant first:
+//   layer    4 bits   passes that must stay in order (opaque before blended)
+//   program 12 bits   the costliest switch
+//   material 12 bits  first texture of the packet; grouping by texture before
+//                     VAO saves more, since most meshes own their VAO anyway
+//   vao     12 bits
+//   depth   24 bits   front to back, so early depth rejects more
+// GL names are folded into their bit range; a collision only costs grouping,
+// the state cache compares the real names.
+inline uint64_t makeSortKey(unsigned int layer, unsigned int program, unsigned int material, unsigned int vao, float depth01)
+{
+    uint64_t depth = (uint64_t)(std::min(std::max(depth01, 0.0f), 1.0f) * 16777215.0f);
+    return ((uint64_t)(layer & 0xf) << 60) | ((uint64_t)(program & 0xfff) << 48) |
+           ((uint64_t)(material & 0xfff) << 36) | ((uint64_t)(vao & 0xfff) << 24) | depth;
+}
+
+struct RenderQueueStats
+{
+    unsigned int packets = 0;
+    unsigned int drawCalls = 0;
+    unsigned int programBinds = 0;
+    unsigned int vaoBinds = 0;
+    unsigned int textureBinds = 0;
+    unsigned int uniformWrites = 0;     // made, i.e. the value changed
+    // binds the same packets would have cost drawn one by one in submission
+    // order, Mesh::Draw style: VAO and every texture per draw
+    unsigned int unsortedBinds = 0;
+
+    unsigned int stateChanges() const { return programBinds + vaoBinds + textureBinds; }
+};
+
+// Objects submit draw packets, flush() sorts them by key and issues them with
+// a state cache so that program, VAO and texture binds are only made when
+// they change. Per-draw uniforms are recorded with the packet and written
+// only when they differ from the last value the flush wrote to that location
+// of that program, so a model matrix shared by many meshes is written once.
+// Per-program uniforms (view, projection, lights) are set on the program
+// beforehand and are untouched by the queue, since GL keeps them per program.
+class RenderQueue
+{
+public:
+    RenderQueueStats stats;     // of the current frame
+    RenderQueueStats lastFrame; // of the previous frame, after endFrame()
+
+    // Starts a packet; uniforms for it follow with set*(). indexType 0 means
+    // glDrawArrays, otherwise glDrawElements; instances > 1 draws instanced.
+    // first is the first vertex or index drawn, e.g. of a level of detail.
+    void submit(uint64_t key, unsigned int program, unsigned int vao, const TextureBindings* textures,
+                GLenum mode, GLsizei count, GLenum indexType = 0, GLsizei instances = 1, GLsizei first = 0)
+    {
+        Packet packet;
+        packet.program = program;
+        packet.vao = vao;
+        packet.textures = textures;
+        packet.mode = mode;
+        packet.count = count;
+        packet.indexType = indexType;
+        packet.instances = instances;
+        packet.first = first;
+        packet.firstUniform = (uint32_t)uniforms.size();
+        packet.uniformCount = 0;
+        keys.push_back({ key, (uint32_t)packets.size() });
+        packets.push_back(packet);
+    }
+
+    void setMat4(GLint location, const glm::mat4& value) { addUniform(location, UNIFORM_MAT4, &value[0][0], 16); }
+    void setVec3(GLint location, const glm::vec3& value) { addUniform(location, UNIFORM_VEC3, &value[0], 3); }
+    void setFloat(GLint location, float value) { addUniform(location, UNIFORM_FLOAT, &value, 1); }
+
+    // Sorts and draws everything submitted since the last flush. State set
+    // outside the queue is unknown, so the cache starts empty every time.
+    void flush()
+    {
+        std::sort(keys.begin(), keys.end());
+        countUnsorted();
+
+        unsigned int program = 0, vao = 0;
+        bool first = true;
+        unsigned int bound[MAX_UNITS];
+        std::memset(bound, 0, sizeof(bound));
+        unsigned int activeUnit = 0;
+        for (const SortEntry& entry : keys)
+        {
+            const Packet& p = packets[entry.packet];
+            if (first || p.program != program)
+            {
+                glUseProgram(p.program);
+                program = p.program;
+                stats.programBinds++;
+            }
+            if (first || p.vao != vao)
+            {
+                glBindVertexArray(p.vao);
+                vao = p.vao;
+                stats.vaoBinds++;
+            }
+            first = false;
+            if (p.textures)
+            {
+                for (const auto& t : *p.textures)
+                {
+                    if (t.first < MAX_UNITS && bound[t.first] == t.second)
+                        continue;
+                    if ((unsigned int)t.first != activeUnit)
+                    {
+                        glActiveTexture(GL_TEXTURE0 + t.first);
+                        activeUnit = t.first;
+                    }
+                    glBindTexture(GL_TEXTURE_2D, t.second);
+                    if (t.first < MAX_UNITS)
+                        bound[t.first] = t.second;
+                    stats.textureBinds++;
+                }
+            }
+            for (uint32_t u = p.firstUniform; u < p.firstUniform + p.uniformCount; u++)
+                if (uniforms[u].location >= 0 && changed(p.program, uniforms[u]))
+                {
+                    writeUniform(uniforms[u]);
+                    stats.uniformWrites++;
+                }
+
+            if (p.indexType == 0)
+            {
+                if (p.instances > 1)
+                    glDrawArraysInstanced(p.mode, p.first, p.count, p.instances);
+                else
+                    glDrawArrays(p.mode, p.first, p.count);
+            }
+            else
+            {
+                size_t size = p.indexType == GL_UNSIGNED_BYTE ? 1 : p.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+                const void* offset = (const void*)(p.first * size);
+                if (p.instances > 1)
+                    glDrawElementsInstanced(p.mode, p.count, p.indexType, offset, p.instances);
+                else
+                    glDrawElements(p.mode, p.count, p.indexType, offset);
+            }
+            stats.drawCalls++;
+        }
+        stats.packets += (unsigned int)keys.size();
+        if (activeUnit != 0)
+            glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(0);
+
+        keys.clear();
+        packets.clear();
+        uniforms.clear();
+        written.clear();
+    }
+
+    void endFrame()
+    {
+        lastFrame = stats;
+        stats = RenderQueueStats();
+    }
+
+private:
+    static const int MAX_UNITS = 16;
+    enum UniformType : uint8_t { UNIFORM_FLOAT, UNIFORM_VEC3, UNIFORM_MAT4 };
+
+    struct Packet
+    {
+        unsigned int program, vao;
+        const TextureBindings* textures;
+        GLenum mode, indexType;
+        GLsizei count, instances, first;
+        uint32_t firstUniform, uniformCount;
+    };
+
+    struct PacketUniform
+    {
+        GLint location;
+        UniformType type;
+        float data[16];
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;    // submission order breaks ties, so the sort is stable
+        bool operator<(const SortEntry& other) const { return key != other.key ? key < other.key : packet < other.packet; }
+    };
+
+    std::vector<SortEntry> keys;
+    std::vector<Packet> packets;
+    std::vector<PacketUniform> uniforms;
+
+    // the last value this flush wrote to each location of each program
+    struct WrittenUniform
+    {
+        unsigned int program;
+        PacketUniform value;
+    };
+    std::vector<WrittenUniform> written;
+
+    void addUniform(GLint location, UniformType type, const float* data, int floats)
+    {
+        PacketUniform u;
+        u.location = location;
+        u.type = type;
+        std::memcpy(u.data, data, floats * sizeof(float));
+        uniforms.push_back(u);
+        packets.back().uniformCount++;
+    }
+
+    static int floatCount(UniformType type) { return type == UNIFORM_MAT4 ? 16 : type == UNIFORM_VEC3 ? 3 : 1; }
+
+    // Whether u differs from what the flush last wrote there, and if so
+    // remembers it. Few locations are in play, so a linear search will do.
+    bool changed(unsigned int program, const PacketUniform& u)
+    {
+        for (WrittenUniform& w : written)
+            if (w.program == program && w.value.location == u.location)
+            {
+                if (w.value.type == u.type && std::memcmp(w.value.data, u.data, floatCount(u.type) * sizeof(float)) == 0)
+                    return false;
+                w.value = u;
+                return true;
+            }
+        written.push_back({ program, u });
+        return true;
+    }
+
+    static void writeUniform(const PacketUniform& u)
+    {
+        switch (u.type)
+        {
+        case UNIFORM_FLOAT: glUniform1f(u.location, u.data[0]); break;
+        case UNIFORM_VEC3: glUniform3fv(u.location, 1, u.data); break;
+        case UNIFORM_MAT4: glUniformMatrix4fv(u.location, 1, GL_FALSE, u.data); break;
+        }
+    }
+
+    // program switches as submitted, plus a VAO bind and every texture per draw
+    void countUnsorted()
+    {
+        unsigned int program = 0;
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            const Packet& p = packets[i];
+            if (i == 0 || p.program != program)
+                stats.unsortedBinds++;
+            program = p.program;
+            stats.unsortedBinds += 1 + (p.textures ? (unsigned int)p.textures->size() : 0);
+        }
+    }
+};
+
+#endif
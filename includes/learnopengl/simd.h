@@ -0,0 +1,98 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+
+// Thin wrappers over the widest float vector the build targets: AVX2+FMA
+// when the compiler targets it (-mavx2 -mfma, /arch:AVX2), SSE2 on any
+// x86-64 build, scalar otherwise (SIMD_LANES = 1, no vfloat). Kernels are
+// written once against vfloat and finish the remainder of an array with
+// their scalar code.
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+#if defined(SIMD_AVX2)
+typedef __m256 vfloat;
+typedef __m256i vint;
+const size_t SIMD_LANES = 8;
+inline vfloat vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+inline vfloat vset1(float f) { return _mm256_set1_ps(f); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vmuladd(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+inline vfloat vnmuladd(vfloat a, vfloat b, vfloat c) { return _mm256_fnmadd_ps(a, b, c); }
+inline vfloat vxor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+inline vint vround(vfloat a) { return _mm256_cvtps_epi32(a); }
+inline vfloat vtofloat(vint a) { return _mm256_cvtepi32_ps(a); }
+inline vint viadd(vint a, int b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+inline vfloat vbit(vint a, int bit) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(a, _mm256_set1_epi32(bit)), _mm256_set1_epi32(bit))); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat vless(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat vand(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+inline int vmask(vfloat a) { return _mm256_movemask_ps(a); }   // sign bit of lane i is bit i
+#else
+typedef __m128 vfloat;
+typedef __m128i vint;
+const size_t SIMD_LANES = 4;
+inline vfloat vload(const float* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+inline vfloat vset1(float f) { return _mm_set1_ps(f); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vmuladd(vfloat a, vfloat b, vfloat c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline vfloat vnmuladd(vfloat a, vfloat b, vfloat c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+inline vfloat vxor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline vint vround(vfloat a) { return _mm_cvtps_epi32(a); }
+inline vfloat vtofloat(vint a) { return _mm_cvtepi32_ps(a); }
+inline vint viadd(vint a, int b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+inline vfloat vbit(vint a, int bit) { return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(bit)), _mm_set1_epi32(bit))); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat vless(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+inline vfloat vand(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+inline int vmask(vfloat a) { return _mm_movemask_ps(a); }
+#endif
+
+// sin(x) for quadrant = 0, cos(x) for quadrant = 1. The argument is reduced
+// to [-pi/4, pi/4] around the nearest multiple of pi/2 (three-part pi/2 so
+// the phases of a long-running animation stay accurate), then the Cephes
+// single precision polynomials give ~1e-7 absolute error.
+inline vfloat vsincos(vfloat x, int quadrant)
+{
+    vint j = vround(vmul(x, vset1(0.636619772f)));
+    vfloat jf = vtofloat(j);
+    vfloat r = vnmuladd(jf, vset1(1.5703125f), x);
+    r = vnmuladd(jf, vset1(4.837512969970703125e-4f), r);
+    r = vnmuladd(jf, vset1(7.549789948768648e-8f), r);
+    vfloat r2 = vmul(r, r);
+
+    vfloat s = vmuladd(vset1(-1.9515295891e-4f), r2, vset1(8.3321608736e-3f));
+    s = vmuladd(s, r2, vset1(-1.6666654611e-1f));
+    s = vmuladd(vmul(s, r2), r, r);
+
+    vfloat c = vmuladd(vset1(2.443315711809948e-5f), r2, vset1(-1.388731625493765e-3f));
+    c = vmuladd(c, r2, vset1(4.166664568298827e-2f));
+    c = vmuladd(vmul(c, r2), r2, vnmuladd(vset1(0.5f), r2, vset1(1.0f)));
+
+    vint q = viadd(j, quadrant);
+    vfloat result = vselect(vbit(q, 1), c, s);
+    vfloat negate = vbit(q, 2);
+    return vxor(result, vselect(negate, vset1(-0.0f), vset1(0.0f)));
+}
+#else
+const size_t SIMD_LANES = 1;
+#endif
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniforms.h>
+#include <learnopengl/vertex_format.h>
+#include <learnopengl/render_queue.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// Draw calls and CPU time of one static batch per frame
+struct StaticBatchStats
+{
+    unsigned int meshes = 0;        // visible meshes drawn
+    unsigned int triangles = 0;
+    unsigned int drawCalls = 0;
+    unsigned int textureBinds = 0;
+    double microseconds = 0.0;
+};
+
+// Geometry that never moves, merged at load into one vertex buffer and one
+// index buffer behind a single VAO. Meshes keep their own index ranges, one
+// per level of detail, and base vertex, and are grouped by material (their
+// texture set), so a frame costs one texture bind and one
+// glMultiDrawElementsBaseVertex per material with visible meshes instead of
+// a VAO bind, texture binds, uniforms and a draw per mesh. The packed
+// positions of each mesh are requantized into the bounding box of the whole
+// batch, so one positionOffset / positionScale holds for every mesh.
+//
+// The contexts are GL 3.3, so glMultiDrawElementsIndirect (4.3) and gl_DrawID
+// are out of reach; per-material multi-draws are what 3.3 offers, and
+// per-mesh culling still decides what goes into them.
+class StaticBatch
+{
+public:
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    glm::vec3 positionOffset = glm::vec3(0.0f), positionScale = glm::vec3(1.0f);
+    std::vector<TextureBindings> materials;
+    StaticBatchStats stats;     // of the last draw()
+    size_t vertexCount = 0, indexCount = 0;
+    float worstError = 0.0f;    // position change from requantizing, model units
+    double buildMilliseconds = 0.0;
+
+    size_t meshCount() const { return ranges.size(); }
+
+    // Merges every mesh of model, reading their buffers back from GL, which
+    // works the same whichever way the model was loaded. The model keeps its
+    // own buffers.
+    void build(const PackedModel& model)
+    {
+        destroy();
+        auto start = std::chrono::steady_clock::now();
+
+        // one box around every mesh box
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const PackedMesh& mesh : model.meshes)
+        {
+            lo = glm::min(lo, mesh.positionOffset - mesh.positionScale);
+            hi = glm::max(hi, mesh.positionOffset + mesh.positionScale);
+        }
+        if (model.meshes.empty())
+            lo = hi = glm::vec3(0.0f);
+        positionOffset = (lo + hi) * 0.5f;
+        positionScale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+
+        // meshes of a material end up next to each other in the buffers
+        std::map<TextureBindings, uint32_t> materialIndex;
+        std::vector<uint32_t> order(model.meshes.size());
+        ranges.resize(model.meshes.size());
+        for (uint32_t m = 0; m < model.meshes.size(); m++)
+        {
+            auto inserted = materialIndex.emplace(model.meshes[m].textures, (uint32_t)materials.size());
+            if (inserted.second)
+                materials.push_back(model.meshes[m].textures);
+            ranges[m].material = inserted.first->second;
+            order[m] = m;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return ranges[a].material < ranges[b].material; });
+
+        std::vector<PackedVertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<uint8_t> bytes;
+        size_t largestMesh = 0;
+        worstError = 0.0f;
+        for (uint32_t m : order)
+        {
+            const PackedMesh& mesh = model.meshes[m];
+            readBuffer(mesh.VBO, bytes);
+            size_t count = bytes.size() / sizeof(PackedVertex);
+            size_t first = vertices.size();
+            vertices.resize(first + count);
+            std::memcpy(&vertices[first], bytes.data(), count * sizeof(PackedVertex));
+            for (size_t v = first; v < vertices.size(); v++)
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    int16_t& q = vertices[v].position[axis];
+                    float position = std::max(q / 32767.0f, -1.0f) * mesh.positionScale[axis] + mesh.positionOffset[axis];
+                    q = packSnorm16((position - positionOffset[axis]) / positionScale[axis]);
+                    float error = std::fabs(q / 32767.0f * positionScale[axis] + positionOffset[axis] - position);
+                    worstError = std::max(worstError, error);
+                }
+            largestMesh = std::max(largestMesh, count);
+
+            // every level of detail comes along with the full mesh
+            readBuffer(mesh.EBO, bytes);
+            size_t size = indexSize(mesh.indexType);
+            Range& range = ranges[m];
+            range.levels = (int)mesh.lodCount + 1;
+            for (int level = 0; level < range.levels; level++)
+            {
+                range.count[level] = mesh.levelIndexCount(level);
+                range.firstIndex[level] = indices.size() + mesh.levelFirstIndex(level);
+            }
+            range.baseVertex = (GLint)first;
+            for (size_t i = 0; i < bytes.size() / size; i++)
+            {
+                uint32_t index = 0;
+                std::memcpy(&index, &bytes[i * size], size);
+                indices.push_back(index);
+            }
+        }
+
+        // indices stay local to their mesh, so 16 bits do unless one mesh
+        // alone has more vertices than that
+        indexType = largestMesh <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        uploadIndices(indices, indexType);
+        setupPackedAttributes(false);
+        glBindVertexArray(0);
+
+        perMaterial.assign(materials.size(), Draws());
+        vertexCount = vertices.size();
+        indexCount = indices.size();
+        buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void print(const char* name) const
+    {
+        std::printf("%-8s %zu meshes batched into %zu materials: %zu vertices, %zu indices (%s), %.2f MB, worst requantization error %.4f, built in %.1f ms\n",
+            name, ranges.size(), materials.size(), vertexCount, indexCount, indexType == GL_UNSIGNED_SHORT ? "16-bit" : "32-bit",
+            (vertexCount * sizeof(PackedVertex) + indexCount * indexSize(indexType)) / (1024.0 * 1024.0), worstError, buildMilliseconds);
+    }
+
+    // Draws the given meshes (indices into the source model), each at its
+    // entry in levels (by source mesh, null for full detail). The program
+    // must be bound with its view and projection set; model, positionOffset
+    // and positionScale are set here.
+    void draw(const std::vector<uint32_t>& visibleMeshes, const uint8_t* levels, const glm::mat4& model, const Uniform<glm::mat4>& uModel,
+              const Uniform<glm::vec3>& uPositionOffset, const Uniform<glm::vec3>& uPositionScale)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stats = StaticBatchStats();
+        for (Draws& draws : perMaterial)
+            draws.clear();
+        size_t stride = indexSize(indexType);
+        for (uint32_t m : visibleMeshes)
+        {
+            const Range& range = ranges[m];
+            int level = levels ? std::min((int)levels[m], range.levels - 1) : 0;
+            Draws& draws = perMaterial[range.material];
+            draws.counts.push_back(range.count[level]);
+            draws.offsets.push_back((const void*)(range.firstIndex[level] * stride));
+            draws.baseVertices.push_back(range.baseVertex);
+            stats.triangles += range.count[level] / 3;
+        }
+
+        uModel.set(model);
+        uPositionOffset.set(positionOffset);
+        uPositionScale.set(positionScale);
+        glBindVertexArray(VAO);
+        for (size_t material = 0; material < materials.size(); material++)
+        {
+            const Draws& draws = perMaterial[material];
+            if (draws.counts.empty())
+                continue;
+            for (const auto& texture : materials[material])
+            {
+                glActiveTexture(GL_TEXTURE0 + texture.first);
+                glBindTexture(GL_TEXTURE_2D, texture.second);
+                stats.textureBinds++;
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, draws.counts.data(), indexType, draws.offsets.data(),
+                                          (GLsizei)draws.counts.size(), draws.baseVertices.data());
+            stats.meshes += (unsigned int)draws.counts.size();
+            stats.drawCalls++;
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        stats.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+        vertexCount = indexCount = 0;
+        materials.clear();
+        ranges.clear();
+        perMaterial.clear();
+    }
+
+private:
+    struct Range
+    {
+        int levels = 1;
+        GLsizei count[MAX_MESH_LODS + 1] = {};
+        size_t firstIndex[MAX_MESH_LODS + 1] = {};  // in the batch's index buffer
+        GLint baseVertex = 0;
+        uint32_t material = 0;
+    };
+
+    // this frame's draws of one material, in glMultiDraw* layout
+    struct Draws
+    {
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        std::vector<GLint> baseVertices;
+
+        void clear()
+        {
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+        }
+    };
+
+    std::vector<Range> ranges;  // per source mesh
+    std::vector<Draws> perMaterial;
+
+    static void readBuffer(unsigned int buffer, std::vector<uint8_t>& bytes)
+    {
+        GLint size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        bytes.resize((size_t)size);
+        if (size > 0)
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, bytes.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+};
+
+#endif
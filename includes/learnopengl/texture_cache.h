@@ -0,0 +1,440 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <learnopengl/mesh_cache.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Content-addressed textures. An image is identified by the hash of its file
+// bytes, so the same picture used by several models (or saved under several
+// names) is decoded and uploaded once and shares one GL texture.
+//
+// The first time an image is seen it is decoded with stb_image, its mip chain
+// is box-filtered on the CPU and everything is written to <hash>.mips in the
+// cache directory. Later loads map that container and upload each level as
+// is: no PNG/JPG decoding and no glGenerateMipmap.
+//
+// Container layout, little-endian:
+//   TextureCacheHeader
+//   level 0 .. levels-1, tightly packed rows, each level 16-byte aligned
+
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+const int TEXTURE_CACHE_MAX_LEVELS = 16;
+
+struct TextureCacheHeader
+{
+    char magic[8];          // "LOGLMIPS"
+    uint32_t version;
+    uint32_t flipped;       // rows flipped on decode, as stbi_set_flip_vertically_on_load
+    uint64_t contentHash;
+    uint64_t fileSize;
+    uint32_t width, height, components, levels;
+    uint64_t levelOffset[TEXTURE_CACHE_MAX_LEVELS];
+};
+
+// Pixels of a whole mip chain, either owned or inside a mapped container
+struct TextureData
+{
+    int width = 0, height = 0, components = 0;
+    std::vector<const uint8_t*> levels;
+    std::vector<uint8_t> storage;
+    MappedFile mapping;
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (size_t level = 0; level < levels.size(); level++)
+            total += levelBytes(level);
+        return total;
+    }
+    int levelWidth(size_t level) const { return std::max(1, width >> (int)level); }
+    int levelHeight(size_t level) const { return std::max(1, height >> (int)level); }
+    size_t levelBytes(size_t level) const { return (size_t)levelWidth(level) * levelHeight(level) * components; }
+};
+
+// Startup counters; times are summed over all threads
+struct TextureCacheStats
+{
+    std::atomic<unsigned int> requests{ 0 };
+    std::atomic<unsigned int> duplicateHits{ 0 };   // served by an already known image
+    std::atomic<unsigned int> decoded{ 0 };
+    std::atomic<unsigned int> cooked{ 0 };          // loaded from a .mips container
+    std::atomic<unsigned long long> decodedBytes{ 0 };
+    std::atomic<unsigned long long> cookedBytes{ 0 };
+    std::atomic<unsigned long long> hashMicroseconds{ 0 }, prepareMicroseconds{ 0 }, uploadMicroseconds{ 0 };
+
+    void reset()
+    {
+        requests = duplicateHits = decoded = cooked = 0;
+        decodedBytes = cookedBytes = 0;
+        hashMicroseconds = prepareMicroseconds = uploadMicroseconds = 0;
+    }
+
+    void print() const
+    {
+        std::printf("textures %4u requests, %u unique, %u duplicate hits | %u decoded (%.1f MB), %u from mip containers (%.1f MB) | "
+                    "hash %.1f ms, decode/map %.1f ms, upload %.1f ms\n",
+            requests.load(), requests.load() - duplicateHits.load(), duplicateHits.load(),
+            decoded.load(), decodedBytes.load() / (1024.0 * 1024.0), cooked.load(), cookedBytes.load() / (1024.0 * 1024.0),
+            hashMicroseconds.load() / 1000.0, prepareMicroseconds.load() / 1000.0, uploadMicroseconds.load() / 1000.0);
+    }
+};
+
+// Process-wide registry, see shared(). key(), claim() and prepare() are
+// thread-safe CPU work; upload(), whenReady(), load() and clear() need the
+// GL thread.
+class TextureRegistry
+{
+public:
+    TextureCacheStats stats;
+
+    static TextureRegistry& shared()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // Where the .mips containers go; empty disables them. flipped must match
+    // the stbi_set_flip_vertically_on_load setting, it is part of the key.
+    void configure(const std::string& directory, bool flipped)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cacheDirectory = directory;
+        flipVertically = flipped;
+        if (!directory.empty())
+        {
+#ifdef _WIN32
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+        }
+    }
+
+    // Content key of an image file. An unreadable file is keyed by its
+    // name, so it fails once and then counts as a duplicate like any other.
+    uint64_t key(const std::string& path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        MappedFile file;
+        uint64_t hash = file.open(path) ? hashBytes(file.data(), file.size())
+                                        : hashBytes((const uint8_t*)path.data(), path.size(), 0x84222325cbf29ce4ull);
+        stats.hashMicroseconds += elapsedMicroseconds(start);
+        return hash ^ (flipVertically ? 0x9e3779b97f4a7c15ull : 0ull);
+    }
+
+    // True for the first caller with this key, which must prepare() and
+    // upload() it; later callers use whenReady() instead
+    bool claim(uint64_t key)
+    {
+        stats.requests++;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.count(key))
+        {
+            stats.duplicateHits++;
+            return false;
+        }
+        entries[key] = Entry();
+        return true;
+    }
+
+    // Maps the cooked container, or decodes the image and cooks it
+    std::shared_ptr<TextureData> prepare(const std::string& path, uint64_t key)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<TextureData> data = std::make_shared<TextureData>();
+        std::string container = containerPath(key);
+        if (!container.empty() && openContainer(container, key, *data))
+        {
+            stats.cooked++;
+            stats.cookedBytes += data->bytes();
+        }
+        else if (decode(path, *data))
+        {
+            stats.decoded++;
+            stats.decodedBytes += data->levelBytes(0);
+            if (!container.empty())
+                writeContainer(container, key, *data);
+        }
+        stats.prepareMicroseconds += elapsedMicroseconds(start);
+        return data;
+    }
+
+    // GL thread: creates the texture for a claimed key and hands it to
+    // everyone waiting on it
+    unsigned int upload(uint64_t key, const TextureData& data, const std::string& path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int texture = createTexture(data, path);
+        std::vector<std::function<void(unsigned int)>> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry& entry = entries[key];
+            entry.texture = texture;
+            entry.ready = true;
+            waiting.swap(entry.waiting);
+        }
+        for (auto& callback : waiting)
+            callback(texture);
+        stats.uploadMicroseconds += elapsedMicroseconds(start);
+        return texture;
+    }
+
+    // GL thread: calls back with the texture of a claimed key, right away
+    // when it is uploaded already
+    void whenReady(uint64_t key, std::function<void(unsigned int)> callback)
+    {
+        unsigned int texture = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry& entry = entries[key];
+            if (!entry.ready)
+            {
+                entry.waiting.push_back(callback);
+                return;
+            }
+            texture = entry.texture;
+        }
+        callback(texture);
+    }
+
+    // GL thread, everything in one go: TextureFromFile through the registry
+    unsigned int load(const std::string& path)
+    {
+        uint64_t textureKey = key(path);
+        if (!claim(textureKey))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries[textureKey].texture;
+        }
+        return upload(textureKey, *prepare(path, textureKey), path);
+    }
+
+    // CPU only: makes sure the image has an up-to-date container
+    void cook(const std::string& path)
+    {
+        uint64_t textureKey = key(path);
+        std::string container = containerPath(textureKey);
+        TextureData data;
+        if (container.empty() || openContainer(container, textureKey, data))
+            return;
+        if (decode(path, data))
+            writeContainer(container, textureKey, data);
+    }
+
+    // GL thread: deletes every texture and forgets all keys
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : entries)
+            if (entry.second.ready)
+                glDeleteTextures(1, &entry.second.texture);
+        entries.clear();
+        stats.reset();
+    }
+
+private:
+    struct Entry
+    {
+        unsigned int texture = 0;
+        bool ready = false;
+        std::vector<std::function<void(unsigned int)>> waiting;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::string cacheDirectory;
+    bool flipVertically = true;
+
+    TextureRegistry() {}
+
+    static unsigned long long elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+    {
+        return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::string containerPath(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cacheDirectory.empty())
+            return std::string();
+        char name[24];
+        std::snprintf(name, sizeof(name), "%016llx.mips", (unsigned long long)key);
+        return cacheDirectory + '/' + name;
+    }
+
+    static bool openContainer(const std::string& container, uint64_t key, TextureData& data)
+    {
+        if (!data.mapping.open(container) || data.mapping.size() < sizeof(TextureCacheHeader))
+            return false;
+        TextureCacheHeader header;
+        std::memcpy(&header, data.mapping.data(), sizeof(header));
+        if (std::memcmp(header.magic, "LOGLMIPS", 8) != 0 || header.version != TEXTURE_CACHE_VERSION ||
+            header.contentHash != key || header.fileSize != data.mapping.size() ||
+            header.levels == 0 || header.levels > (uint32_t)TEXTURE_CACHE_MAX_LEVELS ||
+            header.components < 1 || header.components > 4)
+        {
+            data.mapping.close();
+            return false;
+        }
+        data.width = (int)header.width;
+        data.height = (int)header.height;
+        data.components = (int)header.components;
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            if (header.levelOffset[level] + data.levelBytes(level) > data.mapping.size())
+            {
+                data.levels.clear();
+                data.mapping.close();
+                return false;
+            }
+            data.levels.push_back(data.mapping.data() + header.levelOffset[level]);
+        }
+        return true;
+    }
+
+    // stb_image decode plus a box-filtered mip chain down to 1x1, the same
+    // filter glGenerateMipmap uses on most drivers
+    static bool decode(const std::string& path, TextureData& data)
+    {
+        unsigned char* pixels = stbi_load(path.c_str(), &data.width, &data.height, &data.components, 0);
+        if (!pixels)
+            return false;
+        int levels = 1;
+        while (levels < TEXTURE_CACHE_MAX_LEVELS && (data.width >> levels || data.height >> levels))
+            levels++;
+        std::vector<size_t> offsets(levels);
+        size_t total = 0;
+        for (int level = 0; level < levels; level++)
+        {
+            offsets[level] = total;
+            total += data.levelBytes(level);
+        }
+        data.storage.resize(total);
+        std::memcpy(data.storage.data(), pixels, data.levelBytes(0));
+        stbi_image_free(pixels);
+
+        int c = data.components;
+        for (int level = 1; level < levels; level++)
+        {
+            const uint8_t* src = &data.storage[offsets[level - 1]];
+            uint8_t* dst = &data.storage[offsets[level]];
+            int sw = data.levelWidth(level - 1), sh = data.levelHeight(level - 1);
+            int dw = data.levelWidth(level), dh = data.levelHeight(level);
+            for (int y = 0; y < dh; y++)
+            {
+                int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                for (int x = 0; x < dw; x++)
+                {
+                    int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                    for (int k = 0; k < c; k++)
+                    {
+                        int sum = src[(y0 * sw + x0) * c + k] + src[(y0 * sw + x1) * c + k] +
+                                  src[(y1 * sw + x0) * c + k] + src[(y1 * sw + x1) * c + k];
+                        dst[(y * dw + x) * c + k] = (uint8_t)((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+        for (int level = 0; level < levels; level++)
+            data.levels.push_back(&data.storage[offsets[level]]);
+        return true;
+    }
+
+    // written to a temporary file and renamed, like the mesh cache
+    void writeContainer(const std::string& container, uint64_t key, const TextureData& data)
+    {
+        TextureCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "LOGLMIPS", 8);
+        header.version = TEXTURE_CACHE_VERSION;
+        header.flipped = flipVertically ? 1 : 0;
+        header.contentHash = key;
+        header.width = (uint32_t)data.width;
+        header.height = (uint32_t)data.height;
+        header.components = (uint32_t)data.components;
+        header.levels = (uint32_t)data.levels.size();
+        uint64_t offset = (sizeof(header) + 15) & ~(uint64_t)15;
+        for (size_t level = 0; level < data.levels.size(); level++)
+        {
+            header.levelOffset[level] = offset;
+            offset = (offset + data.levelBytes(level) + 15) & ~(uint64_t)15;
+        }
+        header.fileSize = offset;
+
+        // per thread, two cooks of the same image may race
+        std::string temporary = container + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+            return;
+        static const uint8_t padding[16] = {};
+        uint64_t position = 0;
+        auto put = [&](const void* bytes, size_t size) {
+            position += size;
+            return size == 0 || std::fwrite(bytes, 1, size, out) == size;
+        };
+        bool written = put(&header, sizeof(header));
+        for (size_t level = 0; level < data.levels.size() && written; level++)
+            written = put(padding, (size_t)(header.levelOffset[level] - position)) && put(data.levels[level], data.levelBytes(level));
+        written = written && put(padding, (size_t)(header.fileSize - position));
+        written = std::fclose(out) == 0 && written;
+        if (written)
+            std::remove(container.c_str());
+        if (!written || std::rename(temporary.c_str(), container.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            std::cout << "TEXTURE_CACHE::WRITE_FAILED: " << container << std::endl;
+        }
+    }
+
+    // Same formats and sampling as TextureFromFile, with the levels given
+    // instead of generated
+    static unsigned int createTexture(const TextureData& data, const std::string& path)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        if (data.levels.empty())
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return texture;
+        }
+        GLenum format = data.components == 1 ? GL_RED : data.components == 2 ? GL_RG : data.components == 3 ? GL_RGB : GL_RGBA;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t level = 0; level < data.levels.size(); level++)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, data.levelWidth(level), data.levelHeight(level), 0,
+                         format, GL_UNSIGNED_BYTE, data.levels[level]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)data.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return texture;
+    }
+};
+
+#endif
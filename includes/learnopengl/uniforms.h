@@ -0,0 +1,234 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Process-wide counters for uniform name lookups and heap allocations. Lookups
+// are counted once countUniformLookups() has hooked glGetUniformLocation, which
+// also catches the ones done inside Shader::set* and Mesh::Draw. Allocations are
+// counted in the one translation unit that defines LEARNOPENGL_COUNT_ALLOCATIONS
+// before including this header.
+struct UniformStats
+{
+    static inline std::atomic<unsigned long long> nameLookups{ 0 };
+    static inline std::atomic<unsigned long long> allocations{ 0 };
+};
+
+inline PFNGLGETUNIFORMLOCATIONPROC& uniformLookupTarget()
+{
+    static PFNGLGETUNIFORMLOCATIONPROC target = nullptr;
+    return target;
+}
+
+inline GLint APIENTRY countedGetUniformLocation(GLuint program, const GLchar* name)
+{
+    UniformStats::nameLookups.fetch_add(1, std::memory_order_relaxed);
+    return uniformLookupTarget()(program, name);
+}
+
+// call once after gladLoadGLLoader
+inline void countUniformLookups()
+{
+    if (glad_glGetUniformLocation != countedGetUniformLocation)
+    {
+        uniformLookupTarget() = glad_glGetUniformLocation;
+        glad_glGetUniformLocation = countedGetUniformLocation;
+    }
+}
+
+// Per-frame deltas of UniformStats, call endFrame() once at the end of each frame.
+struct FrameCounters
+{
+    unsigned long long lookups = 0;
+    unsigned long long allocations = 0;
+
+    void endFrame()
+    {
+        unsigned long long l = UniformStats::nameLookups.load(std::memory_order_relaxed);
+        unsigned long long a = UniformStats::allocations.load(std::memory_order_relaxed);
+        lookups = l - lastLookups;
+        allocations = a - lastAllocations;
+        lastLookups = l;
+        lastAllocations = a;
+    }
+
+private:
+    unsigned long long lastLookups = UniformStats::nameLookups.load();
+    unsigned long long lastAllocations = UniformStats::allocations.load();
+};
+
+// Prevalidated uniform location. set() writes straight to the location of the
+// currently bound program, no strings involved. An unresolved handle keeps
+// location -1, which GL silently ignores.
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+    void set(const T& value) const;
+};
+
+template <> inline void Uniform<int>::set(const int& v) const { glUniform1i(location, v); }
+template <> inline void Uniform<bool>::set(const bool& v) const { glUniform1i(location, (int)v); }
+template <> inline void Uniform<float>::set(const float& v) const { glUniform1f(location, v); }
+template <> inline void Uniform<glm::vec2>::set(const glm::vec2& v) const { glUniform2fv(location, 1, &v[0]); }
+template <> inline void Uniform<glm::vec3>::set(const glm::vec3& v) const { glUniform3fv(location, 1, &v[0]); }
+template <> inline void Uniform<glm::vec4>::set(const glm::vec4& v) const { glUniform4fv(location, 1, &v[0]); }
+template <> inline void Uniform<glm::mat4>::set(const glm::mat4& m) const { glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]); }
+
+// Whole-array handle: one glUniform*v call fills elements [0, count).
+template <typename T>
+struct UniformArray
+{
+    GLint location = -1;
+    GLsizei size = 0;
+    void set(const T* values, GLsizei count) const;
+};
+
+template <> inline void UniformArray<float>::set(const float* v, GLsizei n) const { glUniform1fv(location, std::min(n, size), v); }
+template <> inline void UniformArray<glm::vec3>::set(const glm::vec3* v, GLsizei n) const { glUniform3fv(location, std::min(n, size), &v[0][0]); }
+template <> inline void UniformArray<glm::vec4>::set(const glm::vec4* v, GLsizei n) const { glUniform4fv(location, std::min(n, size), &v[0][0]); }
+template <> inline void UniformArray<glm::mat4>::set(const glm::mat4* m, GLsizei n) const { glUniformMatrix4fv(location, std::min(n, size), GL_FALSE, &m[0][0][0]); }
+
+template <typename T> constexpr GLenum uniformGLType();
+template <> constexpr GLenum uniformGLType<int>() { return GL_INT; }
+template <> constexpr GLenum uniformGLType<bool>() { return GL_BOOL; }
+template <> constexpr GLenum uniformGLType<float>() { return GL_FLOAT; }
+template <> constexpr GLenum uniformGLType<glm::vec2>() { return GL_FLOAT_VEC2; }
+template <> constexpr GLenum uniformGLType<glm::vec3>() { return GL_FLOAT_VEC3; }
+template <> constexpr GLenum uniformGLType<glm::vec4>() { return GL_FLOAT_VEC4; }
+template <> constexpr GLenum uniformGLType<glm::mat4>() { return GL_FLOAT_MAT4; }
+
+// Snapshot of every active uniform of a linked program, taken once at startup.
+// Handles are resolved against it by name during setup; the render loop only
+// ever touches the returned handles.
+class UniformTable
+{
+public:
+    struct Entry
+    {
+        std::string name;   // arrays of basic types are stored without the "[0]"
+        GLenum type;
+        GLint size;
+        GLint location;
+    };
+
+    std::vector<Entry> entries;
+
+    explicit UniformTable(unsigned int program) : program(program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            Entry entry;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), &length, &entry.size, &entry.type, buffer.data());
+            entry.name.assign(buffer.data(), length);
+            entry.location = glGetUniformLocation(program, entry.name.c_str());
+            if (entry.location < 0)
+                continue; // uniform block members have no location
+            entry.name = baseName(entry.name);
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    }
+
+    // quiet check for uniforms only some variants of a program declare
+    bool has(const std::string& name) const
+    {
+        std::string key = baseName(name);
+        auto it = std::lower_bound(entries.begin(), entries.end(), key,
+            [](const Entry& e, const std::string& k) { return e.name < k; });
+        return it != entries.end() && it->name == key;
+    }
+
+    template <typename T>
+    Uniform<T> get(const std::string& name) const
+    {
+        Uniform<T> handle;
+        if (const Entry* entry = find(name, uniformGLType<T>()))
+            handle.location = entry->location;
+        return handle;
+    }
+
+    template <typename T>
+    UniformArray<T> array(const std::string& name) const
+    {
+        UniformArray<T> handle;
+        if (const Entry* entry = find(name, uniformGLType<T>()))
+        {
+            handle.location = entry->location;
+            handle.size = entry->size;
+        }
+        return handle;
+    }
+
+private:
+    unsigned int program;
+
+    static std::string baseName(const std::string& name)
+    {
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            return name.substr(0, name.size() - 3);
+        return name;
+    }
+
+    const Entry* find(const std::string& name, GLenum type) const
+    {
+        std::string key = baseName(name);
+        auto it = std::lower_bound(entries.begin(), entries.end(), key,
+            [](const Entry& e, const std::string& k) { return e.name < k; });
+        if (it == entries.end() || it->name != key)
+        {
+            std::cout << "WARNING::UNIFORM::NOT_ACTIVE: " << name << std::endl;
+            return nullptr;
+        }
+        // GL_BOOL uniforms may be set through either int or bool handles
+        bool boolAsInt = (type == GL_INT && it->type == GL_BOOL) || (type == GL_BOOL && it->type == GL_INT);
+        if (it->type != type && !boolAsInt && !isSampler(it->type, type))
+        {
+            std::cout << "ERROR::UNIFORM::TYPE_MISMATCH: " << name << std::endl;
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    static bool isSampler(GLenum actual, GLenum requested)
+    {
+        return requested == GL_INT &&
+            (actual == GL_SAMPLER_1D || actual == GL_SAMPLER_2D || actual == GL_SAMPLER_3D ||
+             actual == GL_SAMPLER_CUBE || actual == GL_SAMPLER_2D_ARRAY || actual == GL_SAMPLER_BUFFER ||
+             actual == GL_INT_SAMPLER_BUFFER || actual == GL_UNSIGNED_INT_SAMPLER_BUFFER);
+    }
+};
+
+#ifdef LEARNOPENGL_COUNT_ALLOCATIONS
+// Replacement global allocation functions, forwarding to malloc/free.
+void* operator new(std::size_t size)
+{
+    UniformStats::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+#endif
@@ -0,0 +1,504 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniforms.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ---- quantization ----------------------------------------------------------
+
+// IEEE half, round to nearest even; overflow saturates to infinity
+inline uint16_t packHalf(float value)
+{
+    uint32_t f;
+    std::memcpy(&f, &value, 4);
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t abs = f & 0x7fffffffu;
+    if (abs >= 0x7f800000u) // inf / nan
+        return (uint16_t)(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+    if (abs >= 0x47800000u) // too large for a half
+        return (uint16_t)(sign | 0x7c00u);
+    if (abs < 0x38800000u) // subnormal half or zero
+    {
+        float magnitude;
+        std::memcpy(&magnitude, &abs, 4);
+        return (uint16_t)(sign | (uint32_t)std::lrint(magnitude * 16777216.0f)); // 2^24
+    }
+    uint32_t half = (abs - 0x38000000u) >> 13;
+    uint32_t rest = abs & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++;
+    return (uint16_t)(sign | half);
+}
+
+inline int16_t packSnorm16(float value)
+{
+    return (int16_t)std::lrint(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+inline uint8_t packUnorm8(float value)
+{
+    return (uint8_t)std::lrint(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+}
+
+// Octahedral unit vector encoding: the sphere is projected onto an octahedron
+// and unfolded into [-1, 1]^2, two snorm16 values instead of three floats.
+// Matches octDecode() in the vertex shaders.
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length < 1e-20f)
+        return glm::vec2(0.0f, 0.0f); // degenerate input decodes to +Z
+    n /= length;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+        e = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    return e;
+}
+
+inline glm::vec3 octDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+        n = glm::vec3((1.0f - std::fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f), n.z);
+    return glm::normalize(n);
+}
+
+// ---- vertex layouts --------------------------------------------------------
+
+// Untextured geometry whose positions are exact in half precision (the demo
+// cubes): 12 bytes instead of 32
+struct CompactVertex
+{
+    uint16_t position[4];   // half xyz, w unused
+    int16_t normal[2];      // octahedral
+};
+
+// Static model vertex, 20 bytes instead of 88. Positions are snorm16 inside
+// the mesh's bounding box and expanded by positionScale / positionOffset in
+// the vertex shader. The bitangent is rebuilt as cross(normal, tangent) * w.
+struct PackedVertex
+{
+    int16_t position[4];    // xyz in the box, w = bitangent sign
+    int16_t normal[2];      // octahedral
+    int16_t tangent[2];     // octahedral
+    uint16_t texCoords[2];  // half, UVs may tile outside [0, 1]
+};
+
+// Skinned model vertex, 32 bytes instead of 88
+struct PackedSkinnedVertex
+{
+    PackedVertex base;
+    uint16_t boneIds[4];    // PACKED_NO_BONE for unused slots
+    uint8_t weights[4];     // unorm8, always summing to 255
+};
+
+const uint16_t PACKED_NO_BONE = 0xffff;
+
+// Attribute locations match the original layouts: 0 position, 1 normal,
+// 2 texture coordinates, 3 tangent, 5 bone ids, 6 weights.
+inline void setupCompactAttributes()
+{
+    glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(1);
+}
+
+inline void setupPackedAttributes(bool skinned)
+{
+    GLsizei stride = skinned ? sizeof(PackedSkinnedVertex) : sizeof(PackedVertex);
+    glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, texCoords));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, tangent));
+    glEnableVertexAttribArray(3);
+    if (skinned)
+    {
+        glVertexAttribIPointer(5, 4, GL_UNSIGNED_SHORT, stride, (void*)offsetof(PackedSkinnedVertex, boneIds));
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PackedSkinnedVertex, weights));
+        glEnableVertexAttribArray(6);
+    }
+}
+
+// ---- indexing --------------------------------------------------------------
+
+// Merges bit-identical vertices of a non-indexed float stream. The first
+// `floats` floats of each `stride`-float vertex are kept (and compared), so
+// attributes nobody reads are dropped at the same time.
+inline void weldVertices(const float* data, size_t count, int stride, int floats,
+                         std::vector<float>& unique, std::vector<uint32_t>& indices)
+{
+    std::unordered_map<std::string, uint32_t> seen;
+    unique.clear();
+    indices.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* v = data + i * stride;
+        std::string key((const char*)v, floats * sizeof(float));
+        auto inserted = seen.emplace(key, (uint32_t)(unique.size() / floats));
+        if (inserted.second)
+            unique.insert(unique.end(), v, v + floats);
+        indices.push_back(inserted.first->second);
+    }
+}
+
+// Narrowest GL index type for vertexCount vertices
+inline GLenum indexTypeFor(size_t vertexCount)
+{
+    return vertexCount <= 0x100 ? GL_UNSIGNED_BYTE : vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline size_t indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// Indices narrowed to the given type, as stored in the index buffer
+inline std::vector<uint8_t> narrowIndices(const std::vector<uint32_t>& indices, GLenum type)
+{
+    size_t size = indexSize(type);
+    std::vector<uint8_t> narrow(indices.size() * size);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (size == 1)
+            narrow[i] = (uint8_t)indices[i];
+        else if (size == 2)
+        {
+            uint16_t index = (uint16_t)indices[i];
+            std::memcpy(&narrow[i * 2], &index, 2);
+        }
+        else
+            std::memcpy(&narrow[i * 4], &indices[i], 4);
+    }
+    return narrow;
+}
+
+// Uploads indices to the bound GL_ELEMENT_ARRAY_BUFFER in the given type
+inline void uploadIndices(const std::vector<uint32_t>& indices, GLenum type)
+{
+    std::vector<uint8_t> narrow = narrowIndices(indices, type);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size(), narrow.data(), GL_STATIC_DRAW);
+}
+
+// ---- sizes -----------------------------------------------------------------
+
+struct VertexFormatStats
+{
+    size_t vertices = 0;
+    size_t indices = 0;
+    size_t bytesBefore = 0;     // the loader's full-float vertices + 32-bit indices
+    size_t bytesAfter = 0;
+    size_t vertexBytesBefore = 0;
+    size_t vertexBytesAfter = 0;
+
+    void add(size_t vertexCount, size_t indexCount, size_t strideBefore, size_t strideAfter, size_t indexBytesAfter)
+    {
+        vertices += vertexCount;
+        indices += indexCount;
+        vertexBytesBefore += vertexCount * strideBefore;
+        vertexBytesAfter += vertexCount * strideAfter;
+        bytesBefore += vertexCount * strideBefore + indexCount * sizeof(uint32_t);
+        bytesAfter += vertexCount * strideAfter + indexBytesAfter;
+    }
+
+    void print(const char* name) const
+    {
+        double perVertexBefore = vertices ? (double)vertexBytesBefore / vertices : 0.0;
+        double perVertexAfter = vertices ? (double)vertexBytesAfter / vertices : 0.0;
+        std::printf("%-8s %9zu vertices %9zu indices | %5.1f -> %5.1f bytes/vertex | VRAM %7.2f -> %7.2f MB (%.1fx)\n",
+            name, vertices, indices, perVertexBefore, perVertexAfter,
+            bytesBefore / (1024.0 * 1024.0), bytesAfter / (1024.0 * 1024.0),
+            bytesAfter ? (double)bytesBefore / bytesAfter : 0.0);
+    }
+};
+
+// ---- packed models ---------------------------------------------------------
+
+// A simplified level of detail (see lod.h): a range of the mesh's index
+// buffer, after the full-detail indices, over the same vertices
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;            // model units, never less than a finer level's
+};
+
+const int MAX_MESH_LODS = 3;    // besides the full mesh
+
+struct PackedMesh
+{
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    GLsizei indexCount = 0;                       // full detail
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionOffset = glm::vec3(0.0f);   // box center
+    glm::vec3 positionScale = glm::vec3(1.0f);    // box half extent
+    std::vector<std::pair<int, unsigned int>> textures; // texture unit, texture
+    uint32_t lodCount = 0;
+    MeshLod lods[MAX_MESH_LODS];
+
+    // level 0 is the full mesh, 1..lodCount the simplified ones
+    GLsizei levelIndexCount(int level) const { return level == 0 ? indexCount : (GLsizei)lods[level - 1].indexCount; }
+    GLsizei levelFirstIndex(int level) const { return level == 0 ? 0 : (GLsizei)lods[level - 1].firstIndex; }
+    float levelError(int level) const { return level == 0 ? 0.0f : lods[level - 1].error; }
+};
+
+// CPU side of a PackedMesh: the vertex and index bytes exactly as uploaded
+struct EncodedMesh
+{
+    std::vector<uint8_t> vertices;
+    std::vector<uint8_t> indices;   // full detail, then each level
+    size_t vertexCount = 0;
+    GLsizei indexCount = 0;         // full detail
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    size_t sourceStride = 0;    // bytes per vertex before packing
+    uint32_t lodCount = 0;
+    MeshLod lods[MAX_MESH_LODS];
+
+    // every index in the buffer, levels included
+    size_t totalIndexCount() const { return lodCount ? lods[lodCount - 1].firstIndex + lods[lodCount - 1].indexCount : (size_t)indexCount; }
+};
+
+// A learnopengl Model re-encoded into the packed formats. The sampler names
+// Mesh::Draw would use (texture_diffuse1, texture_specular1, ...) get fixed
+// texture units shared by every model, so drawing never looks up a uniform;
+// bindSamplers() points a program's samplers at those units once.
+class PackedModel
+{
+public:
+    static const int SAMPLERS_PER_TYPE = 4;
+
+    std::vector<PackedMesh> meshes;
+    VertexFormatStats stats;
+
+    // Packs every mesh and frees the model's own vertex and index buffers;
+    // the CPU-side copies (and the bone map, for animation) stay in the model.
+    template <typename ModelT>
+    void pack(ModelT& model, bool skinned)
+    {
+        for (auto& mesh : model.meshes)
+        {
+            meshes.push_back(packMesh(mesh, skinned));
+            releaseMeshBuffers(mesh);
+        }
+    }
+
+    // Packed vertex and index bytes of one mesh, without touching GL
+    template <typename MeshT>
+    static EncodedMesh encodeMesh(const MeshT& mesh, bool skinned)
+    {
+        EncodedMesh encoded;
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if (!mesh.vertices.empty())
+        {
+            lo = hi = mesh.vertices[0].Position;
+            for (const auto& v : mesh.vertices)
+            {
+                lo = glm::min(lo, v.Position);
+                hi = glm::max(hi, v.Position);
+            }
+        }
+        encoded.positionOffset = (lo + hi) * 0.5f;
+        encoded.positionScale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+        encoded.vertexCount = mesh.vertices.size();
+        encoded.sourceStride = sizeof(mesh.vertices[0]);
+
+        size_t stride = skinned ? sizeof(PackedSkinnedVertex) : sizeof(PackedVertex);
+        encoded.vertices.resize(mesh.vertices.size() * stride);
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            const auto& v = mesh.vertices[i];
+            PackedVertex p;
+            glm::vec3 q = (v.Position - encoded.positionOffset) / encoded.positionScale;
+            glm::vec3 n = v.Normal, t = v.Tangent;
+            glm::vec2 octNormal = octEncode(n), octTangent = octEncode(t);
+            bool flipped = glm::dot(glm::cross(n, t), v.Bitangent) < 0.0f;
+            p.position[0] = packSnorm16(q.x);
+            p.position[1] = packSnorm16(q.y);
+            p.position[2] = packSnorm16(q.z);
+            p.position[3] = flipped ? -32767 : 32767;
+            p.normal[0] = packSnorm16(octNormal.x);
+            p.normal[1] = packSnorm16(octNormal.y);
+            p.tangent[0] = packSnorm16(octTangent.x);
+            p.tangent[1] = packSnorm16(octTangent.y);
+            p.texCoords[0] = packHalf(v.TexCoords.x);
+            p.texCoords[1] = packHalf(v.TexCoords.y);
+            if (skinned)
+            {
+                PackedSkinnedVertex s;
+                s.base = p;
+                packBones(v.m_BoneIDs, v.m_Weights, s.boneIds, s.weights);
+                std::memcpy(&encoded.vertices[i * stride], &s, sizeof(s));
+            }
+            else
+                std::memcpy(&encoded.vertices[i * stride], &p, sizeof(p));
+        }
+
+        encoded.indexCount = (GLsizei)mesh.indices.size();
+        encoded.indexType = indexTypeFor(mesh.vertices.size());
+        std::vector<uint32_t> indices(mesh.indices.begin(), mesh.indices.end());
+        encoded.indices = narrowIndices(indices, encoded.indexType);
+        return encoded;
+    }
+
+    // Uploads one mesh. vertices and indices hold the bytes described by
+    // layout (their own vectors are not read), so they can point straight
+    // into a memory-mapped file.
+    PackedMesh upload(const EncodedMesh& layout, const void* vertices, const void* indices, bool skinned)
+    {
+        PackedMesh packed;
+        packed.positionOffset = layout.positionOffset;
+        packed.positionScale = layout.positionScale;
+        packed.indexCount = layout.indexCount;
+        packed.indexType = layout.indexType;
+        packed.lodCount = layout.lodCount;
+        std::copy(layout.lods, layout.lods + layout.lodCount, packed.lods);
+        size_t stride = skinned ? sizeof(PackedSkinnedVertex) : sizeof(PackedVertex);
+        size_t indexBytes = layout.totalIndexCount() * indexSize(layout.indexType);
+
+        glGenVertexArrays(1, &packed.VAO);
+        glGenBuffers(1, &packed.VBO);
+        glGenBuffers(1, &packed.EBO);
+        glBindVertexArray(packed.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, packed.VBO);
+        glBufferData(GL_ARRAY_BUFFER, layout.vertexCount * stride, vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, packed.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+        setupPackedAttributes(skinned);
+        glBindVertexArray(0);
+
+        stats.add(layout.vertexCount, layout.indexCount, layout.sourceStride, stride, indexBytes);
+        return packed;
+    }
+
+    // Gives a texture the next unit of its type, the way Mesh::Draw numbers
+    // its samplers; count holds the per-type counters of the mesh so far.
+    static void addTexture(PackedMesh& mesh, const std::string& type, unsigned int id, int* count)
+    {
+        int index = (int)(std::find(textureTypes(), textureTypes() + 4, type) - textureTypes());
+        if (index < 4 && count[index] < SAMPLERS_PER_TYPE)
+            mesh.textures.push_back({ index * SAMPLERS_PER_TYPE + count[index]++, id });
+    }
+
+    // Mesh keeps its buffer names private; they are read back from its VAO
+    template <typename MeshT>
+    static void releaseMeshBuffers(MeshT& mesh)
+    {
+        GLint buffers[2] = { 0, 0 };
+        glBindVertexArray(mesh.VAO);
+        glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffers[0]);
+        glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffers[1]);
+        glBindVertexArray(0);
+        GLuint names[2] = { (GLuint)buffers[0], (GLuint)buffers[1] };
+        glDeleteBuffers(2, names);
+        glDeleteVertexArrays(1, &mesh.VAO);
+        mesh.VAO = 0;
+    }
+
+    // call with the program bound
+    static void bindSamplers(const UniformTable& uniforms)
+    {
+        for (int type = 0; type < 4; type++)
+            for (int number = 1; number <= SAMPLERS_PER_TYPE; number++)
+            {
+                std::string name = textureTypes()[type] + std::to_string(number);
+                if (uniforms.has(name))
+                    uniforms.get<int>(name).set(type * SAMPLERS_PER_TYPE + number - 1);
+            }
+    }
+
+    void drawMesh(size_t index, const Uniform<glm::vec3>& positionOffset, const Uniform<glm::vec3>& positionScale) const
+    {
+        const PackedMesh& mesh = meshes[index];
+        for (const auto& texture : mesh.textures)
+        {
+            glActiveTexture(GL_TEXTURE0 + texture.first);
+            glBindTexture(GL_TEXTURE_2D, texture.second);
+        }
+        positionOffset.set(mesh.positionOffset);
+        positionScale.set(mesh.positionScale);
+        glBindVertexArray(mesh.VAO);
+        glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, 0);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void draw(const Uniform<glm::vec3>& positionOffset, const Uniform<glm::vec3>& positionScale) const
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+            drawMesh(i, positionOffset, positionScale);
+    }
+
+    void destroy()
+    {
+        for (PackedMesh& mesh : meshes)
+        {
+            glDeleteVertexArrays(1, &mesh.VAO);
+            glDeleteBuffers(1, &mesh.VBO);
+            glDeleteBuffers(1, &mesh.EBO);
+        }
+        meshes.clear();
+    }
+
+private:
+    static const std::string* textureTypes()
+    {
+        static const std::string types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        return types;
+    }
+
+    template <typename MeshT>
+    PackedMesh packMesh(const MeshT& mesh, bool skinned)
+    {
+        EncodedMesh encoded = encodeMesh(mesh, skinned);
+        PackedMesh packed = upload(encoded, encoded.vertices.data(), encoded.indices.data(), skinned);
+        int count[4] = { 0, 0, 0, 0 };
+        for (const auto& texture : mesh.textures)
+            addTexture(packed, texture.type, texture.id, count);
+        return packed;
+    }
+
+    // Up to four influences with unorm8 weights. The rounding error goes to
+    // the largest weight so the weights still sum to exactly 1.
+    static void packBones(const int* ids, const float* weights, uint16_t* outIds, uint8_t* outWeights)
+    {
+        float total = 0.0f;
+        for (int i = 0; i < 4; i++)
+            if (ids[i] >= 0)
+                total += weights[i];
+        int sum = 0, largest = -1;
+        for (int i = 0; i < 4; i++)
+        {
+            bool used = ids[i] >= 0 && total > 0.0f;
+            outIds[i] = used ? (uint16_t)ids[i] : PACKED_NO_BONE;
+            outWeights[i] = used ? packUnorm8(weights[i] / total) : 0;
+            sum += outWeights[i];
+            if (used && (largest < 0 || outWeights[i] > outWeights[largest]))
+                largest = i;
+        }
+        if (largest >= 0)
+            outWeights[largest] = (uint8_t)(outWeights[largest] + 255 - sum);
+    }
+};
+
+#endif